@@ -0,0 +1,111 @@
+#include "annotationhistory.h"
+#include "annotationjournal.h"
+#include "trace.h"
+
+#include <QUndoCommand>
+#include <QUndoStack>
+
+class AnnotationHistory::AddCommand : public QUndoCommand {
+public:
+    AddCommand(AnnotationHistory* h, MarkupId id, const Markup& m)
+        : QUndoCommand(QStringLiteral("Add Markup")), m_h(h), m_id(id), m_markup(m) {}
+    void redo() override {
+        if (!m_h->insert(m_id, m_markup)) setObsolete(true);   // nothing to undo; push() drops it
+    }
+    void undo() override { m_h->erase(m_id); }
+
+private:
+    AnnotationHistory* m_h;
+    MarkupId m_id;
+    Markup   m_markup;
+};
+
+class AnnotationHistory::RemoveCommand : public QUndoCommand {
+public:
+    RemoveCommand(AnnotationHistory* h, MarkupId id, const Markup& m)
+        : QUndoCommand(QStringLiteral("Delete Markup")), m_h(h), m_id(id), m_markup(m) {}
+    void redo() override { m_h->erase(m_id); }
+    void undo() override { m_h->insert(m_id, m_markup); }
+
+private:
+    AnnotationHistory* m_h;
+    MarkupId m_id;
+    Markup   m_markup;
+};
+
+class AnnotationHistory::RestyleCommand : public QUndoCommand {
+public:
+    RestyleCommand(AnnotationHistory* h, MarkupId id, MarkupKind fromKind, const QColor& from,
+                   MarkupKind toKind, const QColor& to)
+        : QUndoCommand(QStringLiteral("Change Markup")), m_h(h), m_id(id),
+          m_fromKind(fromKind), m_toKind(toKind), m_from(from), m_to(to) {}
+    void redo() override { m_h->setStyle(m_id, m_toKind, m_to); }
+    void undo() override { m_h->setStyle(m_id, m_fromKind, m_from); }
+
+private:
+    AnnotationHistory* m_h;
+    MarkupId   m_id;
+    MarkupKind m_fromKind, m_toKind;
+    QColor     m_from, m_to;
+};
+
+AnnotationHistory::AnnotationHistory(AnnotationStore* store, AnnotationJournal* journal, QObject* parent)
+    : QObject(parent), m_store(store), m_journal(journal), m_stack(new QUndoStack(this))
+{
+    m_stack->setUndoLimit(kUndoLimit);
+}
+
+// Ids are never reused, so the new markup takes nextId() and keeps it through undo/redo.
+MarkupId AnnotationHistory::add(const Markup& m) {
+    TRACE_SPAN("annotations", "add");
+    const MarkupId id = m_store->nextId();
+    m_stack->push(new AddCommand(this, id, m));   // push() runs redo()
+    return m_store->contains(id) ? id : kNoMarkup;
+}
+
+bool AnnotationHistory::remove(MarkupId id) {
+    if (!m_store->contains(id)) return false;
+    TRACE_SPAN("annotations", "remove");
+    m_stack->push(new RemoveCommand(this, id, m_store->markup(id)));
+    return true;
+}
+
+bool AnnotationHistory::restyle(MarkupId id, MarkupKind kind, const QColor& color) {
+    if (!m_store->contains(id)) return false;
+    const MarkupKind oldKind = m_store->kind(id);
+    const QColor old = m_store->color(id);
+    if (oldKind == kind && old == color) return false;
+    TRACE_SPAN("annotations", "restyle");
+    m_stack->push(new RestyleCommand(this, id, oldKind, old, kind, color));
+    return true;
+}
+
+void AnnotationHistory::clear() {
+    m_stack->clear();
+}
+
+bool AnnotationHistory::insert(MarkupId id, const Markup& m) {
+    if (!m_store->addWithId(id, m)) return false;
+    m_journal->recordAdd(id);
+    m_journal->flush();   // appends just this record
+    emit markupChanged(m.page, m_store->bounds(id));
+    return true;
+}
+
+bool AnnotationHistory::erase(MarkupId id) {
+    const int page = m_store->page(id);
+    const QRectF bounds = m_store->bounds(id);
+    if (!m_store->remove(id)) return false;
+    m_journal->recordRemove(id);
+    m_journal->flush();
+    emit markupChanged(page, bounds);
+    return true;
+}
+
+bool AnnotationHistory::setStyle(MarkupId id, MarkupKind kind, const QColor& color) {
+    if (!m_store->restyle(id, kind, color)) return false;
+    m_journal->recordUpdate(id);
+    m_journal->flush();
+    emit markupChanged(m_store->page(id), m_store->bounds(id));
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <QObject>
+#include <QColor>
+#include <QRectF>
+
+#include "annotationstore.h"
+
+class QUndoStack;
+class AnnotationJournal;
+
+// Undo/redo for markup edits, as a QUndoStack of commands that each hold only
+// their own change: the markup they add or remove (its quads are an implicitly
+// shared QVector, never deep-copied between undo and redo) or the old and new
+// style. A step costs O(that markup), whatever else is on the document.
+//
+// Every step that gets applied — done, undone or redone — goes to the journal
+// as it happens, so the sidecar always replays to what's on screen.
+class AnnotationHistory : public QObject {
+    Q_OBJECT
+public:
+    static constexpr int kUndoLimit = 500;
+
+    AnnotationHistory(AnnotationStore* store, AnnotationJournal* journal, QObject* parent = nullptr);
+
+    QUndoStack* stack() const { return m_stack; }
+
+    MarkupId add(const Markup& m);
+    bool remove(MarkupId id);
+    bool restyle(MarkupId id, MarkupKind kind, const QColor& color);
+
+    // Forget every step (the store was reloaded).
+    void clear();
+
+signals:
+    // The area a markup covers (before or after the step) needs repainting.
+    void markupChanged(int page, const QRectF& boundsPts);
+
+private:
+    class AddCommand;
+    class RemoveCommand;
+    class RestyleCommand;
+
+    // what the commands do, in both directions
+    bool insert(MarkupId id, const Markup& m);
+    bool erase(MarkupId id);
+    bool setStyle(MarkupId id, MarkupKind kind, const QColor& color);
+
+    AnnotationStore*   m_store;
+    AnnotationJournal* m_journal;
+    QUndoStack*        m_stack;
+};
@@ -0,0 +1,327 @@
+#include "annotationjournal.h"
+#include "trace.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QVarLengthArray>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "journal records are written in host order");
+
+namespace {
+const char kMagic[8] = { 'P', 'D', 'E', 'A', 'N', 'N', '\0', '\0' };
+
+constexpr int kCompactMinRecords = 256;   // short journals aren't worth rewriting
+constexpr int kCompactRatio      = 2;     // rewrite once records > ratio x live markups
+
+enum : quint16 { OpAdd = 1, OpRemove = 2 };
+
+struct FileHeader {
+    char    magic[8];
+    quint32 version;
+    quint32 reserved;
+};
+
+struct RecordHeader {
+    quint16 op;
+    quint16 reserved;
+    quint32 quadCount;
+    quint32 id;
+    qint32  page;
+    quint32 rgba;
+    quint32 kind;
+    quint32 check;      // FNV-1a over the fields above and the quads
+};
+// version 1: at most 65535 quads a record; read on open and rewritten as version 2
+struct RecordHeaderV1 {
+    quint16 op;
+    quint16 quadCount;
+    quint32 id;
+    qint32  page;
+    quint32 rgba;
+    quint32 kind;
+    quint32 check;
+};
+constexpr qsizetype kQuadBytes = 4 * sizeof(float);
+
+quint32 fnv1a(const char* p, qsizetype n, quint32 h = 2166136261u) {
+    for (qsizetype i = 0; i < n; ++i) { h ^= quint8(p[i]); h *= 16777619u; }
+    return h;
+}
+
+void encodeRecord(QByteArray& out, quint16 op, MarkupId id, int page, MarkupKind kind, QRgb color,
+                  const float* xywh, int quadCount) {
+    RecordHeader h{};
+    h.op = op;
+    h.quadCount = quint32(quadCount);
+    h.id = id;
+    h.page = page;
+    h.rgba = color;
+    h.kind = quint32(kind);
+    const char* quads = reinterpret_cast<const char*>(xywh);
+    h.check = fnv1a(quads, quadCount * kQuadBytes,
+                    fnv1a(reinterpret_cast<const char*>(&h), offsetof(RecordHeader, check)));
+    out.append(reinterpret_cast<const char*>(&h), sizeof h);
+    if (quadCount) out.append(quads, quadCount * kQuadBytes);
+}
+
+// Interleave a markup's SoA quad columns into x,y,w,h records.
+void encodeStoredAdd(QByteArray& out, const AnnotationStore& store, MarkupId id) {
+    const AnnotationStore::Quads q = store.quads(id);
+    const int n = q.count;
+    QVarLengthArray<float, 64> xywh(4 * n);
+    for (int i = 0; i < n; ++i) {
+        xywh[4 * i]     = q.x[i];
+        xywh[4 * i + 1] = q.y[i];
+        xywh[4 * i + 2] = q.w[i];
+        xywh[4 * i + 3] = q.h[i];
+    }
+    encodeRecord(out, OpAdd, id, store.page(id), store.kind(id), store.color(id).rgba(), xywh.constData(), n);
+}
+
+// Walks the records of a mapped journal; stops at the first torn/corrupt one.
+template <typename Header, typename Fn>
+qint64 forEachRecord(const uchar* base, qint64 size, Fn fn) {
+    qint64 at = sizeof(FileHeader);
+    while (at + qint64(sizeof(Header)) <= size) {
+        const auto* h = reinterpret_cast<const Header*>(base + at);
+        const qint64 quadBytes = qint64(h->quadCount) * kQuadBytes;
+        if (quadBytes > size - at - qint64(sizeof(Header))) break;
+        const char* quads = reinterpret_cast<const char*>(h + 1);
+        if (fnv1a(quads, quadBytes, fnv1a(reinterpret_cast<const char*>(h), offsetof(Header, check))) != h->check)
+            break;
+        fn(at, *h, reinterpret_cast<const float*>(quads));
+        at += sizeof(Header) + quadBytes;
+    }
+    return at;
+}
+
+// Replays a mapped journal into store; returns where its good records end. A
+// record can pass its checksum and still make no sense (a newer version wrote
+// it, or it was crafted): one with an unknown op or kind, or a page the
+// document doesn't have, is skipped rather than added.
+template <typename Header>
+qint64 replay(const uchar* base, qint64 size, AnnotationStore* store, int pageCount, int* records) {
+    auto valid = [pageCount](const Header& h) {
+        if (h.op == OpRemove) return true;
+        return h.op == OpAdd && h.id != kNoMarkup && h.kind <= quint32(MarkupKind::StrikeOut)
+            && h.page >= 0 && h.page < pageCount && h.quadCount <= quint32(INT_MAX / 4);
+    };
+
+    // pass 1: which Add record is the final state of each id (ids can be removed and re-added)
+    QHash<MarkupId, qint64> finalAdd;
+    *records = 0;
+    const qint64 goodEnd = forEachRecord<Header>(base, size, [&](qint64 at, const Header& h, const float*) {
+        ++*records;
+        if (!valid(h)) return;
+        if (h.op == OpAdd) finalAdd.insert(h.id, at);
+        else finalAdd.remove(h.id);
+    });
+
+    // pass 2: hand the live quads to the store straight from the mapping
+    forEachRecord<Header>(base, goodEnd, [&](qint64 at, const Header& h, const float* quads) {
+        if (h.op == OpAdd && finalAdd.value(h.id, -1) == at)
+            store->addRaw(h.id, h.page, MarkupKind(h.kind), h.rgba, quads, int(h.quadCount));
+    });
+    return goodEnd;
+}
+
+// Data on the disk (not just in the page cache) before a rename makes the file
+// the journal; otherwise a crash can leave an empty or short journal behind.
+bool syncToDisk(QFile& f) {
+    if (!f.flush()) return false;
+#if defined(Q_OS_WIN)
+    return FlushFileBuffers(HANDLE(_get_osfhandle(f.handle())));
+#elif defined(Q_OS_UNIX)
+    return ::fsync(f.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+QByteArray fileHeader() {
+    FileHeader fh{};
+    std::memcpy(fh.magic, kMagic, sizeof kMagic);
+    fh.version = AnnotationJournal::kVersion;
+    return QByteArray(reinterpret_cast<const char*>(&fh), sizeof fh);
+}
+}
+
+AnnotationJournal::AnnotationJournal(QObject* parent) : QObject(parent) {
+    m_pool.setMaxThreadCount(1);
+}
+
+AnnotationJournal::~AnnotationJournal() { close(); }
+
+bool AnnotationJournal::open(const QString& path, AnnotationStore* store, int pageCount) {
+    TRACE_SPAN("annotations", "journalOpen");
+    close();
+
+    QFile f(path);
+    if (!f.exists()) {
+        if (!f.open(QIODevice::WriteOnly) || f.write(fileHeader()) != qint64(sizeof(FileHeader)))
+            return false;
+        m_path = path;
+        m_store = store;
+        return true;
+    }
+
+    if (!f.open(QIODevice::ReadWrite)) return false;
+    const qint64 size = f.size();
+    if (size < qint64(sizeof(FileHeader))) return false;
+    uchar* base = f.map(0, size);
+    if (!base) return false;
+    const auto* fh = reinterpret_cast<const FileHeader*>(base);
+    const quint32 version = fh->version;
+    if (std::memcmp(fh->magic, kMagic, sizeof kMagic) != 0 || (version != kVersion && version != 1)) {
+        f.unmap(base);
+        return false;
+    }
+
+    int records = 0;
+    const qint64 goodEnd = version == 1 ? replay<RecordHeaderV1>(base, size, store, pageCount, &records)
+                                        : replay<RecordHeader>(base, size, store, pageCount, &records);
+    f.unmap(base);
+
+    if (version == 1) {
+        // rewritten whole in the current layout, which appends can then follow
+        f.close();
+        QByteArray data = fileHeader();
+        for (MarkupId id : store->ids()) encodeStoredAdd(data, *store, id);
+        QSaveFile out(path);
+        if (!out.open(QIODevice::WriteOnly) || out.write(data) != data.size() || !out.commit()) return false;
+        records = store->count();
+    } else if (goodEnd < size) {
+        f.resize(goodEnd);   // drop a torn tail
+    }
+
+    m_path = path;
+    m_store = store;
+    m_records = records;
+    return true;
+}
+
+void AnnotationJournal::close() {
+    if (!isOpen()) return;
+    flush();
+    m_pool.waitForDone();
+    if (m_compacting) {
+        // its completion is still queued; the generation makes it a no-op
+        QFile::remove(m_path + ".compact");
+        m_compacting = false;
+    }
+    ++m_generation;
+    m_path.clear();
+    m_store = nullptr;
+    m_pending.clear();
+    m_records = 0;
+}
+
+void AnnotationJournal::recordAdd(MarkupId id) {
+    if (!isOpen() || !m_store->contains(id)) return;
+    encodeStoredAdd(m_pending, *m_store, id);
+    ++m_records;
+}
+
+void AnnotationJournal::recordRemove(MarkupId id) {
+    appendRecord(OpRemove, id, -1, MarkupKind::Highlight, 0, nullptr, 0);
+}
+
+void AnnotationJournal::appendRecord(quint16 op, MarkupId id, int page, MarkupKind kind, QRgb color,
+                                     const float* xywh, int quadCount) {
+    if (!isOpen()) return;
+    encodeRecord(m_pending, op, id, page, kind, color, xywh, quadCount);
+    ++m_records;
+}
+
+bool AnnotationJournal::flush() {
+    if (!isOpen() || m_pending.isEmpty()) return true;
+    TRACE_SPAN_ARG("annotations", "journalFlush", m_pending.size());
+    QFile f(m_path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) return false;
+    if (f.write(m_pending) != m_pending.size()) return false;
+    f.close();
+    m_pending.clear();
+    maybeCompact();
+    return true;
+}
+
+void AnnotationJournal::maybeCompact() {
+    if (m_compacting || m_records < kCompactMinRecords || m_records <= kCompactRatio * m_store->count())
+        return;
+
+    // the snapshot is encoded here (it's a linear pass over the store);
+    // writing and syncing it is what goes to the background
+    QByteArray snapshot = fileHeader();
+    const QVector<MarkupId> live = m_store->ids();
+    for (MarkupId id : live) encodeStoredAdd(snapshot, *m_store, id);
+
+    const QString tmp = m_path + ".compact";
+    const qint64 snapshotEnd = QFileInfo(m_path).size();
+    const int snapshotRecords = int(live.size());
+    const int recordsAtSnapshot = m_records;
+    const quint64 generation = m_generation;
+    m_compacting = true;
+
+    m_pool.start([this, tmp, snapshot, snapshotEnd, snapshotRecords, recordsAtSnapshot, generation] {
+        TRACE_SPAN_ARG("annotations", "journalCompact", snapshot.size());
+        QFile out(tmp);
+        const bool ok = out.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            && out.write(snapshot) == snapshot.size() && syncToDisk(out);
+        out.close();
+        QMetaObject::invokeMethod(this, [this, tmp, snapshotEnd, snapshotRecords, recordsAtSnapshot, generation, ok] {
+            if (generation != m_generation) return;   // closed since; maybe another document open now
+            // records appended while we were writing still count
+            finishCompaction(tmp, snapshotEnd, snapshotRecords + (m_records - recordsAtSnapshot), ok);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AnnotationJournal::finishCompaction(const QString& tmpPath, qint64 snapshotEnd, int snapshotRecords, bool ok) {
+    m_compacting = false;
+    if (!ok) {
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    // carry over whatever was flushed after the snapshot was taken
+    QFile cur(m_path);
+    QFile out(tmpPath);
+    if (!cur.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        QFile::remove(tmpPath);
+        return;
+    }
+    bool copied = true;
+    if (cur.size() > snapshotEnd) {
+        cur.seek(snapshotEnd);
+        const QByteArray tail = cur.readAll();
+        copied = out.write(tail) == tail.size();
+    }
+    cur.close();
+    copied = copied && syncToDisk(out);
+    out.close();
+    if (!copied) {
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    const QString old = m_path + ".old";
+    QFile::remove(old);
+    if (!QFile::rename(m_path, old)) { QFile::remove(tmpPath); return; }
+    if (!QFile::rename(tmpPath, m_path)) { QFile::rename(old, m_path); return; }
+    QFile::remove(old);
+
+    m_records = snapshotRecords;
+    emit compacted();
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include "annotationstore.h"
+
+// Binary annotation sidecar. The file is a short header followed by an
+// append-only list of records; every edit appends one record and a save only
+// writes the records since the last save. Replaying is done straight off a
+// memory mapping. When dead records pile up, a background compaction rewrites
+// the file as one Add record per live markup.
+//
+//   FileHeader   magic "PDEANN", version
+//   Record...    RecordHeader + quadCount x Quad (x, y, w, h as float32, page points)
+//
+// A record whose checksum doesn't match ends the replay (torn write); the file
+// gets cut back to the last good record on open. Version 1 files (16-bit quad
+// counts) are read and rewritten as the current version.
+class AnnotationJournal : public QObject {
+    Q_OBJECT
+public:
+    static constexpr quint32 kVersion = 2;
+
+    explicit AnnotationJournal(QObject* parent = nullptr);
+    ~AnnotationJournal();
+
+    static QString sidecarPathFor(const QString& pdfPath) { return pdfPath + ".annotations.bin"; }
+
+    // Opens (creating if needed) and replays the journal into store. Markups on
+    // pages past pageCount are left out.
+    bool open(const QString& path, AnnotationStore* store, int pageCount);
+    void close();
+    bool isOpen() const { return !m_path.isEmpty(); }
+    QString path() const { return m_path; }
+
+    void recordAdd(MarkupId id);       // reads the markup from the store
+    void recordRemove(MarkupId id);
+    // The markup changed in place (restyled): another Add record, and replay keeps the last one.
+    void recordUpdate(MarkupId id) { recordAdd(id); }
+    bool hasPendingChanges() const { return !m_pending.isEmpty(); }
+
+    // Append pending records; starts a compaction if the file got too long.
+    bool flush();
+
+    int recordCount() const { return m_records; }
+
+signals:
+    void compacted();
+
+private:
+    void appendRecord(quint16 op, MarkupId id, int page, MarkupKind kind, QRgb color,
+                      const float* xywh, int quadCount);
+    void maybeCompact();
+    void finishCompaction(const QString& tmpPath, qint64 snapshotEnd, int snapshotRecords, bool ok);
+
+    QString          m_path;
+    AnnotationStore* m_store = nullptr;
+    QByteArray       m_pending;          // encoded, not yet on disk
+    int              m_records = 0;      // records in the file (plus pending)
+    bool             m_compacting = false;
+    quint64          m_generation = 0;   // bumped by close(): older compactions are stale
+    QThreadPool      m_pool;
+};
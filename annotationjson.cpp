@@ -0,0 +1,73 @@
+#include "annotationjson.h"
+#include "annotationstore.h"
+#include "trace.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+QString kindName(MarkupKind k) {
+    switch (k) {
+    case MarkupKind::Underline: return "underline";
+    case MarkupKind::StrikeOut: return "strikeout";
+    default:                    return "highlight";
+    }
+}
+MarkupKind kindFromName(const QString& s) {
+    if (s == "underline") return MarkupKind::Underline;
+    if (s == "strikeout") return MarkupKind::StrikeOut;
+    return MarkupKind::Highlight;
+}
+}
+
+bool writeMarkupsJson(const AnnotationStore& store, const QString& jsonPath, const QString& pdfName) {
+    if (jsonPath.isEmpty()) return false;
+    TRACE_SPAN_ARG("annotations", "jsonWrite", store.count());
+    QJsonArray marks;
+    for (MarkupId id : store.ids()) {
+        const Markup m = store.markup(id);
+        QJsonArray quads;
+        for (const QRectF& r : m.quadsPts)
+            quads.append(QJsonArray{ r.x(), r.y(), r.width(), r.height() });
+        marks.append(QJsonObject{
+            { "page",  m.page },
+            { "kind",  kindName(m.kind) },
+            { "color", m.color.name(QColor::HexArgb) },
+            { "quads", quads },
+        });
+    }
+    const QJsonObject root{
+        { "version", 1 },
+        { "file",    pdfName },
+        { "markups", marks },
+    };
+    QFile f(jsonPath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    return f.write(QJsonDocument(root).toJson(QJsonDocument::Indented)) >= 0;
+}
+
+bool readMarkupsJson(AnnotationStore* store, const QString& jsonPath, int pageCount) {
+    TRACE_SPAN("annotations", "jsonRead");
+    QFile f(jsonPath);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    const QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    if (!doc.isObject()) return false;
+
+    for (const QJsonValue& v : doc.object().value("markups").toArray()) {
+        const QJsonObject o = v.toObject();
+        Markup m;
+        m.page = o.value("page").toInt();
+        m.kind = kindFromName(o.value("kind").toString());
+        m.color = QColor(o.value("color").toString());
+        for (const QJsonValue& q : o.value("quads").toArray()) {
+            const QJsonArray a = q.toArray();
+            if (a.size() == 4)
+                m.quadsPts << QRectF(a[0].toDouble(), a[1].toDouble(), a[2].toDouble(), a[3].toDouble());
+        }
+        if (m.page >= 0 && (pageCount < 0 || m.page < pageCount) && !m.quadsPts.isEmpty())
+            store->add(m);
+    }
+    return true;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <QString>
+
+class AnnotationStore;
+
+// JSON form of the markups: what Export Notes writes, and the old sidecar
+// format. The binary journal is the working copy.
+//   { "version": 1, "file": <name>, "markups": [ { page, kind, color, quads: [[x,y,w,h]...] } ] }
+bool writeMarkupsJson(const AnnotationStore& store, const QString& jsonPath, const QString& pdfName);
+// Adds the markups in the file to store; pages outside [0, pageCount) are
+// dropped (pageCount < 0: no check).
+bool readMarkupsJson(AnnotationStore* store, const QString& jsonPath, int pageCount = -1);
@@ -0,0 +1,94 @@
+#include "annotationoverlay.h"
+#include "pdfpageview.h"
+
+#include <QEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QTransform>
+
+AnnotationOverlay::AnnotationOverlay(PdfPageView* view, const AnnotationStore* store)
+    : QWidget(view->viewport()), m_view(view), m_store(store), m_compositor(store)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_NoSystemBackground);
+    setGeometry(view->viewport()->rect());
+    view->viewport()->installEventFilter(this);   // follow viewport resizes
+    show();
+}
+
+bool AnnotationOverlay::eventFilter(QObject* obj, QEvent* ev) {
+    if (obj == m_view->viewport() && ev->type() == QEvent::Resize)
+        setGeometry(m_view->viewport()->rect());
+    return QWidget::eventFilter(obj, ev);
+}
+
+void AnnotationOverlay::setPreview(int page, const QVector<QRectF>& quadsPts, MarkupKind kind, const QColor& color) {
+    m_previewPage = page;
+    m_previewQuads = quadsPts;
+    m_previewKind = kind;
+    m_previewColor = color;
+    update();
+}
+
+void AnnotationOverlay::clearPreview() {
+    if (m_previewPage < 0) return;
+    m_previewPage = -1;
+    m_previewQuads.clear();
+    update();
+}
+
+void AnnotationOverlay::reload() {
+    m_compositor.clear();
+    update();
+}
+
+void AnnotationOverlay::markupChanged(int page, const QRectF& boundsPts) {
+    m_compositor.invalidate(page, boundsPts);
+    const QRect pr = m_view->pageViewportRect(page);
+    if (pr.isNull()) return;
+    const qreal s = m_view->pageScale(page);
+    const QRectF r(pr.x() + boundsPts.x() * s, pr.y() + boundsPts.y() * s,
+                   boundsPts.width() * s, boundsPts.height() * s);
+    update(r.toAlignedRect().adjusted(-2, -2, 2, 2));
+}
+
+void AnnotationOverlay::paintQuad(QPainter& p, const QRectF& r, MarkupKind kind, const QColor& color) const {
+    p.fillRect(MarkupCompositor::paintedRect(r, kind), color);
+}
+
+void AnnotationOverlay::paintEvent(QPaintEvent* ev) {
+    QPainter p(this);
+    const qreal dpr = devicePixelRatioF();
+    for (int page : m_view->visiblePages()) {
+        const QRect pr = m_view->pageViewportRect(page);
+        const QRect dirty = pr.intersected(ev->rect());
+        if (dirty.isEmpty()) continue;
+
+        const qreal s = m_view->pageScale(page);
+        const QTransform toView = QTransform::fromTranslate(pr.x(), pr.y()).scale(s, s);
+
+        QPoint origin;
+        if (const QImage* layer = m_compositor.layer(page, s * dpr, &origin)) {
+            // layer pixels are device pixels: blit the part under the repainted area 1:1
+            const QRectF target(pr.x() + origin.x() / dpr, pr.y() + origin.y() / dpr,
+                                layer->width() / dpr, layer->height() / dpr);
+            const QRectF part = target & QRectF(dirty);
+            if (!part.isEmpty())
+                p.drawImage(part, *layer, QRectF((part.topLeft() - target.topLeft()) * dpr, part.size() * dpr));
+        } else {
+            // only the markups under the repainted part of the page
+            const QTransform toPage = toView.inverted();
+            for (MarkupId id : m_store->query(page, toPage.mapRect(QRectF(dirty)))) {
+                const AnnotationStore::Quads q = m_store->quads(id);
+                const MarkupKind kind = m_store->kind(id);
+                const QColor color = m_store->color(id);
+                for (int i = 0; i < q.count; ++i)
+                    paintQuad(p, toView.mapRect(q.at(i)), kind, color);
+            }
+        }
+
+        if (page == m_previewPage)
+            for (const QRectF& r : std::as_const(m_previewQuads))
+                paintQuad(p, toView.mapRect(r), m_previewKind, m_previewColor);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QWidget>
+#include <QRectF>
+#include <QVector>
+
+#include "annotationstore.h"
+#include "markupcompositor.h"
+
+class PdfPageView;
+
+// Transparent layer over the view's viewport that paints the markups of the
+// visible pages and the live preview of a drag-to-annotate selection. Markups
+// come out of MarkupCompositor's per-page layers (one blit per page); only when
+// a layer would be too big (extreme zoom) are quads painted one by one, queried
+// from the store by viewport rect. It never takes mouse input.
+class AnnotationOverlay : public QWidget {
+    Q_OBJECT
+public:
+    AnnotationOverlay(PdfPageView* view, const AnnotationStore* store);
+
+    void setPreview(int page, const QVector<QRectF>& quadsPts, MarkupKind kind, const QColor& color);
+    void clearPreview();
+
+    // Repaint the viewport area covered by a markup's bounds on a page.
+    void markupChanged(int page, const QRectF& boundsPts);
+    // The store was cleared or reloaded wholesale.
+    void reload();
+
+protected:
+    void paintEvent(QPaintEvent* ev) override;
+    bool eventFilter(QObject* obj, QEvent* ev) override;
+
+private:
+    void paintQuad(QPainter& p, const QRectF& r, MarkupKind kind, const QColor& color) const;
+
+    PdfPageView*           m_view;
+    const AnnotationStore* m_store;
+    MarkupCompositor       m_compositor;
+
+    int             m_previewPage = -1;
+    QVector<QRectF> m_previewQuads;
+    MarkupKind      m_previewKind = MarkupKind::Highlight;
+    QColor          m_previewColor;
+};
@@ -0,0 +1,244 @@
+#include "annotationstore.h"
+
+#include <QSet>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+// The grid covers the largest page PDF allows (14400 points a side); anything
+// past it shares the edge cells, for quads and queries alike. So a quad visits
+// at most 226 x 226 cells, however big it claims to be.
+constexpr qreal kMaxPagePts = 14400;
+constexpr int kMaxCell = int(kMaxPagePts / AnnotationStore::kCellSize);
+constexpr int kCompactMinDead = 64;   // don't bother compacting small pages
+
+// NaN and negatives land in cell 0, infinities in the last one
+int cellOf(qreal v) {
+    if (!(v > 0)) return 0;
+    return v >= kMaxPagePts ? kMaxCell : qMin(int(qFloor(v / AnnotationStore::kCellSize)), kMaxCell);
+}
+}
+
+QRect AnnotationStore::cellRange(const QRectF& r) {
+    return QRect(QPoint(cellOf(r.left()), cellOf(r.top())), QPoint(cellOf(r.right()), cellOf(r.bottom())));
+}
+
+template <typename QuadAt>
+void AnnotationStore::insertQuads(PageStore& ps, MarkupId id, Record& rec, int count, QuadAt quadAt) {
+    rec.first = int(ps.x.size());
+    rec.count = count;
+    for (int i = 0; i < count; ++i) {
+        const QRectF q = quadAt(i);
+        const int qi = int(ps.x.size());
+        ps.x << float(q.x());
+        ps.y << float(q.y());
+        ps.w << float(q.width());
+        ps.h << float(q.height());
+        ps.owner << id;
+
+        const QRect cells = cellRange(q);
+        for (int cy = cells.top(); cy <= cells.bottom(); ++cy)
+            for (int cx = cells.left(); cx <= cells.right(); ++cx)
+                ps.grid[cellKey(cx, cy)] << qi;
+    }
+}
+
+MarkupId AnnotationStore::add(const Markup& m) {
+    const MarkupId id = nextId();
+    return addWithId(id, m) ? id : kNoMarkup;
+}
+
+AnnotationStore::Record* AnnotationStore::claim(MarkupId id, int page, MarkupKind kind, QRgb color) {
+    if (id == kNoMarkup || page < 0 || contains(id)) return nullptr;
+    if (id >= MarkupId(m_records.size())) m_records.resize(int(id) + 1);
+
+    Record& rec = m_records[int(id)];
+    rec.page = page;
+    rec.kind = kind;
+    rec.color = color;
+    ++m_live;
+    return &rec;
+}
+
+bool AnnotationStore::addWithId(MarkupId id, const Markup& m) {
+    if (m.quadsPts.isEmpty()) return false;   // nothing to show or hit
+    Record* rec = claim(id, m.page, m.kind, m.color.rgba());
+    if (!rec) return false;
+    insertQuads(m_pages[m.page], id, *rec, int(m.quadsPts.size()),
+                [&m](int i) { return m.quadsPts[i]; });
+    return true;
+}
+
+bool AnnotationStore::addRaw(MarkupId id, int page, MarkupKind kind, QRgb color, const float* xywh, int quadCount) {
+    if (quadCount <= 0) return false;
+    Record* rec = claim(id, page, kind, color);
+    if (!rec) return false;
+    insertQuads(m_pages[page], id, *rec, quadCount, [xywh](int i) {
+        const float* q = xywh + 4 * i;
+        return QRectF(q[0], q[1], q[2], q[3]);
+    });
+    return true;
+}
+
+bool AnnotationStore::remove(MarkupId id) {
+    if (!contains(id)) return false;
+    Record& rec = m_records[int(id)];
+    PageStore& ps = m_pages[rec.page];
+    for (int i = rec.first; i < rec.first + rec.count; ++i)
+        ps.owner[i] = kNoMarkup;   // grid entries are skipped lazily
+    ps.dead += rec.count;
+
+    const int page = rec.page;
+    rec = Record();
+    --m_live;
+
+    // the page's last markup: pages() shouldn't list it any more
+    if (ps.dead == ps.owner.size()) m_pages.remove(page);
+    else if (ps.dead > kCompactMinDead && ps.dead * 2 > ps.owner.size()) compact(page);
+    return true;
+}
+
+bool AnnotationStore::restyle(MarkupId id, MarkupKind kind, const QColor& color) {
+    if (!contains(id)) return false;
+    Record& rec = m_records[int(id)];
+    rec.kind = kind;
+    rec.color = color.rgba();
+    return true;
+}
+
+// Rewrite a page's columns without removed quads and rebuild its grid.
+void AnnotationStore::compact(int page) {
+    const PageStore& old = m_pages[page];
+    PageStore fresh;
+    fresh.x.reserve(old.x.size() - old.dead);
+
+    QVector<MarkupId> order;
+    for (MarkupId id : std::as_const(old.owner))
+        if (id != kNoMarkup && (order.isEmpty() || order.last() != id)) order << id;
+
+    for (MarkupId id : std::as_const(order)) {
+        Record& rec = m_records[int(id)];
+        const int first = rec.first;
+        insertQuads(fresh, id, rec, rec.count, [&old, first](int i) {
+            return QRectF(old.x[first + i], old.y[first + i], old.w[first + i], old.h[first + i]);
+        });
+    }
+    if (fresh.owner.isEmpty()) m_pages.remove(page);
+    else m_pages[page] = std::move(fresh);
+}
+
+void AnnotationStore::clear() {
+    m_records.clear();
+    m_pages.clear();
+    m_live = 0;
+}
+
+bool AnnotationStore::contains(MarkupId id) const {
+    return id < MarkupId(m_records.size()) && m_records[int(id)].page >= 0;
+}
+
+Markup AnnotationStore::markup(MarkupId id) const {
+    Markup m;
+    if (!contains(id)) return m;
+    const Record& rec = m_records[int(id)];
+    m.page = rec.page;
+    m.kind = rec.kind;
+    m.color = QColor::fromRgba(rec.color);
+    const Quads q = quads(id);
+    m.quadsPts.reserve(q.count);
+    for (int i = 0; i < q.count; ++i) m.quadsPts << q.at(i);
+    return m;
+}
+
+int AnnotationStore::page(MarkupId id) const {
+    return contains(id) ? m_records[int(id)].page : -1;
+}
+
+MarkupKind AnnotationStore::kind(MarkupId id) const {
+    return contains(id) ? m_records[int(id)].kind : MarkupKind::Highlight;
+}
+
+QColor AnnotationStore::color(MarkupId id) const {
+    return contains(id) ? QColor::fromRgba(m_records[int(id)].color) : QColor();
+}
+
+QRectF AnnotationStore::bounds(MarkupId id) const {
+    QRectF r;
+    const Quads q = quads(id);
+    for (int i = 0; i < q.count; ++i) r = r.united(q.at(i));
+    return r;
+}
+
+QRectF AnnotationStore::pageBounds(int page) const {
+    const auto it = m_pages.constFind(page);
+    if (it == m_pages.cend()) return {};
+    const PageStore& ps = *it;
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    bool any = false;
+    for (int i = 0, n = int(ps.owner.size()); i < n; ++i) {
+        if (ps.owner[i] == kNoMarkup) continue;
+        const float l = ps.x[i], t = ps.y[i], r = l + ps.w[i], b = t + ps.h[i];
+        if (!any) { x0 = l; y0 = t; x1 = r; y1 = b; any = true; continue; }
+        x0 = qMin(x0, l); y0 = qMin(y0, t); x1 = qMax(x1, r); y1 = qMax(y1, b);
+    }
+    return any ? QRectF(QPointF(x0, y0), QPointF(x1, y1)) : QRectF();
+}
+
+AnnotationStore::Quads AnnotationStore::quads(MarkupId id) const {
+    Quads q;
+    if (!contains(id)) return q;
+    const Record& rec = m_records[int(id)];
+    const PageStore& ps = *m_pages.find(rec.page);
+    q.x = ps.x.constData() + rec.first;
+    q.y = ps.y.constData() + rec.first;
+    q.w = ps.w.constData() + rec.first;
+    q.h = ps.h.constData() + rec.first;
+    q.count = rec.count;
+    return q;
+}
+
+QVector<MarkupId> AnnotationStore::ids() const {
+    QVector<MarkupId> out;
+    out.reserve(m_live);
+    for (int i = 0; i < m_records.size(); ++i)
+        if (m_records[i].page >= 0) out << MarkupId(i);
+    return out;
+}
+
+QVector<int> AnnotationStore::pages() const {
+    QVector<int> out = m_pages.keys();
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+QVector<MarkupId> AnnotationStore::query(int page, const QRectF& rectPts) const {
+    QVector<MarkupId> out;
+    const auto it = m_pages.constFind(page);
+    if (it == m_pages.cend()) return out;
+    const PageStore& ps = *it;
+
+    QSet<MarkupId> seen;
+    const QRect cells = cellRange(rectPts);
+    for (int cy = cells.top(); cy <= cells.bottom(); ++cy) {
+        for (int cx = cells.left(); cx <= cells.right(); ++cx) {
+            const auto cell = ps.grid.constFind(cellKey(cx, cy));
+            if (cell == ps.grid.cend()) continue;
+            for (int qi : *cell) {
+                const MarkupId id = ps.owner[qi];
+                if (id == kNoMarkup || seen.contains(id)) continue;
+                if (QRectF(ps.x[qi], ps.y[qi], ps.w[qi], ps.h[qi]).intersects(rectPts)) {
+                    seen.insert(id);
+                    out << id;
+                }
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+MarkupId AnnotationStore::hitTest(int page, const QPointF& pt, qreal slopPts) const {
+    const QVector<MarkupId> hits =
+        query(page, QRectF(pt - QPointF(slopPts, slopPts), QSizeF(2 * slopPts, 2 * slopPts)));
+    return hits.isEmpty() ? kNoMarkup : hits.last();
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <QColor>
+#include <QHash>
+#include <QRectF>
+#include <QVector>
+
+enum class MarkupKind { Highlight, Underline, StrikeOut };
+
+struct Markup {
+    int page = 0;
+    QVector<QRectF> quadsPts;   // rectangles in PAGE POINTS
+    MarkupKind kind = MarkupKind::Highlight;
+    QColor color = QColor(255, 235, 0, 96); // translucent yellow by default
+};
+
+inline QColor defaultMarkupColor(MarkupKind kind) {
+    switch (kind) {
+    case MarkupKind::Underline: return QColor(0, 160, 0, 200);
+    case MarkupKind::StrikeOut: return QColor(220, 0, 0, 200);
+    default:                    return Markup().color;
+    }
+}
+
+using MarkupId = quint32;
+constexpr MarkupId kNoMarkup = 0xffffffffu;
+
+// All markups of a document, stored per page. Quads live in structure-of-arrays
+// columns that double as the page's arena (a markup's quads are one contiguous
+// range, no allocation per markup), and a uniform grid over the page answers
+// "what intersects this rect" without looking at every markup.
+//
+// Ids are stable for the life of the store and never reused, so they can be
+// written to a journal. Markup is only materialized when asked for.
+class AnnotationStore {
+public:
+    static constexpr qreal kCellSize = 64;   // grid cell edge, in points
+
+    // A markup without quads is refused (kNoMarkup / false).
+    MarkupId add(const Markup& m);
+    // Re-insert under a known id (loading a journal, undo). Fails if the id is live.
+    bool addWithId(MarkupId id, const Markup& m);
+    // Same, straight from interleaved x,y,w,h floats (a mapped journal record).
+    bool addRaw(MarkupId id, int page, MarkupKind kind, QRgb color, const float* xywh, int quadCount);
+    bool remove(MarkupId id);
+    // Kind and colour only; the quads (and the grid) stay where they are.
+    bool restyle(MarkupId id, MarkupKind kind, const QColor& color);
+    void clear();
+
+    bool contains(MarkupId id) const;
+    int count() const { return m_live; }
+    bool isEmpty() const { return m_live == 0; }
+    MarkupId nextId() const { return MarkupId(m_records.size()); }
+
+    Markup markup(MarkupId id) const;
+    int page(MarkupId id) const;
+    MarkupKind kind(MarkupId id) const;
+    QColor color(MarkupId id) const;
+    QRectF bounds(MarkupId id) const;          // union of its quads
+    QRectF pageBounds(int page) const;         // union of every live quad on the page
+    QVector<MarkupId> ids() const;             // live ids, ascending
+    QVector<int> pages() const;                // pages that have markups
+
+    // Markups with a quad intersecting rectPts on the page, ascending id (= paint order).
+    QVector<MarkupId> query(int page, const QRectF& rectPts) const;
+    // Topmost markup under the point, or kNoMarkup.
+    MarkupId hitTest(int page, const QPointF& pt, qreal slopPts = 2) const;
+
+    // Raw quad columns of one markup (valid until the next add/remove on that page).
+    struct Quads {
+        const float* x = nullptr;
+        const float* y = nullptr;
+        const float* w = nullptr;
+        const float* h = nullptr;
+        int count = 0;
+        QRectF at(int i) const { return QRectF(x[i], y[i], w[i], h[i]); }
+    };
+    Quads quads(MarkupId id) const;
+
+private:
+    struct Record {
+        int     page = -1;      // -1 = removed
+        int     first = 0;      // first quad in the page columns
+        int     count = 0;
+        MarkupKind kind = MarkupKind::Highlight;
+        QRgb    color = 0;
+    };
+
+    struct PageStore {
+        QVector<float>    x, y, w, h;
+        QVector<MarkupId> owner;              // kNoMarkup once removed
+        QHash<quint32, QVector<int>> grid;    // cell -> quad indices
+        int dead = 0;
+    };
+
+    static quint32 cellKey(int cx, int cy) { return (quint32(cy) << 16) | quint32(cx & 0xffff); }
+    static QRect cellRange(const QRectF& r);
+    template <typename QuadAt>
+    static void insertQuads(PageStore& ps, MarkupId id, Record& rec, int count, QuadAt quadAt);
+    Record* claim(MarkupId id, int page, MarkupKind kind, QRgb color);
+    void compact(int page);
+
+    QVector<Record>         m_records;   // indexed by id
+    QHash<int, PageStore>   m_pages;
+    int                     m_live = 0;
+};
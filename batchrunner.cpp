@@ -0,0 +1,376 @@
+#include "batchrunner.h"
+#include "annotationjournal.h"
+#include "annotationjson.h"
+#include "annotationstore.h"
+#include "filecopy.h"
+#include "pdfassembler.h"
+#include "pdfcompat.h"
+#include "pdfwriter.h"
+#include "workstealingpool.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QTextStream>
+#include <QThreadStorage>
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfSelection>
+#include <algorithm>
+#include <memory>
+
+namespace {
+struct FileResult {
+    QString path;
+    qint64  bytes = 0;
+    int     pages = 0;        // pages worked on
+    int     rendered = 0;
+    int     hits = 0;
+    int     markups = 0;
+    int     written = 0;      // pages in edited copies
+    qint64  ms = 0;
+    QString error;
+};
+
+// Shared by the tasks of one file; the last one to finish reports it.
+struct FileJob {
+    int                           file = -1;   // index into the inputs
+    QString                       path;
+    QString                       base;    // output name stem
+    int                           pageCount = 0;
+    QElapsedTimer                 timer;
+    QAtomicInt                    remaining = 0;
+    QAtomicInt                    rendered = 0;
+    QAtomicInt                    hits = 0;
+    QAtomicInt                    markups = 0;
+    QAtomicInt                    written = 0;
+    QMutex                        errorLock;
+    QString                       error;
+
+    void fail(const QString& msg) {
+        QMutexLocker lock(&errorLock);
+        if (error.isEmpty()) error = msg;
+    }
+};
+
+// QPdfDocument is a QObject, so a file's tasks don't share one: whichever worker
+// runs (or steals) a task reads the file through its own copy, created, used and
+// destroyed on that thread. A worker keeps the last file it opened, so the pages
+// it works through in a row load it once. QThreadStorage deletes it while the
+// worker's QThread is still finishing, not after Qt has let go of the thread.
+struct WorkerDocument {
+    int                           file = -1;
+    std::unique_ptr<QPdfDocument> doc;
+    bool                          ok = false;
+};
+QThreadStorage<WorkerDocument*> s_documents;
+
+QPdfDocument* documentFor(const FileJob& job) {
+    if (!s_documents.hasLocalData()) s_documents.setLocalData(new WorkerDocument);
+    WorkerDocument* d = s_documents.localData();
+    if (d->file != job.file) {
+        d->doc = std::make_unique<QPdfDocument>();
+        d->file = job.file;
+        d->ok = pdfLoadOk(d->doc->load(job.path));
+    }
+    return d->ok ? d->doc.get() : nullptr;
+}
+
+class Batch {
+public:
+    explicit Batch(const BatchOptions& o) : m_options(o), m_pool(o.threads > 0 ? o.threads : QThread::idealThreadCount()) {}
+
+    int run() {
+        QDir().mkpath(m_options.outputDir);
+        QElapsedTimer wall;
+        wall.start();
+        const bool perFile = m_options.render || !m_options.search.isEmpty() || m_options.annotations || hasEdits();
+        m_bases = outputBases(m_options.files);
+        if (perFile)
+            for (int i = 0; i < m_options.files.size(); ++i)
+                m_pool.submit([this, i] { openFile(i); });
+        if (!m_options.merge.isEmpty()) m_pool.submit([this] { mergeAll(); });
+        m_pool.waitForDone();
+        report(wall.elapsed());
+
+        for (const FileResult& r : std::as_const(m_results))
+            if (!r.error.isEmpty()) return 1;
+        return 0;
+    }
+
+private:
+    // Output name stems, one per input. Inputs with the same name (from different
+    // folders, or listed twice) would write the same files from different workers:
+    // the later ones get -2, -3, ...
+    static QStringList outputBases(const QStringList& files) {
+        QStringList bases;
+        QSet<QString> taken;   // lower case: the output directory may not care
+        for (const QString& path : files) taken.insert(QFileInfo(path).completeBaseName().toLower());
+        QSet<QString> used;
+        for (const QString& path : files) {
+            const QString stem = QFileInfo(path).completeBaseName();
+            QString base = stem;
+            for (int n = 2; used.contains(base.toLower()) || (base != stem && taken.contains(base.toLower())); ++n)
+                base = QString("%1-%2").arg(stem).arg(n);
+            used.insert(base.toLower());
+            bases << base;
+        }
+        return bases;
+    }
+
+    void openFile(int file) {
+        auto job = std::make_shared<FileJob>();
+        job->file = file;
+        job->path = m_options.files[file];
+        job->base = m_bases[file];
+        job->timer.start();
+
+        // page edits never go through pdfium
+        const bool perPage = m_options.render || !m_options.search.isEmpty();
+        QVector<int> pages;
+        if (perPage || m_options.annotations) {
+            const QPdfDocument* doc = documentFor(*job);   // this worker's copy; its own pages reuse it
+            if (!doc) {
+                job->fail("cannot open");
+                finish(job, 0);
+                return;
+            }
+            job->pageCount = doc->pageCount();
+            pages = parsePageRanges(m_options.pages, job->pageCount);
+        }
+
+        const int tasks = (perPage ? int(pages.size()) : 0) + (m_options.annotations ? 1 : 0) + (hasEdits() ? 1 : 0);
+        job->remaining.storeRelease(tasks);
+        const int pageCount = perPage ? int(pages.size()) : 0;
+        if (tasks == 0) {
+            finish(job, pageCount);
+            return;
+        }
+
+        // these land on this worker's own deque; idle workers steal them
+        if (hasEdits())
+            m_pool.submit([this, job, pageCount] { editPages(*job); done(job, pageCount); });
+        if (m_options.annotations)
+            m_pool.submit([this, job, pageCount] { exportAnnotations(*job); done(job, pageCount); });
+        if (perPage)
+            for (int page : pages)
+                m_pool.submit([this, job, page, pageCount] { processPage(*job, page); done(job, pageCount); });
+    }
+
+    void processPage(FileJob& job, int page) {
+        QPdfDocument* doc = documentFor(job);
+        if (!doc) {
+            job.fail(QString("page %1: cannot open").arg(page + 1));
+            return;
+        }
+        if (m_options.render) {
+            const qreal scale = m_options.dpi / 72.0;
+            const QSize px = (doc->pagePointSize(page) * scale).toSize();
+            const QImage img = doc->render(page, px);
+            const QString out = QDir(m_options.outputDir)
+                                    .filePath(QString("%1-p%2.png").arg(job.base).arg(page + 1, 4, 10, QChar('0')));
+            if (img.isNull() || !img.save(out, "PNG")) job.fail(QString("page %1: render/save failed").arg(page + 1));
+            else job.rendered.fetchAndAddRelaxed(1);
+        }
+        if (!m_options.search.isEmpty()) {
+            const QString text = doc->getAllText(page).text();
+            int n = 0;
+            for (int at = text.indexOf(m_options.search, 0, Qt::CaseInsensitive); at >= 0;
+                 at = text.indexOf(m_options.search, at + m_options.search.size(), Qt::CaseInsensitive))
+                ++n;
+            if (n) {
+                job.hits.fetchAndAddRelaxed(n);
+                print(QString("%1:%2: %3 hit(s)").arg(job.path).arg(page + 1).arg(n));
+            }
+        }
+    }
+
+    // Sidecar (journal, or an old JSON one) -> <base>.annotations.json and an
+    // annotated copy of the PDF in the output directory.
+    void exportAnnotations(FileJob& job) {
+        AnnotationStore store;
+        const QString journal = AnnotationJournal::sidecarPathFor(job.path);
+        const QString json = job.path + ".annotations.json";
+        if (QFileInfo::exists(journal)) {
+            AnnotationJournal j;
+            if (!j.open(journal, &store, job.pageCount)) { job.fail("bad annotation journal"); return; }
+            j.close();
+        } else if (QFileInfo::exists(json)) {
+            readMarkupsJson(&store, json, job.pageCount);
+        }
+        if (store.isEmpty()) return;
+        job.markups.storeRelaxed(store.count());
+
+        const QDir out(m_options.outputDir);
+        writeMarkupsJson(store, out.filePath(job.base + ".annotations.json"), QFileInfo(job.path).fileName());
+        const QString annotated = out.filePath(job.base + ".annotated.pdf");
+        QString err;
+        if (!copyFileFast(job.path, annotated, &err) || !appendMarkupAnnotations(annotated, store, &err))
+            job.fail("annotated copy: " + err);
+    }
+
+    bool hasEdits() const {
+        return !m_options.extract.isEmpty() || !m_options.remove.isEmpty() || m_options.rotate || m_options.split > 0;
+    }
+
+    // One assembler for all of a file's edits: its page tree is read once.
+    void editPages(FileJob& job) {
+        PdfAssembler a;
+        const int n = a.pagesIn(job.path);
+        if (n < 0) { job.fail(a.errorString()); return; }
+        const QDir out(m_options.outputDir);
+        auto write = [&](const QString& name) {
+            if (!a.pageCount()) return true;
+            if (!a.write(out.filePath(name))) { job.fail(name + ": " + a.errorString()); return false; }
+            job.written.fetchAndAddRelaxed(a.pageCount());
+            return true;
+        };
+
+        if (!m_options.extract.isEmpty()) {
+            a.clearPages();
+            for (int p : parsePageList(m_options.extract, n)) a.addPage(job.path, p);
+            if (!write(job.base + ".extract.pdf")) return;
+        }
+        if (!m_options.remove.isEmpty()) {
+            a.clearPages();
+            const QVector<int> drop = parsePageRanges(m_options.remove, n);
+            for (int p = 0; p < n; ++p)
+                if (!std::binary_search(drop.cbegin(), drop.cend(), p)) a.addPage(job.path, p);
+            if (!write(job.base + ".trimmed.pdf")) return;
+        }
+        if (m_options.rotate) {
+            a.clearPages();
+            const QVector<int> turn = parsePageRanges(m_options.pages, n);
+            for (int p = 0; p < n; ++p)
+                a.addPage(job.path, p, std::binary_search(turn.cbegin(), turn.cend(), p) ? m_options.rotate : 0);
+            if (!write(job.base + ".rotated.pdf")) return;
+        }
+        for (int first = 0, part = 1; m_options.split > 0 && first < n; first += m_options.split, ++part) {
+            a.clearPages();
+            for (int p = first; p < qMin(n, first + m_options.split); ++p) a.addPage(job.path, p);
+            if (!write(QString("%1-part%2.pdf").arg(job.base).arg(part))) return;
+        }
+    }
+
+    // Every input, in the order given, into one file; reported as a line of its own.
+    void mergeAll() {
+        auto job = std::make_shared<FileJob>();
+        job->path = QDir(m_options.outputDir).filePath(m_options.merge);
+        job->timer.start();
+        PdfAssembler a;
+        for (const QString& in : m_options.files) {
+            const int n = a.pagesIn(in);
+            if (n < 0) { job->fail(a.errorString()); break; }
+            for (int p = 0; p < n; ++p) a.addPage(in, p);
+        }
+        if (job->error.isEmpty()) {
+            if (a.write(job->path)) job->written.storeRelaxed(a.pageCount());
+            else job->fail(a.errorString());
+        }
+        finish(job, 0);
+    }
+
+    void done(const std::shared_ptr<FileJob>& job, int pages) {
+        if (job->remaining.fetchAndSubOrdered(1) == 1) finish(job, pages);
+    }
+
+    void finish(const std::shared_ptr<FileJob>& job, int pages) {
+        FileResult r;
+        r.path = job->path;
+        r.bytes = QFileInfo(job->path).size();
+        r.pages = pages;
+        r.rendered = job->rendered.loadRelaxed();
+        r.hits = job->hits.loadRelaxed();
+        r.markups = job->markups.loadRelaxed();
+        r.written = job->written.loadRelaxed();
+        r.ms = job->timer.elapsed();
+        r.error = job->error;
+
+        QString line = QString("%1: %2 page(s) in %3 ms, %4 pages/s, %5 MB/s")
+                           .arg(r.path).arg(r.pages).arg(r.ms)
+                           .arg(rate(r.pages, r.ms), 0, 'f', 1)
+                           .arg(rate(r.bytes / 1048576.0, r.ms), 0, 'f', 1);
+        if (m_options.render) line += QString(", %1 rendered").arg(r.rendered);
+        if (!m_options.search.isEmpty()) line += QString(", %1 hit(s)").arg(r.hits);
+        if (m_options.annotations) line += QString(", %1 markup(s)").arg(r.markups);
+        if (r.written) line += QString(", %1 page(s) written").arg(r.written);
+        if (!r.error.isEmpty()) line += " — FAILED: " + r.error;
+        print(line);
+
+        QMutexLocker lock(&m_resultsLock);
+        m_results << r;
+    }
+
+    void report(qint64 wallMs) {
+        int pages = 0, failed = 0;
+        qint64 bytes = 0;
+        for (const FileResult& r : std::as_const(m_results)) {
+            pages += r.pages;
+            bytes += r.bytes;
+            failed += r.error.isEmpty() ? 0 : 1;
+        }
+        print(QString("total: %1 file(s) (%2 failed), %3 page(s), %4 MB in %5 ms on %6 thread(s): "
+                      "%7 files/s, %8 pages/s, %9 MB/s, %10 steal(s)")
+                  .arg(m_results.size()).arg(failed).arg(pages)
+                  .arg(bytes / 1048576.0, 0, 'f', 1).arg(wallMs).arg(m_pool.threadCount())
+                  .arg(rate(m_results.size(), wallMs), 0, 'f', 2)
+                  .arg(rate(pages, wallMs), 0, 'f', 1)
+                  .arg(rate(bytes / 1048576.0, wallMs), 0, 'f', 1)
+                  .arg(m_pool.stealCount()));
+    }
+
+    static double rate(double amount, qint64 ms) { return ms > 0 ? amount * 1000.0 / ms : 0.0; }
+
+    void print(const QString& line) {
+        QMutexLocker lock(&m_printLock);
+        QTextStream(stdout) << line << Qt::endl;
+    }
+
+    const BatchOptions m_options;
+    QStringList        m_bases;   // per file, set before any task runs
+    WorkStealingPool   m_pool;
+    QMutex             m_printLock;
+    QMutex             m_resultsLock;
+    QVector<FileResult> m_results;
+};
+}
+
+QVector<int> parsePageRanges(const QString& spec, int pageCount) {
+    QVector<bool> want(qMax(0, pageCount), spec.trimmed().isEmpty());
+    for (const QString& part : spec.split(',', Qt::SkipEmptyParts)) {
+        const QStringList ends = part.trimmed().split('-');
+        bool ok1 = true, ok2 = true;
+        const int from = ends[0].isEmpty() ? 1 : ends[0].toInt(&ok1);
+        const int to = ends.size() == 1 ? from : (ends[1].isEmpty() ? pageCount : ends[1].toInt(&ok2));
+        if (!ok1 || !ok2 || ends.size() > 2) continue;
+        for (int p = qMax(1, from); p <= qMin(to, pageCount); ++p) want[p - 1] = true;
+    }
+    QVector<int> pages;
+    for (int i = 0; i < want.size(); ++i)
+        if (want[i]) pages << i;
+    return pages;
+}
+
+QVector<int> parsePageList(const QString& spec, int pageCount) {
+    QVector<int> pages;
+    for (const QString& part : spec.split(',', Qt::SkipEmptyParts)) {
+        const QStringList ends = part.trimmed().split('-');
+        bool ok1 = true, ok2 = true;
+        const int from = ends[0].isEmpty() ? 1 : ends[0].toInt(&ok1);
+        const int to = ends.size() == 1 ? from : (ends[1].isEmpty() ? pageCount : ends[1].toInt(&ok2));
+        if (!ok1 || !ok2 || ends.size() > 2 || qMax(from, to) < 1 || qMin(from, to) > pageCount) continue;
+        const int a = qBound(1, from, pageCount), b = qBound(1, to, pageCount);
+        for (int p = a; ; p += b < a ? -1 : 1) {
+            pages << p - 1;
+            if (p == b) break;
+        }
+    }
+    return pages;
+}
+
+int runBatch(const BatchOptions& options) {
+    Batch batch(options);
+    return batch.run();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct BatchOptions {
+    QStringList files;
+    QString     outputDir = ".";
+    bool        render = false;
+    int         dpi = 150;
+    QString     pages;               // "1-3,7,10-" (1-based); empty = all
+    QString     search;
+    bool        annotations = false; // annotated copy + JSON from each file's sidecar
+    // page edits, each writing a new PDF into outputDir
+    QString     extract;             // "5-3,9,1" in that order -> <base>.extract.pdf
+    QString     remove;              // pages to drop -> <base>.trimmed.pdf
+    int         rotate = 0;          // turn the --pages pages -> <base>.rotated.pdf
+    int         split = 0;           // parts of this many pages -> <base>-partN.pdf
+    QString     merge;               // all files, in order, into one
+    int         threads = 0;         // 0 = one per core
+};
+
+// Runs the jobs for every file on a work-stealing pool, without any UI. A file's
+// pages become separate tasks, so a big file gets spread over idle workers
+// (each reading it through a document of its own). Prints a line per file as it
+// finishes and an aggregate at the end; returns the process exit code.
+int runBatch(const BatchOptions& options);
+
+// "1-3,7,10-" -> 0-based page numbers below pageCount, ascending, no duplicates.
+QVector<int> parsePageRanges(const QString& spec, int pageCount);
+// Same syntax, but kept in the order given, repeats and all; "5-3" counts down.
+QVector<int> parsePageList(const QString& spec, int pageCount);
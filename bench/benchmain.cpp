@@ -0,0 +1,332 @@
+// PDFEditorBench: generates a synthetic corpus and times the hot paths the
+// app depends on. One JSON document per run (stdout or --out), so results
+// from two builds can be diffed.
+//
+//   PDFEditorBench [--quick] [--reps N] [--workdir DIR] [--out results.json]
+
+#include "syntheticpdf.h"
+
+#include "annotationjournal.h"
+#include "annotationjson.h"
+#include "annotationstore.h"
+#include "filecopy.h"
+#include "mappedfile.h"
+#include "markupcompositor.h"
+#include "memorybudget.h"
+#include "pdfcompat.h"
+#include "pdfwriter.h"
+#include "searchengine.h"
+#include "textgeometry.h"
+#include "textindex.h"
+
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfSelection>
+#include <algorithm>
+#include <deque>
+#include <functional>
+
+namespace {
+constexpr qreal kScreenDpi = 96;
+const qreal kZooms[] = { 0.5, 1.0, 2.0 };
+constexpr int kRenderPages = 5;          // pages rendered per zoom (spread over the document)
+constexpr int kMarkupsPerPage = 20;
+
+struct Result {
+    QString corpus;
+    QString metric;
+    QVector<double> samples;   // ms
+    QJsonObject extra;
+};
+
+double nowMs(const QElapsedTimer& t) { return t.nsecsElapsed() / 1e6; }
+
+QJsonObject toJson(const Result& r) {
+    QVector<double> s = r.samples;
+    std::sort(s.begin(), s.end());
+    QJsonObject o{
+        { "corpus", r.corpus },
+        { "metric", r.metric },
+        { "unit", "ms" },
+        { "samples", int(s.size()) },
+    };
+    if (!s.isEmpty()) {
+        o.insert("min", s.first());
+        o.insert("median", s[s.size() / 2]);
+        o.insert("max", s.last());
+    }
+    for (auto it = r.extra.begin(); it != r.extra.end(); ++it) o.insert(it.key(), it.value());
+    return o;
+}
+
+class Bench {
+public:
+    Bench(const QString& dir, int reps) : m_dir(dir), m_reps(qMax(1, reps)) {}
+
+    void run(const SyntheticPdfSpec& spec) {
+        const QString path = QDir(m_dir).filePath(spec.name + ".pdf");
+        QElapsedTimer t;
+        t.start();
+        if (!writeSyntheticPdf(path, spec)) {
+            QTextStream(stderr) << "cannot write " << path << Qt::endl;
+            return;
+        }
+        m_corpus.append(QJsonObject{
+            { "name", spec.name },
+            { "pages", spec.pages },
+            { "wordsPerPage", spec.wordsPerPage },
+            { "scan", spec.scan.isEmpty() ? QString() : QString("%1x%2").arg(spec.scan.width()).arg(spec.scan.height()) },
+            { "bytes", QFileInfo(path).size() },
+            { "generateMs", nowMs(t) },
+        });
+
+        benchLoad(spec.name, path);
+        benchRender(spec.name, path);
+        if (spec.wordsPerPage > 0) benchSearch(spec.name, path);
+        benchAnnotations(spec.name, path, spec.pages);
+    }
+
+    QJsonObject report() const {
+        QJsonArray results;
+        for (const Result& r : m_results) results.append(toJson(r));
+        return QJsonObject{
+            { "build", QJsonObject{
+                { "qt", QString(qVersion()) },
+                { "cpu", QSysInfo::currentCpuArchitecture() },
+                { "os", QSysInfo::prettyProductName() },
+                { "timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate) },
+            } },
+            { "reps", m_reps },
+            { "corpus", m_corpus },
+            { "results", results },
+            { "peakRssBytes", peakResidentBytes() },
+        };
+    }
+
+private:
+    Result& add(const QString& corpus, const QString& metric) {
+        m_results.push_back({ corpus, metric, {}, {} });
+        return m_results.back();
+    }
+
+    void sample(Result& r, const std::function<void()>& fn) {
+        for (int i = 0; i < m_reps; ++i) {
+            QElapsedTimer t;
+            t.start();
+            fn();
+            r.samples << nowMs(t);
+        }
+    }
+
+    // QPdfDocument::load, by path and through the mapped device; plus first page at 100%.
+    void benchLoad(const QString& corpus, const QString& path) {
+        sample(add(corpus, "load.path"), [&] {
+            QPdfDocument doc;
+            doc.load(path);
+        });
+        sample(add(corpus, "load.mapped"), [&] {
+            MappedFileDevice dev;
+            QPdfDocument doc;
+            if (dev.openFile(path)) doc.load(&dev);
+        });
+        sample(add(corpus, "load.firstPage"), [&] {
+            QPdfDocument doc;
+            if (!pdfLoadOk(doc.load(path)) || doc.pageCount() == 0) return;
+            doc.render(0, (doc.pagePointSize(0) * kScreenDpi / 72).toSize());
+        });
+    }
+
+    // Per-page render at each zoom, pages spread over the document.
+    void benchRender(const QString& corpus, const QString& path) {
+        QPdfDocument doc;
+        if (!pdfLoadOk(doc.load(path)) || doc.pageCount() == 0) return;
+        const int n = qMin(kRenderPages, doc.pageCount());
+        for (qreal zoom : kZooms) {
+            Result& r = add(corpus, QString("render.page@%1").arg(zoom));
+            r.extra.insert("zoom", zoom);
+            for (int rep = 0; rep < m_reps; ++rep) {
+                for (int i = 0; i < n; ++i) {
+                    const int page = i * doc.pageCount() / n;
+                    QElapsedTimer t;
+                    t.start();
+                    doc.render(page, (doc.pagePointSize(page) * zoom * kScreenDpi / 72).toSize());
+                    r.samples << nowMs(t);
+                }
+            }
+        }
+    }
+
+    // The find bar path (SearchEngine::setQuery, scanning on its worker) and the index path.
+    void benchSearch(const QString& corpus, const QString& path) {
+        QPdfDocument doc;
+        if (!pdfLoadOk(doc.load(path))) return;
+
+        Result& total = add(corpus, "search.scan");
+        Result& first = add(corpus, "search.scan.firstHit");
+        for (int rep = 0; rep < m_reps; ++rep) {
+            SearchEngine engine(&doc);
+            engine.setDebounceInterval(0);
+            QEventLoop loop;
+            QElapsedTimer t;
+            double firstHit = -1;
+            QObject::connect(&engine, &SearchEngine::hitsAdded, &loop, [&] { if (firstHit < 0) firstHit = nowMs(t); });
+            QObject::connect(&engine, &SearchEngine::finished, &loop, &QEventLoop::quit);
+            t.start();
+            engine.setQuery(kSyntheticNeedle);
+            if (engine.isRunning()) loop.exec();
+            total.samples << nowMs(t);
+            if (firstHit >= 0) first.samples << firstHit;
+            total.extra.insert("hits", engine.count());
+        }
+
+        // index build once, then lookups
+        const QString idxPath = path + ".idx";
+        Result& build = add(corpus, "search.index.build");
+        QElapsedTimer t;
+        t.start();
+        QVector<QVector<PageWord>> words(doc.pageCount());
+        for (int p = 0; p < doc.pageCount(); ++p) words[p] = extractPageWords(&doc, p);
+        const bool written = TextIndex::write(idxPath, words);
+        build.samples << nowMs(t);
+
+        // a drag over most of page 0: pdfium's selection against the word/line store
+        const QPointF from(60, 80), to(500, 600);
+        sample(add(corpus, "select.getSelection"), [&] { doc.getSelection(0, from, to); });
+        const PageGeometry geometry = PageGeometry::fromWords(words.value(0));
+        Result& snap = add(corpus, "select.geometry");
+        sample(snap, [&] { snap.extra.insert("quads", int(geometry.selectionQuads(from, to).size())); });
+
+        if (!written) return;
+
+        TextIndex index;
+        Result& open = add(corpus, "search.index.open");
+        sample(open, [&] { index.close(); index.open(idxPath); });
+        Result& find = add(corpus, "search.index.find");
+        sample(find, [&] { find.extra.insert("hits", int(index.find(kSyntheticNeedle).size())); });
+    }
+
+    // Journal, JSON and PDF incremental update for a page-proportional markup set.
+    void benchAnnotations(const QString& corpus, const QString& path, int pages) {
+        AnnotationStore store;
+        QRandomGenerator rng(7);
+        for (int i = 0; i < pages * kMarkupsPerPage; ++i) {
+            Markup m;
+            m.page = int(rng.bounded(pages));
+            m.kind = MarkupKind(rng.bounded(3));
+            const qreal y = 60 + rng.bounded(650);
+            for (int line = 0, n = 1 + int(rng.bounded(3)); line < n; ++line)
+                m.quadsPts << QRectF(54 + rng.bounded(200), y + line * 12, 100 + rng.bounded(300), 11);
+            store.add(m);
+        }
+
+        const QString journalPath = path + ".annotations.bin";
+        const QString jsonPath = path + ".annotations.json";
+        const QString copyPath = path + ".annotated.pdf";
+
+        sample(add(corpus, "annotations.journal.save"), [&] {
+            QFile::remove(journalPath);
+            AnnotationJournal j;
+            if (!j.open(journalPath, &store, pages)) return;
+            for (MarkupId id : store.ids()) j.recordAdd(id);
+            j.flush();
+        });
+        sample(add(corpus, "annotations.journal.load"), [&] {
+            AnnotationStore loaded;
+            AnnotationJournal j;
+            j.open(journalPath, &loaded, pages);
+        });
+        sample(add(corpus, "annotations.json.save"), [&] { writeMarkupsJson(store, jsonPath, corpus); });
+        sample(add(corpus, "annotations.json.load"), [&] {
+            AnnotationStore loaded;
+            readMarkupsJson(&loaded, jsonPath, pages);
+        });
+        // every page's markup layer at 200% (the overlay's full repaint after a zoom)
+        Result& composite = add(corpus, "annotations.composite");
+        composite.extra.insert("kernel", MarkupCompositor::kernelName());
+        sample(composite, [&] {
+            MarkupCompositor compositor(&store);
+            QPoint origin;
+            for (int p = 0; p < pages; ++p) compositor.layer(p, 2.0 * kScreenDpi / 72, &origin);
+        });
+
+        Result& save = add(corpus, "annotations.pdf.saveCopy");
+        save.extra.insert("markups", store.count());
+        sample(save, [&] {
+            copyFileFast(path, copyPath);
+            appendMarkupAnnotations(copyPath, store);
+        });
+    }
+
+    QString m_dir;
+    int m_reps;
+    QJsonArray m_corpus;
+    std::deque<Result> m_results;   // add() hands out references that must stay valid
+};
+}
+
+int main(int argc, char* argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("PDFEditor");
+    app.setApplicationName("PDFEditorBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times load/render/search/annotation paths on a generated corpus.");
+    parser.addHelpOption();
+    const QCommandLineOption quick("quick", "Small corpus, for a smoke run.");
+    const QCommandLineOption reps("reps", "Repetitions per measurement (default 5).", "n", "5");
+    const QCommandLineOption workdir("workdir", "Where to put the corpus (default: a temporary directory).", "dir");
+    const QCommandLineOption out("out", "Write the JSON here instead of stdout.", "file");
+    parser.addOptions({ quick, reps, workdir, out });
+    parser.process(app);
+
+    QTemporaryDir tmp;
+    const QString dir = parser.isSet(workdir) ? parser.value(workdir) : tmp.path();
+    QDir().mkpath(dir);
+
+    QVector<SyntheticPdfSpec> corpus;
+    if (parser.isSet(quick)) {
+        corpus << SyntheticPdfSpec{ "text-10", 10, 300, {}, 1 }
+               << SyntheticPdfSpec{ "scan-5", 5, 250, QSize(425, 550), 2 };
+    } else {
+        corpus << SyntheticPdfSpec{ "text-10", 10, 300, {}, 1 }
+               << SyntheticPdfSpec{ "text-500", 500, 400, {}, 2 }
+               << SyntheticPdfSpec{ "sparse-2000", 2000, 40, {}, 3 }
+               << SyntheticPdfSpec{ "scan-50", 50, 250, QSize(850, 1100), 4 }
+               << SyntheticPdfSpec{ "scan-300", 300, 0, QSize(1275, 1650), 5 };
+    }
+
+    Bench bench(dir, parser.value(reps).toInt());
+    for (const SyntheticPdfSpec& spec : std::as_const(corpus)) {
+        QTextStream(stderr) << "bench: " << spec.name << Qt::endl;
+        bench.run(spec);
+    }
+
+    const QByteArray json = QJsonDocument(bench.report()).toJson(QJsonDocument::Indented);
+    if (parser.isSet(out)) {
+        QFile f(parser.value(out));
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(json) != json.size()) {
+            QTextStream(stderr) << "cannot write " << f.fileName() << Qt::endl;
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "syntheticpdf.h"
+
+#include <QFile>
+#include <QRandomGenerator>
+#include <QVector>
+
+const char kSyntheticNeedle[] = "quixotic";
+
+namespace {
+const char* const kWords[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be",
+    "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have",
+    "an", "had", "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there",
+    "been", "if", "more", "when", "will", "would", "who", "so", "no", "drawing", "section",
+    "elevation", "detail", "revision", "contract", "schedule", "specification", "assembly",
+    "tolerance", "material", "finish", "dimension", "reference", "approved", "general", "notes",
+};
+constexpr int kWordCount = int(sizeof kWords / sizeof kWords[0]);
+
+constexpr int kPageW = 612, kPageH = 792;   // US Letter, points
+constexpr int kMargin = 54;
+constexpr int kFontSize = 10, kLeading = 12;
+constexpr int kWordsPerLine = 12;
+
+class Writer {
+public:
+    explicit Writer(QFile& f) : m_f(f) {}
+
+    // Object numbers are assigned up front, so offsets[] can be filled in any order.
+    void begin(int num) {
+        if (num >= m_offsets.size()) m_offsets.resize(num + 1);
+        m_offsets[num] = m_f.pos();
+        write(QByteArray::number(num) + " 0 obj\n");
+    }
+    void end() { write("\nendobj\n"); }
+    void object(int num, const QByteArray& body) { begin(num); write(body); end(); }
+    void stream(int num, const QByteArray& dict, const QByteArray& data) {
+        begin(num);
+        write("<<" + dict + " /Length " + QByteArray::number(data.size()) + ">>\nstream\n");
+        write(data);
+        write("\nendstream");
+        end();
+    }
+    void write(const QByteArray& b) { m_ok = m_ok && m_f.write(b) == b.size(); }
+
+    bool finish(int rootNum) {
+        const qint64 xref = m_f.pos();
+        write("xref\n0 " + QByteArray::number(m_offsets.size()) + "\n0000000000 65535 f\r\n");
+        for (int i = 1; i < m_offsets.size(); ++i)
+            write(QByteArray::number(m_offsets[i]).rightJustified(10, '0') + " 00000 n\r\n");
+        write("trailer\n<</Size " + QByteArray::number(m_offsets.size()) + " /Root "
+              + QByteArray::number(rootNum) + " 0 R>>\nstartxref\n" + QByteArray::number(xref) + "\n%%EOF\n");
+        return m_ok;
+    }
+
+private:
+    QFile& m_f;
+    QVector<qint64> m_offsets{ 0 };
+    bool m_ok = true;
+};
+
+QByteArray pageText(QRandomGenerator& rng, int words, bool invisible) {
+    QByteArray s = "BT /F1 " + QByteArray::number(kFontSize) + " Tf " + QByteArray::number(kLeading) + " TL ";
+    if (invisible) s += "3 Tr ";   // OCR layer under a scan
+    s += QByteArray::number(kMargin) + ' ' + QByteArray::number(kPageH - kMargin) + " Td\n";
+    const int maxLines = (kPageH - 2 * kMargin) / kLeading;
+    int lines = 0;
+    for (int w = 0; w < words && lines < maxLines; ++lines) {
+        QByteArray line;
+        for (int i = 0; i < kWordsPerLine && w < words; ++i, ++w) {
+            if (i) line += ' ';
+            line += int(rng.bounded(kNeedleEvery)) == 0 ? kSyntheticNeedle : kWords[rng.bounded(kWordCount)];
+        }
+        s += '(' + line + ") Tj T*\n";
+    }
+    return s + "ET\n";
+}
+
+// Paper-ish gray with noise and dark bands where lines of text would be; noise
+// keeps it from compressing unrealistically well.
+QByteArray scanImage(QRandomGenerator& rng, const QSize& size) {
+    QByteArray px(qsizetype(size.width()) * size.height(), '\0');
+    const int band = qMax(4, size.height() / 60);
+    for (int y = 0; y < size.height(); ++y) {
+        const bool inkRow = (y / band) % 2 == 1 && y > size.height() / 12 && y < size.height() * 11 / 12;
+        uchar* row = reinterpret_cast<uchar*>(px.data()) + qsizetype(y) * size.width();
+        for (int x = 0; x < size.width(); ++x) {
+            int v = 235 + int(rng.bounded(20)) - 10;
+            if (inkRow && x > size.width() / 10 && x < size.width() * 9 / 10 && rng.bounded(3) == 0) v = 40;
+            row[x] = uchar(qBound(0, v, 255));
+        }
+    }
+    return qCompress(px, 6).mid(4);   // drop Qt's length prefix: what's left is a zlib stream
+}
+}
+
+bool writeSyntheticPdf(const QString& path, const SyntheticPdfSpec& spec) {
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    QRandomGenerator rng(spec.seed);
+    Writer w(f);
+    w.write("%PDF-1.7\n%\xe2\xe3\xcf\xd3\n");
+
+    // 1 catalog, 2 page tree, 3 font, then per page: page, contents[, image]
+    const int perPage = spec.scan.isEmpty() ? 2 : 3;
+    auto pageNum = [perPage](int i) { return 4 + i * perPage; };
+
+    w.object(1, "<</Type /Catalog /Pages 2 0 R>>");
+    QByteArray kids;
+    for (int i = 0; i < spec.pages; ++i) kids += QByteArray::number(pageNum(i)) + " 0 R ";
+    w.object(2, "<</Type /Pages /Count " + QByteArray::number(spec.pages) + " /Kids [" + kids + "]>>");
+    w.object(3, "<</Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding>>");
+
+    for (int i = 0; i < spec.pages; ++i) {
+        const int page = pageNum(i), contents = page + 1, image = page + 2;
+        QByteArray resources = "/Font <</F1 3 0 R>>";
+        QByteArray content;
+        if (!spec.scan.isEmpty()) {
+            resources += " /XObject <</Im0 " + QByteArray::number(image) + " 0 R>>";
+            content += "q " + QByteArray::number(kPageW) + " 0 0 " + QByteArray::number(kPageH) + " 0 0 cm /Im0 Do Q\n";
+        }
+        if (spec.wordsPerPage > 0) content += pageText(rng, spec.wordsPerPage, !spec.scan.isEmpty());
+
+        w.object(page, "<</Type /Page /Parent 2 0 R /MediaBox [0 0 " + QByteArray::number(kPageW) + ' '
+                       + QByteArray::number(kPageH) + "] /Resources <<" + resources + ">> /Contents "
+                       + QByteArray::number(contents) + " 0 R>>");
+        w.stream(contents, "/Filter /FlateDecode", qCompress(content, 6).mid(4));
+        if (!spec.scan.isEmpty())
+            w.stream(image, "/Type /XObject /Subtype /Image /Width " + QByteArray::number(spec.scan.width())
+                            + " /Height " + QByteArray::number(spec.scan.height())
+                            + " /ColorSpace /DeviceGray /BitsPerComponent 8 /Filter /FlateDecode",
+                     scanImage(rng, spec.scan));
+    }
+    return w.finish(1);
+}
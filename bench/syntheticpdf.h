@@ -0,0 +1,21 @@
+#pragma once
+#include <QSize>
+#include <QString>
+
+// Shape of a generated test document.
+struct SyntheticPdfSpec {
+    QString name;
+    int     pages = 10;
+    int     wordsPerPage = 300;   // text layer; 0 = none
+    QSize   scan;                 // full-page grayscale image per page (a "scan"); empty = none
+    quint32 seed = 1;
+};
+
+// Word sprinkled through the generated text (about one in kNeedleEvery words)
+// so searches have something to find.
+extern const char kSyntheticNeedle[];
+constexpr int kNeedleEvery = 400;
+
+// Writes a self-contained PDF (Helvetica text, optional Flate-compressed
+// images, classic xref table). Same spec, same bytes.
+bool writeSyntheticPdf(const QString& path, const SyntheticPdfSpec& spec);
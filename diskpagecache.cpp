@@ -0,0 +1,256 @@
+#include "diskpagecache.h"
+#include "textindex.h"   // fileContentHash
+#include "trace.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char kMagic[4] = { 'P', 'D', 'P', 'C' };
+constexpr quint32 kVersion = 1;
+constexpr int kCompressLevel = 1;
+constexpr int kMaxQueuedStores = 8;   // past that a render's page isn't written; it's only a cache
+const char kSuffix[] = ".page";
+
+struct EntryHeader {
+    char    magic[4];
+    quint32 version;
+    qint32  width;
+    qint32  height;
+    quint32 format;        // QImage::Format
+    quint32 bytesPerLine;
+};
+
+// what render() hands out; anything else in an entry means it's damaged
+bool cacheableFormat(quint32 format) {
+    return format == QImage::Format_ARGB32 || format == QImage::Format_ARGB32_Premultiplied;
+}
+
+qint64 nowMs() { return QDateTime::currentMSecsSinceEpoch(); }
+
+// QSettings keys can't hold a path; the memo is keyed by a hash of it instead
+QString memoKey(const QString& absPath) {
+    return QString::fromLatin1(QCryptographicHash::hash(absPath.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString fileStamp(const QFileInfo& fi) {
+    return QString("%1:%2").arg(fi.size()).arg(fi.lastModified().toMSecsSinceEpoch());
+}
+}
+
+DiskPageCache::DiskPageCache(const QString& dir, qint64 capBytes, QObject* parent)
+    : QObject(parent), m_dir(dir), m_cap(qMax<qint64>(capBytes, 1))
+{
+    QDir().mkpath(m_dir);
+    m_pool.setMaxThreadCount(1);   // one file at a time; it's all disk bandwidth
+    m_storePool.setMaxThreadCount(1);
+    m_storePool.start([this] { scan(); });
+}
+
+DiskPageCache::~DiskPageCache() {
+    m_pool.clear();
+    m_storePool.clear();
+    m_pool.waitForDone();
+    m_storePool.waitForDone();
+}
+
+DiskPageCache* DiskPageCache::fromSettings(QObject* parent) {
+    const qint64 mb = QSettings().value("cache/diskMB", kDefaultCapMB).toLongLong();
+    if (mb <= 0) return nullptr;
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pages";
+    return new DiskPageCache(dir, mb << 20, parent);
+}
+
+QString DiskPageCache::entryName(const QByteArray& contentHash, const RenderKey& key) const {
+    return QString("%1-%2-%3-%4%5").arg(QString::fromLatin1(contentHash)).arg(key.page)
+        .arg(key.zoomMilli).arg(key.rotation).arg(QLatin1String(kSuffix));
+}
+
+QImage DiskPageCache::load(const QByteArray& contentHash, const RenderKey& key) {
+    if (contentHash.isEmpty() || key.isTile()) return {};
+    const QString name = entryName(contentHash, key);
+    {
+        QMutexLocker lock(&m_lock);
+        if (m_scanned && !m_entries.contains(name)) return {};   // before the scan, the file itself says
+    }
+    TRACE_SPAN_ARG("cache", "diskLoad", key.page);
+
+    QFile f(m_dir + "/" + name);
+    if (!f.open(QIODevice::ReadOnly)) return {};
+    const QByteArray data = f.readAll();
+    f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);   // LRU across runs
+    f.close();
+
+    // never trust an entry: everything is checked before anything gets allocated,
+    // and a bad one is deleted so it isn't read again
+    auto reject = [this, &name] {
+        QMutexLocker lock(&m_lock);
+        dropLocked(name);
+        return QImage();
+    };
+    EntryHeader h;
+    // qCompress puts the uncompressed size (big-endian) in front of the data
+    if (data.size() < qsizetype(sizeof h) + 4) return reject();
+    std::memcpy(&h, data.constData(), sizeof h);
+    const uchar* packed = reinterpret_cast<const uchar*>(data.constData()) + sizeof h;
+    const qint64 rawSize = qint64(h.width) * h.height * 4;
+    const quint32 declared = quint32(packed[0]) << 24 | quint32(packed[1]) << 16 | quint32(packed[2]) << 8 | packed[3];
+    if (std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 || h.version != kVersion || !cacheableFormat(h.format)
+        || h.width <= 0 || h.height <= 0 || rawSize > kMaxEntryBytes
+        || qint64(h.bytesPerLine) != qint64(h.width) * 4 || declared != quint64(rawSize))
+        return reject();
+    const QByteArray bits = qUncompress(packed, data.size() - qsizetype(sizeof h));
+    QImage img(h.width, h.height, QImage::Format(h.format));
+    if (img.isNull() || img.bytesPerLine() != qsizetype(h.bytesPerLine) || bits.size() != img.sizeInBytes())
+        return reject();
+    std::memcpy(img.bits(), bits.constData(), size_t(bits.size()));
+
+    QMutexLocker lock(&m_lock);
+    touchLocked(name, data.size());
+    return img;
+}
+
+void DiskPageCache::store(const QByteArray& contentHash, const RenderKey& key, const QImage& img) {
+    if (contentHash.isEmpty() || key.isTile() || img.isNull() || img.sizeInBytes() > kMaxEntryBytes
+        || !cacheableFormat(img.format()) || img.bytesPerLine() != qsizetype(img.width()) * 4)
+        return;
+    const QString name = entryName(contentHash, key);
+    {
+        QMutexLocker lock(&m_lock);
+        // the same pixels already, or on their way
+        if (m_entries.contains(name) || m_storing.contains(name) || m_storing.size() >= kMaxQueuedStores) return;
+        m_storing.insert(name);
+    }
+    m_storePool.start([this, name, key, img] {
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        write(name, key, img);
+        QMutexLocker lock(&m_lock);
+        m_storing.remove(name);
+    });
+}
+
+void DiskPageCache::write(const QString& name, const RenderKey& key, const QImage& img) {
+    TRACE_SPAN_ARG("cache", "diskStore", key.page);
+    EntryHeader h{};
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.version = kVersion;
+    h.width = img.width();
+    h.height = img.height();
+    h.format = quint32(img.format());
+    h.bytesPerLine = quint32(img.bytesPerLine());
+    const QByteArray bits = qCompress(img.constBits(), int(img.sizeInBytes()), kCompressLevel);
+
+    // written aside and renamed, so a reader never sees half an entry
+    QSaveFile f(m_dir + "/" + name);
+    if (!f.open(QIODevice::WriteOnly)) return;
+    f.write(reinterpret_cast<const char*>(&h), sizeof h);
+    f.write(bits);
+    if (!f.commit()) return;
+
+    QStringList evicted;
+    {
+        QMutexLocker lock(&m_lock);
+        touchLocked(name, qint64(sizeof h) + bits.size());
+        evicted = evictLocked();
+    }
+    removeFiles(evicted);
+}
+
+qint64 DiskPageCache::bytesUsed() {
+    QMutexLocker lock(&m_lock);
+    return m_total;
+}
+
+// The index is built from the directory listing once, on the store worker, mtimes
+// standing in for last use. Entries read or written before it finished are kept.
+void DiskPageCache::scan() {
+    TRACE_SPAN("cache", "diskScan");
+    const QFileInfoList files = QDir(m_dir).entryInfoList({ QString("*") + kSuffix }, QDir::Files);
+    QStringList evicted;
+    {
+        QMutexLocker lock(&m_lock);
+        for (const QFileInfo& fi : files) {
+            if (m_entries.contains(fi.fileName())) continue;
+            Entry& e = m_entries[fi.fileName()];
+            e.bytes = fi.size();
+            e.used = fi.lastModified().toMSecsSinceEpoch();
+            m_total += e.bytes;
+        }
+        m_scanned = true;
+        evicted = evictLocked();
+    }
+    removeFiles(evicted);
+}
+
+void DiskPageCache::touchLocked(const QString& name, qint64 bytes) {
+    Entry& e = m_entries[name];
+    m_total += bytes - e.bytes;
+    e.bytes = bytes;
+    e.used = nowMs();
+}
+
+void DiskPageCache::dropLocked(const QString& name) {
+    QFile::remove(m_dir + "/" + name);
+    m_total -= m_entries.take(name).bytes;
+}
+
+void DiskPageCache::removeFiles(const QStringList& names) {
+    for (const QString& name : names) QFile::remove(m_dir + "/" + name);
+}
+
+// Down to 90% of the cap, oldest first, so it doesn't run again on the next store.
+// Only the index is updated here; the caller deletes the files once it has unlocked.
+QStringList DiskPageCache::evictLocked() {
+    QStringList evicted;
+    if (m_total <= m_cap) return evicted;
+    QVector<QPair<qint64, QString>> byAge;
+    byAge.reserve(m_entries.size());
+    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) byAge.append({ it->used, it.key() });
+    std::sort(byAge.begin(), byAge.end());
+
+    const qint64 target = m_cap / 10 * 9;
+    for (const auto& aged : std::as_const(byAge)) {
+        if (m_total <= target) break;
+        m_total -= m_entries.take(aged.second).bytes;
+        evicted.append(aged.second);
+    }
+    return evicted;
+}
+
+QByteArray DiskPageCache::knownHash(const QString& pdfPath) const {
+    const QFileInfo fi(pdfPath);
+    const QSettings memo(memoPath(), QSettings::IniFormat);
+    const QStringList v = memo.value(memoKey(fi.absoluteFilePath())).toStringList();   // stamp, hash
+    if (v.size() != 2 || v[0] != fileStamp(fi)) return {};
+    return v[1].toLatin1();
+}
+
+void DiskPageCache::hashInBackground(const QString& pdfPath) {
+    const QString path = QFileInfo(pdfPath).absoluteFilePath();
+    const QByteArray known = knownHash(path);
+    if (!known.isEmpty()) {
+        emit hashReady(path, known);
+        return;
+    }
+    // stamped before reading: a file rewritten while it's hashed must not get the old hash
+    const QString stamp = fileStamp(QFileInfo(path));
+    m_pool.start([this, path, stamp] {
+        TRACE_SPAN("cache", "hashFile");
+        const QByteArray hash = fileContentHash(path);   // chunked, same hash as the text index
+        QMetaObject::invokeMethod(this, [this, path, stamp, hash] {
+            if (hash.isEmpty() || fileStamp(QFileInfo(path)) != stamp) return;
+            QSettings memo(memoPath(), QSettings::IniFormat);
+            memo.setValue(memoKey(path), QStringList{ stamp, QString::fromLatin1(hash) });
+            emit hashReady(path, hash);
+        }, Qt::QueuedConnection);
+    });
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+#include "pagerenderer.h"   // RenderKey
+
+// Rendered whole pages on disk, so a document opened again (tomorrow, after a
+// restart) paints from files instead of pdfium. Entries are keyed by the PDF's
+// content hash plus the render key, and stored as a small header and the
+// zlib-compressed pixels (level 1: decoding is a memcpy away, and a mostly
+// white page shrinks a lot). The directory is capped ("cache/diskMB"); past
+// that the least recently read or written entries go.
+//
+// load() and store() are called from render workers, so the index is locked;
+// the file I/O happens outside the lock. store() only queues the page: the
+// compression and the write run on a low-priority worker of the cache's own,
+// as does the first directory scan, so renders never wait behind them. Content
+// hashes are computed in the background and remembered per path, size and
+// mtime, so reopening an unchanged file knows its hash right away.
+class DiskPageCache : public QObject {
+    Q_OBJECT
+public:
+    static constexpr qint64 kDefaultCapMB = 512;
+    static constexpr qint64 kMaxEntryBytes = 32 << 20;   // raw; bigger pages aren't worth the disk
+
+    explicit DiskPageCache(const QString& dir, qint64 capBytes, QObject* parent = nullptr);
+    ~DiskPageCache();
+
+    // <cache location>/pages, capped by QSettings; nullptr if the cap is 0 (disabled).
+    static DiskPageCache* fromSettings(QObject* parent = nullptr);
+
+    // Thread-safe. A null image on a miss or a damaged file.
+    QImage load(const QByteArray& contentHash, const RenderKey& key);
+    // Thread-safe; returns right away, the entry is written in the background.
+    void store(const QByteArray& contentHash, const RenderKey& key, const QImage& img);
+
+    qint64 capacity() const { return m_cap; }
+    qint64 bytesUsed();
+
+    // Hash of the file as last computed, if it hasn't changed since; empty otherwise.
+    QByteArray knownHash(const QString& pdfPath) const;
+    // Hash it on a worker (unless known) and emit hashReady().
+    void hashInBackground(const QString& pdfPath);
+
+signals:
+    void hashReady(const QString& pdfPath, const QByteArray& contentHash);
+
+private:
+    struct Entry {
+        qint64 bytes = 0;
+        qint64 used = 0;       // ms since epoch; file mtime when scanned
+    };
+    QString entryName(const QByteArray& contentHash, const RenderKey& key) const;
+    void write(const QString& name, const RenderKey& key, const QImage& img);   // store worker
+    void scan();                                                               // store worker
+    void touchLocked(const QString& name, qint64 bytes);
+    QStringList evictLocked();               // forgets entries; returns the files to delete
+    void dropLocked(const QString& name);   // delete the file and forget it
+    void removeFiles(const QStringList& names);
+    QString memoPath() const { return m_dir + "/hashes.ini"; }
+
+    QString m_dir;
+    qint64  m_cap;
+    QMutex  m_lock;                    // guards everything below
+    bool    m_scanned = false;
+    QHash<QString, Entry> m_entries;   // by file name
+    QSet<QString> m_storing;           // queued or being written
+    qint64  m_total = 0;
+    QThreadPool m_pool;                // hashing
+    QThreadPool m_storePool;           // writes and the scan, one at a time
+};
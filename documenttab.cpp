@@ -0,0 +1,114 @@
+#include "documenttab.h"
+#include "pdfpageview.h"
+#include "pagerenderer.h"
+#include "prefetcher.h"
+#include "searchengine.h"
+#include "textgeometry.h"
+#include "annotationoverlay.h"
+#include "annotationjournal.h"
+#include "annotationhistory.h"
+#include "mappedfile.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfPageNavigator>
+#include <QVBoxLayout>
+#include <QLabel>
+#include <QPixmap>
+
+DocumentTab::DocumentTab(RenderScheduler* scheduler, int maxSearchHits, bool continuous, QWidget* parent)
+    : QWidget(parent),
+    doc(new QPdfDocument(this)), view(new PdfPageView(this)),
+    renderer(new PageRenderService(doc, scheduler, this))
+{
+    auto *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(view);
+
+    view->setDocument(doc);
+    view->setRenderService(renderer);   // pages are painted from the render cache
+    renderer->setActive(false);         // until MainWindow brings the tab to the front
+
+    // warm the cache for wherever the reader is heading
+    prefetch = new PrefetchScheduler(view, renderer, this);
+    connect(view->pageNavigator(), &QPdfPageNavigator::currentPageChanged,
+            prefetch, &PrefetchScheduler::pageChanged);
+    connect(view, &QPdfView::zoomFactorChanged, prefetch, &PrefetchScheduler::zoomChanged);
+    connect(view, &QPdfView::zoomModeChanged,   prefetch, &PrefetchScheduler::zoomChanged);
+
+    searchEngine = new SearchEngine(doc, this);
+    searchEngine->setMaxHits(maxSearchHits);
+    view->setSearchEngine(searchEngine);
+
+    overlay = new AnnotationOverlay(view, &store);
+    journal = new AnnotationJournal(this);
+    history = new AnnotationHistory(&store, journal, this);
+    connect(history, &AnnotationHistory::markupChanged, overlay, &AnnotationOverlay::markupChanged);
+    geometry = new TextGeometryStore(doc, this);
+
+    view->setZoomMode(QPdfView::ZoomMode::FitToWidth);
+    view->setPageMode(continuous ? QPdfView::PageMode::MultiPage : QPdfView::PageMode::SinglePage);
+}
+
+// Children would go in creation order, the document first; stop every worker
+// reading it before it goes.
+DocumentTab::~DocumentTab() {
+    delete geometry;
+    delete searchEngine;
+    delete prefetch;
+    delete view;
+    delete renderer;
+    delete history;
+    delete journal;   // flushes
+    delete doc;
+    delete device;
+}
+
+void DocumentTab::setActive(bool active) {
+    if (active == m_active) return;
+    m_active = active;
+    renderer->setActive(active);
+    if (!active) {
+        overlay->reload();   // drops the composited layers; rebuilt on the next paint
+        // queued word extraction waits for the tab to come back (finished pages stay)
+        if (geometry->pause() && m_geometryPage < 0)
+            m_geometryPage = view->pageNavigator() ? view->pageNavigator()->currentPage() : 0;
+    } else if (m_geometryPage >= 0) {
+        extractGeometry(m_geometryPage);
+    }
+}
+
+void DocumentTab::extractGeometry(int page) {
+    if (!m_active) {
+        m_geometryPage = page;
+        return;
+    }
+    m_geometryPage = -1;
+    geometry->extractAll();
+    geometry->prioritize(page);
+}
+
+void DocumentTab::showStandIn(const QImage& img) {
+    if (!m_standIn) {
+        m_standIn = new QLabel(this);   // over the view, not in the layout
+        m_standIn->setAlignment(Qt::AlignHCenter | Qt::AlignTop);
+        m_standIn->setAutoFillBackground(true);
+        m_standIn->setBackgroundRole(view->viewport()->backgroundRole());
+        m_standIn->setAttribute(Qt::WA_TransparentForMouseEvents);
+    }
+    QImage scaled = img;
+    scaled.setDevicePixelRatio(devicePixelRatioF());   // rendered at device pixels, like the view's pages
+    m_standIn->setPixmap(QPixmap::fromImage(scaled));
+    m_standIn->setGeometry(rect());   // the view fills the tab
+    m_standIn->raise();
+    m_standIn->show();
+}
+
+void DocumentTab::hideStandIn() {
+    delete m_standIn;
+    m_standIn = nullptr;
+}
+
+void DocumentTab::resizeEvent(QResizeEvent* ev) {
+    QWidget::resizeEvent(ev);
+    if (m_standIn) m_standIn->setGeometry(rect());
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <QWidget>
+#include <QElapsedTimer>
+#include <QPointF>
+#include <QString>
+
+#include "annotationstore.h"
+
+class QPdfDocument;
+class QLabel;
+class QImage;
+class PdfPageView;
+class PageRenderService;
+class RenderScheduler;
+class PrefetchScheduler;
+class SearchEngine;
+class AnnotationOverlay;
+class AnnotationJournal;
+class AnnotationHistory;
+class TextGeometryStore;
+class MappedFileDevice;
+
+// One open document: the view and everything that works on its document (render
+// service, prefetcher, search, markups). Renders go through the scheduler shared
+// by all tabs. MainWindow drives it, hence the plain fields; it only owns them.
+class DocumentTab : public QWidget {
+    Q_OBJECT
+public:
+    DocumentTab(RenderScheduler* scheduler, int maxSearchHits, bool continuous, QWidget* parent = nullptr);
+    ~DocumentTab();
+
+    bool isEmpty() const { return currentFile.isEmpty() && loadingFile.isEmpty(); }
+
+    // The tab in front renders ahead of the others and keeps its markup layers;
+    // a background one gives those up, only finishes the renders already queued
+    // and puts word extraction on hold.
+    void setActive(bool active);
+    bool isActive() const { return m_active; }
+    // Extract word boxes for the loaded document (the page first), once the tab is in front:
+    // pdfium's lock is shared with rendering, so background tabs shouldn't hold it.
+    // Only for documents without a text index; with one, geometry reads it.
+    void extractGeometry(int page);
+
+    // A saved picture of the first screen (session restore), shown over the view
+    // until its own render of the page arrives.
+    void showStandIn(const QImage& img);
+    void hideStandIn();
+
+    QPdfDocument*       doc;
+    PdfPageView*        view;
+    PageRenderService*  renderer;
+    PrefetchScheduler*  prefetch;
+    SearchEngine*       searchEngine;
+    AnnotationStore     store;
+    AnnotationOverlay*  overlay;
+    AnnotationJournal*  journal;
+    AnnotationHistory*  history;            // every markup edit goes through this (undo/redo)
+    TextGeometryStore*  geometry;
+    MappedFileDevice*   device = nullptr;   // backs doc in mapped mode
+
+    QString         currentFile;
+    QString         loadingFile;            // set while a load is in flight
+    int             pendingJumpPage = 0;    // where to go once the load finishes
+    QPointF         pendingJumpPt;
+    QElapsedTimer   loadTimer;
+    qint64          loadTraceNs = -1;       // Trace::nowNs() at load, -1 if not tracing
+    bool            firstPageShown = true;
+    int             searchIndex = -1;
+
+protected:
+    void resizeEvent(QResizeEvent* ev) override;
+
+private:
+    QLabel* m_standIn = nullptr;
+    bool m_active = false;
+    int  m_geometryPage = -1;               // extraction wanted from here once active
+};
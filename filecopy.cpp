@@ -0,0 +1,79 @@
+#include "filecopy.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+bool fail(QString* error, const QString& msg) {
+    if (error) *error = msg;
+    return false;
+}
+
+#if defined(Q_OS_LINUX)
+// true: copied. false with *tryFallback: the kernel can't do it for these
+// files, nothing useful was written. false otherwise: a real I/O error.
+bool kernelCopy(int in, int out, qint64 size, bool* tryFallback) {
+    *tryFallback = false;
+#ifdef FICLONE
+    if (::ioctl(out, FICLONE, in) == 0) return true;
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    qint64 done = 0;
+    while (done < size) {
+        const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, size_t(size - done), 0);
+        if (n > 0) { done += n; continue; }
+        if (n == 0) break;   // source shrank under us
+        if (errno == EINTR) continue;
+        // EXDEV before 5.3 / across filesystems, ENOSYS on old kernels,
+        // EOPNOTSUPP/EINVAL on special files: only recoverable if nothing went through
+        *tryFallback = done == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL);
+        return false;
+    }
+    return done == size;
+#else
+    Q_UNUSED(size);
+    *tryFallback = true;
+    return false;
+#endif
+}
+#endif
+}
+
+bool copyFileFast(const QString& src, const QString& dst, QString* error) {
+    const QFileInfo srcInfo(src);
+    if (!srcInfo.isFile()) return fail(error, QString("%1 does not exist.").arg(src));
+    if (QFileInfo(dst).exists() && srcInfo.canonicalFilePath() == QFileInfo(dst).canonicalFilePath())
+        return fail(error, "Source and destination are the same file.");
+
+#if defined(Q_OS_LINUX)
+    {
+        QFile in(src);
+        QFile out(dst);
+        if (!in.open(QIODevice::ReadOnly)) return fail(error, in.errorString());
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) return fail(error, out.errorString());
+
+        bool tryFallback = false;
+        if (kernelCopy(in.handle(), out.handle(), in.size(), &tryFallback)) return true;
+        if (!tryFallback) {
+            out.close();
+            QFile::remove(dst);
+            return fail(error, QString("Copy failed: %1").arg(qt_error_string(errno)));
+        }
+    }
+#endif
+
+    // QFile::copy refuses to overwrite
+    if (QFile::exists(dst) && !QFile::remove(dst))
+        return fail(error, QString("Cannot replace %1.").arg(dst));
+    QFile in(src);
+    if (!in.copy(dst)) return fail(error, in.errorString());
+    return true;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <QString>
+
+// Copies src to dst (overwriting it) without pulling the data through user
+// space where the platform allows: a reflink (FICLONE) shares the extents on
+// CoW filesystems, copy_file_range lets the kernel (or the NFS/SMB server) do
+// the copy elsewhere. Falls back to QFile::copy.
+bool copyFileFast(const QString& src, const QString& dst, QString* error = nullptr);
@@ -1,15 +1,102 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QGuiApplication>
+#include <QTextStream>
+#include "batchrunner.h"
 #include "mainwindow.h"
 
-int main(int argc, char *argv[]) {
-    QApplication app(argc, argv);
-    MainWindow w;
-    w.show();
-    return app.exec();
+namespace {
+bool wantsHeadless(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i)
+        if (qstrcmp(argv[i], "--headless") == 0) return true;
+    return false;
 }
 
+// PDFEditor --headless [--render --dpi N --pages R] [--search TEXT] [--annotations]
+//           [--extract L] [--delete R] [--rotate DEG] [--split N] [--merge NAME] -o DIR files...
+int runHeadless(int argc, char* argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");   // no display needed on a server
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("PDFEditor");
+    app.setApplicationName("PDFEditor");
 
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Batch jobs over PDFs, without the UI.");
+    parser.addHelpOption();
+    const QCommandLineOption headless("headless", "Run batch jobs instead of opening the window.");
+    const QCommandLineOption render("render", "Render pages to PNG.");
+    const QCommandLineOption dpi("dpi", "Resolution for --render (default 150).", "dpi", "150");
+    const QCommandLineOption pages("pages", "Pages to work on, e.g. 1-3,7,10- (default all).", "ranges");
+    const QCommandLineOption search("search", "Count occurrences of text on every page.", "text");
+    const QCommandLineOption annotations("annotations",
+        "Export each file's markups as JSON and as an annotated copy of the PDF.");
+    const QCommandLineOption extract("extract",
+        "Copy these pages, in this order, to <name>.extract.pdf (e.g. 3,1-2 or 10-1).", "list");
+    const QCommandLineOption remove("delete", "Copy the document without these pages to <name>.trimmed.pdf.", "ranges");
+    const QCommandLineOption rotate("rotate", "Turn the --pages pages clockwise, into <name>.rotated.pdf.", "degrees");
+    const QCommandLineOption split("split", "Split into <name>-partN.pdf files of n pages.", "n");
+    const QCommandLineOption merge("merge", "Merge all files, in order, into this file in the output directory.", "name");
+    const QCommandLineOption output({ "o", "output" }, "Output directory (default .).", "dir", ".");
+    const QCommandLineOption list("list", "Read more PDF paths from a file, one per line.", "file");
+    const QCommandLineOption jobs({ "j", "jobs" }, "Worker threads (default: one per core).", "n", "0");
+    parser.addOptions({ headless, render, dpi, pages, search, annotations, extract, remove, rotate, split, merge,
+                        output, list, jobs });
+    parser.addPositionalArgument("files", "PDF files to process.", "[files...]");
+    parser.process(app);
 
+    BatchOptions opt;
+    opt.files = parser.positionalArguments();
+    if (parser.isSet(list)) {
+        QFile f(parser.value(list));
+        if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream(stderr) << "Cannot read " << f.fileName() << Qt::endl;
+            return 2;
+        }
+        QTextStream in(&f);
+        while (!in.atEnd()) {
+            const QString line = in.readLine().trimmed();
+            if (!line.isEmpty() && !line.startsWith('#')) opt.files << line;
+        }
+    }
+    opt.render = parser.isSet(render);
+    opt.dpi = qBound(1, parser.value(dpi).toInt(), 2400);
+    opt.pages = parser.value(pages);
+    opt.search = parser.value(search);
+    opt.annotations = parser.isSet(annotations);
+    opt.extract = parser.value(extract);
+    opt.remove = parser.value(remove);
+    if (parser.isSet(rotate)) {
+        bool ok = false;
+        const int degrees = parser.value(rotate).toInt(&ok);
+        if (!ok || degrees % 90 != 0) {
+            QTextStream(stderr) << "--rotate takes a multiple of 90 degrees, not " << parser.value(rotate) << Qt::endl;
+            return 2;
+        }
+        opt.rotate = (degrees % 360 + 360) % 360;
+    }
+    opt.split = qMax(0, parser.value(split).toInt());
+    opt.merge = parser.value(merge);
+    opt.outputDir = parser.value(output);
+    opt.threads = parser.value(jobs).toInt();
 
+    const bool edits = !opt.extract.isEmpty() || !opt.remove.isEmpty() || opt.rotate || opt.split || !opt.merge.isEmpty();
+    if (opt.files.isEmpty() || (!opt.render && opt.search.isEmpty() && !opt.annotations && !edits)) {
+        QTextStream(stderr) << parser.helpText();
+        return 2;
+    }
+    return runBatch(opt);
+}
+}
 
+int main(int argc, char *argv[]) {
+    if (wantsHeadless(argc, argv)) return runHeadless(argc, argv);
 
+    QApplication app(argc, argv);
+    app.setOrganizationName("PDFEditor");   // QSettings + cache locations
+    app.setApplicationName("PDFEditor");
+    MainWindow w;
+    w.show();
+    return app.exec();
+}
@@ -1,11 +1,29 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "documenttab.h"
+#include "pdfpageview.h"
+#include "pagerenderer.h"
+#include "prefetcher.h"
+#include "searchengine.h"
+#include "textindex.h"
+#include "textindexer.h"
+#include "textgeometry.h"
+#include "annotationoverlay.h"
+#include "annotationjournal.h"
+#include "annotationhistory.h"
+#include "annotationjson.h"
+#include "filecopy.h"
+#include "pdfwriter.h"
+#include "pdfassembler.h"
+#include "batchrunner.h"   // parsePageRanges / parsePageList
+#include "pdfcompat.h"
+#include "mappedfile.h"
+#include "diskpagecache.h"
+#include "trace.h"
 
 #include <QtPdf/QPdfDocument>
 #include <QtPdfWidgets/QPdfView>
 #include <QtPdf/QPdfPageNavigator>
-#include <QtPdf/QPdfSearchModel>
-#include <QtPdf/QPdfLink>
 #include <QLineEdit>
 
 
@@ -19,6 +37,21 @@
 #include <QFile>
 #include <QMessageBox>
 #include <QPointF>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QDockWidget>
+#include <QListWidget>
+#include <QTabWidget>
+#include <QUndoGroup>
+#include <QUndoStack>
+#include <QMenu>
+#include <QColorDialog>
+#include <QInputDialog>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QtPdf/QPdfSelection>
+#include <QPolygonF>
 
 
 //Header s for search bar - making ir smaller and implementin g shortcuts
@@ -26,33 +59,77 @@
 #include <QToolButton>
 #include <QShortcut>
 #include <QKeyEvent>
+#include <QMouseEvent>
+#include <QStatusBar>
 #include <QHBoxLayout>
 #include <QStyle>
+#include <QSignalBlocker>
+#include <QCloseEvent>
+
+namespace {
+constexpr int kMaxRecentFiles = 30;
+constexpr int kMaxHitsPerFile = 50;
+constexpr int kLibrarySearchDebounceMs = 300;
+constexpr int kMemoryCheckMs = 2000;
+constexpr int kPerfHudMs = 500;
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow),
-    m_doc(new QPdfDocument(this)), m_view(new QPdfView(this)),
+    m_scheduler(std::make_unique<RenderScheduler>()),
     m_pageSpin(nullptr), m_pageLabel(nullptr)
 {
     ui->setupUi(this);
     setupUi();
 
-    m_view->setDocument(m_doc);
-    #if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
-        m_search = new QPdfSearchModel(this);
-        m_search->setDocument(m_doc);
-        m_view->setSearchModel(m_search);
-    #endif
+    // resident-memory ceiling: fixed shares for what we cache, a watchdog for the rest.
+    // The page share is global: tabs evict each other's least recently used pages.
+    m_budget = MemoryBudget::fromSettings();
+    m_scheduler->setMemoryBudget(m_budget.renderCache());
+    m_memoryTimer = new QTimer(this);
+    m_memoryTimer->setInterval(kMemoryCheckMs);
+    connect(m_memoryTimer, &QTimer::timeout, this, &MainWindow::checkMemory);
+    m_memoryTimer->start();
+
+    // word index per file (sidecar keyed by content hash), built in the background
+    m_indexer = new TextIndexer(this);
+    connect(m_indexer, &TextIndexer::indexReady, this, &MainWindow::indexReady);
+    connect(m_indexer, &TextIndexer::indexFailed, this, &MainWindow::indexFailed);
+
+    // rendered pages survive restarts, keyed by content hash; hashes come in the background
+    m_diskCache = DiskPageCache::fromSettings(this);
+    if (m_diskCache) {
+        connect(m_diskCache, &DiskPageCache::hashReady, this, [this](const QString& fn, const QByteArray& hash) {
+            for (int i = 0; i < m_tabs->count(); ++i) {
+                DocumentTab* tab = tabAt(i);
+                if (tab->currentFile == fn || tab->loadingFile == fn) tab->renderer->setContentHash(hash);
+            }
+        });
+    }
+
+    addDocumentTab();   // becomes current, and m_tab
+    if (m_restoreSessionAction->isChecked()) restoreSession();
 
-    m_view->setZoomMode(QPdfView::ZoomMode::FitToWidth);
-    m_view->setPageMode(QPdfView::PageMode::SinglePage);
+    // PDFEDITOR_TRACE=1 starts with tracing (and the HUD) on, e.g. to catch the first open; 0 doesn't
+    if (qEnvironmentVariableIntValue("PDFEDITOR_TRACE") > 0) m_perfHudAction->setChecked(true);
 
     setWindowTitle("PDFEditor");
     resize(1100, 780);
 }
 
-MainWindow::~MainWindow() { delete ui; }
-
+MainWindow::~MainWindow() {
+    m_editPool.clear();
+    m_editPool.waitForDone();
+    // tabs go before the scheduler their renders run on; nothing of theirs may
+    // reach eventFilter() while they do, and m_tab mustn't point at a dead one
+    disconnect(m_tabs, nullptr, this, nullptr);
+    m_findEdit->removeEventFilter(this);
+    for (int i = 0; i < m_tabs->count(); ++i)
+        if (DocumentTab* tab = tabAt(i)) tab->view->viewport()->removeEventFilter(this);
+    m_tab = nullptr;
+    while (m_tabs->count() > 0) delete m_tabs->widget(0);
+    delete ui;
+}
 
 void MainWindow::setupUi() {
     auto *layout = new QVBoxLayout(ui->centralwidget);
@@ -84,6 +161,12 @@ void MainWindow::setupUi() {
     m_findCount = new QLabel("0/0", m_findBar);
     hb->addWidget(m_findCount);
 
+    m_btnAllFiles = new QToolButton(m_findBar);
+    m_btnAllFiles->setText("All files");
+    m_btnAllFiles->setCheckable(true);
+    m_btnAllFiles->setToolTip("Also search every recently opened file");
+    hb->addWidget(m_btnAllFiles);
+
     m_btnClose = new QToolButton(m_findBar);
     m_btnClose->setText("✕");
     hb->addWidget(m_btnClose);
@@ -111,86 +194,590 @@ void MainWindow::setupUi() {
     tb->addAction("Zoom −", this, &MainWindow::zoomOut);
     tb->addAction("Fit Width", this, &MainWindow::fitWidth);
     tb->addAction("Fit Page", this, &MainWindow::fitPage);
+    m_continuousAction = tb->addAction("Continuous");
+    m_continuousAction->setCheckable(true);
+    m_continuousAction->setChecked(QSettings().value("view/continuous", false).toBool());
+    m_continuousAction->setToolTip("Scroll through all pages instead of one page at a time");
+    connect(m_continuousAction, &QAction::toggled, this, &MainWindow::setContinuousScroll);
+    m_restoreSessionAction = tb->addAction("Restore Session");
+    m_restoreSessionAction->setCheckable(true);
+    m_restoreSessionAction->setChecked(QSettings().value("session/restore", false).toBool());
+    m_restoreSessionAction->setToolTip("Reopen the files that were open last time, at the same page");
+    connect(m_restoreSessionAction, &QAction::toggled, this, [](bool on) { QSettings().setValue("session/restore", on); });
+
+    tb->addSeparator();
+    tb->addAction("Highlight", this, &MainWindow::startHighlight);
+    tb->addAction("Underline", this, &MainWindow::startUnderline);
+    tb->addAction("Strike", this, &MainWindow::startStrike);
+    tb->addAction("Export Notes", this, &MainWindow::exportAnnotations);
+
+    auto* pagesMenu = new QMenu(this);
+    pagesMenu->addAction("Merge Files…", this, &MainWindow::mergeDocuments);
+    pagesMenu->addAction("Extract / Reorder…", this, &MainWindow::extractPageList);
+    pagesMenu->addAction("Split…", this, &MainWindow::splitDocument);
+    pagesMenu->addAction("Rotate…", this, &MainWindow::rotatePageRange);
+    pagesMenu->addAction("Delete Pages…", this, &MainWindow::deletePageRange);
+    auto* pagesButton = new QToolButton(this);
+    pagesButton->setText("Pages");
+    pagesButton->setToolTip("Merge, split, extract, reorder, rotate or delete pages into a new file");
+    pagesButton->setMenu(pagesMenu);
+    pagesButton->setPopupMode(QToolButton::InstantPopup);
+    tb->addWidget(pagesButton);
+    m_editPool.setMaxThreadCount(1);
 
-    // Add the find bar and the view to the page layout
+    // markup undo/redo: one stack per tab, the group follows the tab in front
+    m_undoGroup = new QUndoGroup(this);
+    QAction* undo = m_undoGroup->createUndoAction(this, "Undo");
+    undo->setShortcut(QKeySequence::Undo);
+    tb->addAction(undo);
+    QAction* redo = m_undoGroup->createRedoAction(this, "Redo");
+    redo->setShortcut(QKeySequence::Redo);
+    tb->addAction(redo);
+
+    tb->addSeparator();
+    m_perfHudAction = tb->addAction("Perf HUD");
+    m_perfHudAction->setCheckable(true);
+    m_perfHudAction->setToolTip("Record trace spans and show render/cache/memory stats in the status bar");
+    connect(m_perfHudAction, &QAction::toggled, this, &MainWindow::setPerfHudVisible);
+    tb->addAction("Save Trace", this, &MainWindow::saveTrace);
+
+    m_perfHud = new QLabel(this);
+    m_perfHud->setVisible(false);
+    statusBar()->addPermanentWidget(m_perfHud);
+    m_perfHudTimer = new QTimer(this);
+    m_perfHudTimer->setInterval(kPerfHudMs);
+    connect(m_perfHudTimer, &QTimer::timeout, this, &MainWindow::updatePerfHud);
+
+    // Add the find bar and the document tabs to the page layout
+    m_tabs = new QTabWidget(this);
+    m_tabs->setDocumentMode(true);
+    m_tabs->setTabsClosable(true);
+    m_tabs->setMovable(true);
+    connect(m_tabs, &QTabWidget::currentChanged, this, &MainWindow::currentTabChanged);
+    connect(m_tabs, &QTabWidget::tabCloseRequested, this, &MainWindow::closeTab);
     layout->addWidget(m_findBar);
-    layout->addWidget(m_view);
+    layout->addWidget(m_tabs);
+
+    // Results of the "All files" search
+    m_resultsDock = new QDockWidget("Search Results", this);
+    m_resultsList = new QListWidget(m_resultsDock);
+    m_resultsDock->setWidget(m_resultsList);
+    m_resultsDock->setVisible(false);
+    addDockWidget(Qt::RightDockWidgetArea, m_resultsDock);
+    connect(m_resultsList, &QListWidget::itemActivated, this, &MainWindow::openSearchResult);
 
     // Wire find bar actions
     connect(m_btnPrev,  &QToolButton::clicked, this, &MainWindow::findPrev);
     connect(m_btnNext,  &QToolButton::clicked, this, &MainWindow::findNext);
     connect(m_btnClose, &QToolButton::clicked, this, &MainWindow::hideFindBar);
     connect(m_findEdit, &QLineEdit::textChanged, this, &MainWindow::findTextChanged);
+    m_librarySearchTimer = new QTimer(this);
+    m_librarySearchTimer->setSingleShot(true);
+    m_librarySearchTimer->setInterval(kLibrarySearchDebounceMs);
+    connect(m_librarySearchTimer, &QTimer::timeout, this, [this] { librarySearch(m_findEdit->text()); });
+    connect(m_findEdit, &QLineEdit::textChanged, this, [this] {
+        if (m_btnAllFiles->isChecked()) m_librarySearchTimer->start();
+    });
+    connect(m_btnAllFiles, &QToolButton::toggled, this, [this](bool on) {
+        m_librarySearchTimer->stop();
+        if (on) librarySearch(m_findEdit->text());
+        else m_resultsDock->setVisible(false);
+    });
 
     // Global shortcuts
     m_scFind = new QShortcut(QKeySequence::Find, this);        // Ctrl+F
     m_scNext = new QShortcut(QKeySequence::FindNext, this);    // F3
     m_scPrev = new QShortcut(QKeySequence::FindPrevious, this);// Shift+F3
     m_scEsc  = new QShortcut(QKeySequence(Qt::Key_Escape), this);
+    m_scCloseTab = new QShortcut(QKeySequence::Close, this);  // Ctrl+W
 
     connect(m_scFind, &QShortcut::activated, this, &MainWindow::showFindBar);
     connect(m_scNext, &QShortcut::activated, this, &MainWindow::findNext);
     connect(m_scPrev, &QShortcut::activated, this, &MainWindow::findPrev);
     connect(m_scEsc,  &QShortcut::activated, this, &MainWindow::hideFindBar);
+    connect(m_scEsc,  &QShortcut::activated, this, &MainWindow::cancelAnnotate);
+    connect(m_scCloseTab, &QShortcut::activated, this, [this] { closeTab(m_tabs->currentIndex()); });
 }
 
 
 void MainWindow::openPdf() {
     const QString fn = QFileDialog::getOpenFileName(this, "Open PDF", {}, "PDF Files (*.pdf)");
     if (fn.isEmpty()) return;
+    openInTab(fn);
+}
 
-    auto err = m_doc->load(fn);
-    // In newer Qt, compare to QPdfDocument::Error::None; in older, QPdfDocument::NoError.
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
-    if (err != QPdfDocument::Error::None) {
-#else
-    if (err != QPdfDocument::NoError) {
-#endif
-        QMessageBox::warning(this, "Open PDF", "Failed to open PDF.");
+// --- tabs ---
+
+DocumentTab* MainWindow::addDocumentTab() {
+    auto *tab = new DocumentTab(m_scheduler.get(), m_budget.maxSearchHits(), m_continuousAction->isChecked(), m_tabs);
+    connect(tab->doc, &QPdfDocument::statusChanged, this,
+            [this, tab](QPdfDocument::Status status) { documentStatusChanged(tab, status); });
+    connect(tab->renderer, &PageRenderService::pageReady, this,
+            [this, tab](const RenderKey& key) { renderedPage(tab, key.page); });
+    // in continuous mode the current page follows scrolling; keep the spin box in step
+    connect(tab->view->pageNavigator(), &QPdfPageNavigator::currentPageChanged, this, [this, tab](int page) {
+        if (tab != m_tab) return;
+        const QSignalBlocker block(m_pageSpin);   // not a jump request
+        m_pageSpin->setValue(page + 1);
+    });
+    // search runs on a worker thread; hits are drawn by the view as they arrive
+    connect(tab->searchEngine, &SearchEngine::hitsAdded, this, [this, tab](int first, int count) {
+        if (tab == m_tab) searchHitsAdded(first, count);
+    });
+    connect(tab->searchEngine, &SearchEngine::finished, this, [this, tab] {
+        if (tab == m_tab) updateFindCount();
+    });
+    // markups are painted by the tab's overlay; drags/right-clicks come through eventFilter()
+    tab->view->viewport()->installEventFilter(this);
+    m_undoGroup->addStack(tab->history->stack());
+    tab->renderer->setDiskCache(m_diskCache);
+
+    m_tabs->setCurrentIndex(m_tabs->addTab(tab, "No document"));
+    return tab;
+}
+
+DocumentTab* MainWindow::tabAt(int index) const {
+    return qobject_cast<DocumentTab*>(m_tabs->widget(index));
+}
+
+DocumentTab* MainWindow::tabFor(const QString& fn) const {
+    const QString path = QFileInfo(fn).absoluteFilePath();
+    for (int i = 0; i < m_tabs->count(); ++i) {
+        DocumentTab* tab = tabAt(i);
+        if (tab->currentFile == path || tab->loadingFile == path) return tab;
+    }
+    return nullptr;
+}
+
+void MainWindow::openInTab(const QString& fn) {
+    if (DocumentTab* open = tabFor(fn)) {
+        m_tabs->setCurrentWidget(open);
         return;
     }
-    m_currentFile = fn;
+    if (!m_tab->isEmpty()) addDocumentTab();
+    loadPdf(fn);
+}
 
-    if (auto nav = m_view->pageNavigator())
-        nav->jump(0, QPointF(0, 0), 0);   // first page
+// Only the tab in front renders ahead and extracts text; the rest just finish
+// what they had queued, behind it.
+void MainWindow::currentTabChanged(int index) {
+    DocumentTab* tab = tabAt(index);
+    if (!tab || tab == m_tab) return;
+    TRACE_SPAN_ARG("ui", "switchTab", index);
+    if (m_tab) {
+        cancelAnnotate();   // a drag doesn't carry over
+        m_tab->setActive(false);
+    }
+    m_tab = tab;
+    m_tab->setActive(true);
+    m_undoGroup->setActiveStack(m_tab->history->stack());
+    if (m_perfHudAction->isChecked()) m_tab->renderer->resetStats();
 
     updatePageUi();
-    setWindowTitle(QString("PDFEditor — %1").arg(QFileInfo(fn).fileName()));
+    updateTitle();
+    // the find bar's query applies to whichever document is in front
+    if (m_tab->searchEngine->query() != m_findEdit->text()) findTextChanged(m_findEdit->text());
+    else updateFindCount();
+}
+
+// Closing the last tab leaves an empty one, so there's always a view to show.
+void MainWindow::closeTab(int index) {
+    DocumentTab* tab = tabAt(index);
+    if (!tab) return;
+    if (m_tabs->count() == 1) {
+        if (tab->isEmpty()) return;
+        addDocumentTab();
+    }
+    if (tab == m_tab) {
+        cancelAnnotate();
+        m_tabs->setCurrentIndex(index > 0 ? index - 1 : index + 1);
+    }
+    m_tabs->removeTab(m_tabs->indexOf(tab));
+    delete tab;   // waits for its renders, flushes its journal
+}
+
+bool MainWindow::loadPdf(const QString& fn, DocumentTab* into) {
+    TRACE_SPAN("doc", "loadPdf");
+    DocumentTab* tab = into ? into : m_tab;
+    tab->renderer->reset();   // no worker may touch the document while it reloads
+    tab->prefetch->reset();
+    tab->searchEngine->cancel();
+    tab->searchEngine->setIndex(nullptr);
+    tab->geometry->reset();
+    tab->loadTimer.start();
+    tab->loadTraceNs = Trace::isEnabled() ? Trace::nowNs() : -1;
+    tab->firstPageShown = false;
+    tab->loadingFile = QFileInfo(fn).absoluteFilePath();
+    if (m_diskCache) {
+        // an unchanged file we've hashed before reads from the disk cache from the first render on
+        const QByteArray hash = m_diskCache->knownHash(tab->loadingFile);
+        if (!hash.isEmpty()) tab->renderer->setContentHash(hash);
+        else m_diskCache->hashInBackground(tab->loadingFile);
+    }
+    m_tabs->setTabText(m_tabs->indexOf(tab), QFileInfo(fn).fileName());
+    m_tabs->setTabToolTip(m_tabs->indexOf(tab), tab->loadingFile);
+
+    // mapped mode: pdfium reads through a QIODevice over a mapping and only
+    // faults in what it touches; the load may finish asynchronously
+    MappedFileDevice* device = nullptr;
+    if (QSettings().value("open/mapped", true).toBool()) {
+        device = new MappedFileDevice(tab);
+        if (!device->openFile(fn)) {
+            delete device;
+            device = nullptr;
+        }
+    }
+
+    bool ok = true;
+    if (device) {
+        tab->doc->load(device);
+        ok = tab->doc->status() != QPdfDocument::Status::Error;
+    } else {
+        ok = pdfLoadOk(tab->doc->load(fn));
+    }
+    delete tab->device;       // the document has let go of the previous one
+    tab->device = device;
+
+    if (!ok) {
+        // statusChanged(Error) may already have reported it
+        if (!tab->loadingFile.isEmpty()) {
+            documentFailed(tab);
+            QMessageBox::warning(this, "Open PDF", "Failed to open PDF.");
+        }
+        return false;
+    }
+    if (tab->doc->status() == QPdfDocument::Status::Ready) documentLoaded(tab);
+    return true;
+}
+
+// Second half of loadPdf(), once the document is Ready. The user may have
+// switched to another tab meanwhile.
+void MainWindow::documentLoaded(DocumentTab* tab) {
+    if (tab->loadingFile.isEmpty()) return;
+    TRACE_SPAN("doc", "documentLoaded");
+    tab->currentFile = tab->loadingFile;
+    tab->loadingFile.clear();
+
+    if (auto nav = tab->view->pageNavigator()) {
+        nav->jump(tab->pendingJumpPage, tab->pendingJumpPt, 0);   // first page unless a search result asked
+        tab->prefetch->pageChanged(tab->pendingJumpPage);          // jump() doesn't signal if the page didn't change
+    }
+    const int firstPage = tab->pendingJumpPage;
+    tab->pendingJumpPage = 0;
+    tab->pendingJumpPt = QPointF();
+
+    if (tab == m_tab) {
+        updatePageUi();
+        updateTitle();
+    }
+    addRecentFile(tab->currentFile);
+
+    // markups: binary journal next to the PDF; an older JSON sidecar is imported once
+    tab->journal->close();
+    tab->history->clear();   // steps of the previous document
+    tab->store.clear();
+    const bool hadJournal = QFileInfo::exists(annotationSidecarPath(tab));
+    if (!tab->journal->open(annotationSidecarPath(tab), &tab->store, tab->doc->pageCount())) {
+        statusBar()->showMessage("Could not open the annotation sidecar; markups won't be saved.", 5000);
+    } else if (!hadJournal && QFileInfo::exists(legacyAnnotationJsonPath(tab))) {
+        loadAnnotationsJson(tab, legacyAnnotationJsonPath(tab));
+        for (MarkupId id : tab->store.ids()) tab->journal->recordAdd(id);
+        tab->journal->flush();
+    }
+    tab->overlay->reload();
+
+    // find bar and word snapping answer from the index once it exists; until
+    // then the engine scans and selection asks pdfium per page (indexing already
+    // extracts every word once, the geometry store doesn't do it a second time)
+    if (auto idx = m_indexer->index(tab->currentFile)) {
+        tab->searchEngine->setIndex(idx);
+        tab->geometry->setIndex(idx);
+    } else {
+        m_indexer->ensureIndexed(tab->currentFile);   // indexReady / indexFailed carry on
+        if (tab->isActive()) tab->geometry->prioritize(firstPage);
+    }
+
+    // re-run (or clear) the current query against the new document; a tab in the
+    // background gets it when it's brought to the front
+    if (tab == m_tab) findTextChanged(m_findEdit ? m_findEdit->text() : QString());
+}
+
+void MainWindow::documentStatusChanged(DocumentTab* tab, QPdfDocument::Status status) {
+    if (tab->loadingFile.isEmpty()) return;
+    if (status == QPdfDocument::Status::Ready) {
+        documentLoaded(tab);
+    } else if (status == QPdfDocument::Status::Error) {
+        documentFailed(tab);
+        QMessageBox::warning(this, "Open PDF", "Failed to open PDF.");
+    }
+}
+
+// The load closed the previous document, so nothing of it may linger: its
+// hits, its markups (and their journal) and its name in the title.
+void MainWindow::documentFailed(DocumentTab* tab) {
+    tab->loadingFile.clear();
+    tab->currentFile.clear();
+    tab->hideStandIn();
+    m_tabs->setTabText(m_tabs->indexOf(tab), "No document");
+    m_tabs->setTabToolTip(m_tabs->indexOf(tab), QString());
+
+    tab->searchIndex = -1;
+    tab->view->setCurrentSearchHit(-1);
+    tab->searchEngine->setQuery(QString());
+
+    tab->journal->close();
+    tab->history->clear();
+    tab->store.clear();
+    tab->overlay->reload();
+
+    if (tab == m_tab) {
+        updateFindCount();
+        updatePageUi();
+        updateTitle();
+    }
+}
+
+void MainWindow::renderedPage(DocumentTab* tab, int page) {
+    if (tab->firstPageShown || !tab->view->pageNavigator() || page != tab->view->pageNavigator()->currentPage()) return;
+    tab->firstPageShown = true;
+    tab->hideStandIn();
+    if (tab->loadTraceNs >= 0 && Trace::isEnabled())   // spans the async part too, so it's recorded by hand
+        Trace::record("doc", "openToFirstPage", tab->loadTraceNs, Trace::nowNs() - tab->loadTraceNs, page);
+    const QString msg = QString("First page in %1 ms · peak RSS %2 MB")
+                            .arg(tab->loadTimer.elapsed())
+                            .arg(peakResidentBytes() >> 20);
+    if (tab == m_tab) statusBar()->showMessage(msg, 5000);
+}
+
+// Over the ceiling: give back what we can without losing the current view.
+// Pages are evicted least recently used first, so the background tabs' go first.
+void MainWindow::checkMemory() {
+    if (currentResidentBytes() <= m_budget.ceiling) return;
+    m_scheduler->trim(m_scheduler->memoryUsed() / 2);
+    for (int i = 0; i < m_tabs->count(); ++i)
+        if (MappedFileDevice* device = tabAt(i)->device) device->releaseResidentPages();
+}
+
+void MainWindow::setPerfHudVisible(bool on) {
+    Trace::setEnabled(on);
+    m_perfHud->setVisible(on);
+    if (on) {
+        m_tab->renderer->resetStats();
+        updatePerfHud();
+        m_perfHudTimer->start();
+    } else {
+        m_perfHudTimer->stop();
+    }
+}
+
+void MainWindow::updatePerfHud() {
+    const PageRenderService::Stats s = m_tab->renderer->stats();
+    const qint64 lookups = s.hits + s.misses;
+    m_perfHud->setText(QString("render %1 ms · cache %2% hits, %3 from disk · RSS %4 MB (pages %5 MB)")
+                           .arg(s.lastLatencyMs < 0 ? QStringLiteral("–") : QString::number(s.lastLatencyMs, 'f', 1))
+                           .arg(lookups ? s.hits * 100 / lookups : 0)
+                           .arg(s.diskHits)
+                           .arg(currentResidentBytes() >> 20)
+                           .arg(m_scheduler->memoryUsed() >> 20));   // all tabs
+}
+
+void MainWindow::saveTrace() {
+    const QString out = QFileDialog::getSaveFileName(this, "Save Trace", "pdfeditor-trace.json",
+                                                     "Chrome Trace (*.json)");
+    if (out.isEmpty()) return;
+    if (!Trace::exportChromeJson(out))
+        QMessageBox::warning(this, "Save Trace", "Could not write " + out);
+    else if (!Trace::isEnabled())
+        statusBar()->showMessage("Tracing is off (Perf HUD); the trace only has what was recorded while it was on.", 5000);
+}
+
+void MainWindow::closeEvent(QCloseEvent* ev) {
+    saveSession();
+    QMainWindow::closeEvent(ev);
+}
+
+// Saved on every close; only read back when "Restore Session" is on.
+void MainWindow::saveSession() const {
+    QSettings s;
+    s.remove("session/tabs");
+    s.beginWriteArray("session/tabs");
+    int saved = 0, current = 0;
+    for (int i = 0; i < m_tabs->count(); ++i) {
+        const DocumentTab* tab = tabAt(i);
+        if (tab->currentFile.isEmpty()) continue;
+        if (tab == m_tab) current = saved;
+        const auto nav = tab->view->pageNavigator();
+        const int page = nav ? nav->currentPage() : 0;
+        s.setArrayIndex(saved++);
+        s.setValue("file", tab->currentFile);
+        s.setValue("page", page);
+        // the render key of that page on screen, to paint it from the disk cache next time
+        s.setValue("zoomMilli", PageRenderService::keyFor(page, tab->view->pageScale(page) * tab->view->devicePixelRatioF()).zoomMilli);
+        s.setValue("hash", tab->renderer->contentHash());
+    }
+    s.endArray();
+    s.setValue("session/current", current);
+}
+
+// Each file opens in its own tab at its page. Where the file is unchanged and
+// the disk cache still has the page, that picture covers the view until pdfium
+// has loaded the document and rendered it.
+void MainWindow::restoreSession() {
+    TRACE_SPAN("doc", "restoreSession");
+    QSettings s;
+    const int n = s.beginReadArray("session/tabs");
+    QVector<DocumentTab*> opened(n, nullptr);   // by saved index; missing files leave a hole
+    for (int i = 0; i < n; ++i) {
+        s.setArrayIndex(i);
+        const QString fn = s.value("file").toString();
+        const int page = s.value("page").toInt();
+        const int zoomMilli = s.value("zoomMilli").toInt();
+        const QByteArray hash = s.value("hash").toByteArray();
+        if (!QFileInfo::exists(fn) || tabFor(fn)) continue;
+
+        if (!m_tab->isEmpty()) addDocumentTab();
+        if (m_diskCache && !hash.isEmpty() && hash == m_diskCache->knownHash(fn)) {
+            const QImage img = m_diskCache->load(hash, PageRenderService::keyFor(page, zoomMilli / 1000.0));
+            if (!img.isNull()) m_tab->showStandIn(img);
+        }
+        m_tab->pendingJumpPage = page;
+        if (loadPdf(fn)) opened[i] = m_tab;
+        else m_tab->pendingJumpPage = 0;
+    }
+    s.endArray();
+    if (DocumentTab* current = opened.value(s.value("session/current", 0).toInt())) m_tabs->setCurrentWidget(current);
+}
+
+QStringList MainWindow::recentFiles() const {
+    return QSettings().value("recentFiles").toStringList();
+}
+
+void MainWindow::addRecentFile(const QString& fn) {
+    QStringList files = recentFiles();
+    files.removeAll(fn);
+    files.prepend(fn);
+    while (files.size() > kMaxRecentFiles) files.removeLast();
+    QSettings().setValue("recentFiles", files);
+}
+
+void MainWindow::indexReady(const QString& fn) {
+    if (DocumentTab* tab = tabFor(fn); tab && tab->currentFile == QFileInfo(fn).absoluteFilePath()) {
+        tab->searchEngine->setIndex(m_indexer->index(fn));
+        tab->geometry->setIndex(m_indexer->index(fn));   // a running query keeps its hits: they'd be the same
+    }
+    // several files often finish together; one pass over all of them afterwards
+    if (m_btnAllFiles && m_btnAllFiles->isChecked() && m_librarySearchTimer)
+        m_librarySearchTimer->start();
+}
+
+// No index for an open document: its tab extracts the word boxes itself.
+void MainWindow::indexFailed(const QString& fn) {
+    if (DocumentTab* tab = tabFor(fn); tab && tab->currentFile == QFileInfo(fn).absoluteFilePath()) {
+        auto nav = tab->view->pageNavigator();
+        tab->extractGeometry(nav ? nav->currentPage() : 0);
+    }
+}
+
+// "All files" mode: query the index of every recent file and list the hits
+void MainWindow::librarySearch(const QString& s) {
+    if (!m_btnAllFiles || !m_btnAllFiles->isChecked()) return;
+    m_resultsList->clear();
+    m_resultsDock->setVisible(true);
+
+    int pending = 0;
+    for (const QString& fn : recentFiles()) {
+        const auto idx = m_indexer->index(fn);
+        if (!idx) {
+            // one that failed isn't retried (a re-hash and re-extraction) until it changes
+            if (QFileInfo::exists(fn) && !m_indexer->hasFailed(fn)) { m_indexer->ensureIndexed(fn); ++pending; }
+            continue;
+        }
+        if (s.trimmed().isEmpty()) continue;
+        for (const SearchHit& hit : idx->find(s, kMaxHitsPerFile)) {
+            auto *item = new QListWidgetItem(
+                QString("%1 — p. %2").arg(QFileInfo(fn).fileName()).arg(hit.page + 1), m_resultsList);
+            item->setData(Qt::UserRole, fn);
+            item->setData(Qt::UserRole + 1, hit.page);
+            item->setData(Qt::UserRole + 2, hit.location);
+        }
+    }
+    m_resultsDock->setWindowTitle(pending ? QString("Search Results (indexing %1 file(s)…)").arg(pending)
+                                          : QString("Search Results"));
+}
+
+void MainWindow::openSearchResult(QListWidgetItem* item) {
+    const QString fn = item->data(Qt::UserRole).toString();
+    const int page = item->data(Qt::UserRole + 1).toInt();
+    const QPointF at = item->data(Qt::UserRole + 2).toPointF();
+    DocumentTab* tab = tabFor(fn);
+    if (tab) m_tabs->setCurrentWidget(tab);
+    if (!tab || !tab->loadingFile.isEmpty()) {
+        if (!tab && !m_tab->isEmpty()) addDocumentTab();
+        m_tab->pendingJumpPage = page;   // applied once the document is ready
+        m_tab->pendingJumpPt = at;
+        if (!tab && !loadPdf(fn)) m_tab->pendingJumpPage = 0;
+        return;
+    }
+    if (auto nav = m_tab->view->pageNavigator())
+        nav->jump(page, at, 0);
 }
 
 void MainWindow::saveCopyAs() {
-    if (m_currentFile.isEmpty()) {
+    if (m_tab->currentFile.isEmpty()) {
         QMessageBox::information(this, "Save Copy", "Open a PDF first.");
         return;
     }
     const QString out = QFileDialog::getSaveFileName(this, "Save Copy As", {}, "PDF Files (*.pdf)");
     if (out.isEmpty()) return;
-    if (!QFile::copy(m_currentFile, out)) {
-        QMessageBox::warning(this, "Save Copy", "Failed to save copy.");
+
+    // reflink/kernel copy of the original, then the markups go on the end as an
+    // incremental update: the original bytes are never read or rewritten
+    QElapsedTimer timer;
+    timer.start();
+    QString err;
+    if (!copyFileFast(m_tab->currentFile, out, &err)) {
+        QMessageBox::warning(this, "Save Copy", "Failed to save copy.\n" + err);
+        return;
+    }
+    if (!m_tab->store.isEmpty() && !appendMarkupAnnotations(out, m_tab->store, &err)) {
+        QMessageBox::warning(this, "Save Copy",
+                             "The copy was saved, but the markups could not be written into it.\n" + err);
+        return;
     }
+    statusBar()->showMessage(QString("Saved copy in %1 ms").arg(timer.elapsed()), 4000);
 }
 
+// Shows where the tab in front is; not a jump request.
 void MainWindow::updatePageUi() {
-    const int pages = m_doc->pageCount();
+    const int pages = m_tab->doc->pageCount();
+    auto nav = m_tab->view->pageNavigator();
+    const QSignalBlocker block(m_pageSpin);
     m_pageSpin->setEnabled(pages > 0);
     m_pageSpin->setMaximum(pages > 0 ? pages : 1);
-    m_pageSpin->setValue(pages > 0 ? 1 : 1);
+    m_pageSpin->setValue(pages > 0 && nav ? nav->currentPage() + 1 : 1);
     m_pageLabel->setText(QString("/ %1").arg(pages));
 }
 
+void MainWindow::updateTitle() {
+    setWindowTitle(m_tab->currentFile.isEmpty() ? QString("PDFEditor")
+                                                : QString("PDFEditor — %1").arg(QFileInfo(m_tab->currentFile).fileName()));
+}
+
 void MainWindow::nextPage() {
-    if (!m_doc->pageCount()) return;
-    auto nav = m_view->pageNavigator();
+    TRACE_SPAN("nav", "nextPage");
+    if (!m_tab->doc->pageCount()) return;
+    auto nav = m_tab->view->pageNavigator();
     int p = nav->currentPage();
-    if (p + 1 < m_doc->pageCount()) {
+    if (p + 1 < m_tab->doc->pageCount()) {
         nav->jump(p + 1, QPointF(0,0), 0);
         m_pageSpin->setValue(p + 2);
     }
 }
 
 void MainWindow::prevPage() {
-    if (!m_doc->pageCount()) return;
-    auto nav = m_view->pageNavigator();
+    TRACE_SPAN("nav", "prevPage");
+    if (!m_tab->doc->pageCount()) return;
+    auto nav = m_tab->view->pageNavigator();
     int p = nav->currentPage();
     if (p > 0) {
         nav->jump(p - 1, QPointF(0,0), 0);
@@ -199,126 +786,111 @@ void MainWindow::prevPage() {
 }
 
 void MainWindow::pageSpinChanged(int oneBased) {
-    if (!m_doc->pageCount()) return;
-    auto nav = m_view->pageNavigator();
-    int clamped = qBound(0, oneBased - 1, m_doc->pageCount() - 1);
+    TRACE_SPAN_ARG("nav", "jumpToPage", oneBased - 1);
+    if (!m_tab->doc->pageCount()) return;
+    auto nav = m_tab->view->pageNavigator();
+    int clamped = qBound(0, oneBased - 1, m_tab->doc->pageCount() - 1);
     nav->jump(clamped, QPointF(0,0), 0);
 }
 
 void MainWindow::zoomIn() {
-    m_view->setZoomMode(QPdfView::ZoomMode::Custom);
-    m_view->setZoomFactor(m_view->zoomFactor() * 1.2);
+    TRACE_SPAN("zoom", "zoomIn");
+    m_tab->view->setZoomMode(QPdfView::ZoomMode::Custom);
+    m_tab->view->setZoomFactor(m_tab->view->zoomFactor() * 1.2);
 }
 
 void MainWindow::zoomOut() {
-    m_view->setZoomMode(QPdfView::ZoomMode::Custom);
-    m_view->setZoomFactor(m_view->zoomFactor() / 1.2);
+    TRACE_SPAN("zoom", "zoomOut");
+    m_tab->view->setZoomMode(QPdfView::ZoomMode::Custom);
+    m_tab->view->setZoomFactor(m_tab->view->zoomFactor() / 1.2);
 }
 
-void MainWindow::fitWidth() { m_view->setZoomMode(QPdfView::ZoomMode::FitToWidth); }
-void MainWindow::fitPage()  { m_view->setZoomMode(QPdfView::ZoomMode::FitInView); }
+void MainWindow::fitWidth() {
+    TRACE_SPAN("zoom", "fitWidth");
+    m_tab->view->setZoomMode(QPdfView::ZoomMode::FitToWidth);
+}
 
-void MainWindow::findTextChanged(const QString& s) {
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
-    if (!m_search) return;
-    m_search->setSearchString(s);
-
-#   if (QT_VERSION >= QT_VERSION_CHECK(6, 8, 0))
-    int n = m_search->count();
-#   else
-    int n = m_search->rowCount({});
-#   endif
-
-    // Empty query or no hits → clear highlights and show 0/0
-    if (s.trimmed().isEmpty() || n == 0) {
-        m_searchIndex = -1;
-        m_view->setCurrentSearchResultIndex(-1);
-        if (m_findCount) m_findCount->setText("0/0");
-        return;
+void MainWindow::fitPage() {
+    TRACE_SPAN("zoom", "fitPage");
+    m_tab->view->setZoomMode(QPdfView::ZoomMode::FitInView);
+}
+
+// Only the pages near the viewport are rendered either way (see PdfPageView).
+void MainWindow::setContinuousScroll(bool on) {
+    QSettings().setValue("view/continuous", on);
+    for (int i = 0; i < m_tabs->count(); ++i) {
+        DocumentTab* tab = tabAt(i);
+        auto nav = tab->view->pageNavigator();
+        const int page = nav ? nav->currentPage() : 0;
+        tab->view->setPageMode(on ? QPdfView::PageMode::MultiPage : QPdfView::PageMode::SinglePage);
+        if (nav && tab->doc->pageCount()) nav->jump(page, QPointF(0, 0), 0);   // stay on the same page
     }
+}
 
-    // Go to first hit
-    m_searchIndex = 0;
-    m_view->setCurrentSearchResultIndex(m_searchIndex);
-    if (m_findCount) m_findCount->setText(QString("%1/%2").arg(m_searchIndex + 1).arg(n));
+void MainWindow::findTextChanged(const QString& s) {
+    // debounced; the previous query is cancelled and hits stream in through searchHitsAdded()
+    TRACE_SPAN("search", "findTextChanged");
+    m_tab->searchIndex = -1;
+    m_tab->view->setCurrentSearchHit(-1);
+    m_tab->searchEngine->setQuery(s);
+    updateFindCount();
+}
 
-    const QPdfLink link = m_search->resultAtIndex(m_searchIndex);
-    if (auto nav = m_view->pageNavigator())
-        nav->jump(link.page(), link.location(), 0);
-#else
-    Q_UNUSED(s);
-#endif
+void MainWindow::searchHitsAdded(int first, int count) {
+    Q_UNUSED(count);
+    // Go to first hit as soon as there is one
+    if (first == 0 && m_tab->searchIndex < 0) goToSearchHit(0);
+    else updateFindCount();
 }
 
 void MainWindow::findNext() {
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
-    if (!m_search) return;
-#   if (QT_VERSION >= QT_VERSION_CHECK(6, 8, 0))
-    const int n = m_search->count();
-#   else
-    const int n = m_search->rowCount({});
-#   endif
-    if (n <= 0) { if (m_findCount) m_findCount->setText("0/0"); return; }
-
-    if (m_searchIndex < 0) m_searchIndex = 0;
-    else m_searchIndex = (m_searchIndex + 1) % n;
-
-    m_view->setCurrentSearchResultIndex(m_searchIndex);
-    if (m_findCount) m_findCount->setText(QString("%1/%2").arg(m_searchIndex + 1).arg(n));
-
-    const QPdfLink link = m_search->resultAtIndex(m_searchIndex);
-    if (auto nav = m_view->pageNavigator())
-        nav->jump(link.page(), link.location(), 0);
-#endif
+    TRACE_SPAN("search", "findNext");
+    const int n = m_tab->searchEngine->count();
+    if (n <= 0) { updateFindCount(); return; }
+    goToSearchHit(m_tab->searchIndex < 0 ? 0 : (m_tab->searchIndex + 1) % n);
 }
 
 void MainWindow::findPrev() {
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
-    if (!m_search) return;
-#   if (QT_VERSION >= QT_VERSION_CHECK(6, 8, 0))
-    const int n = m_search->count();
-#   else
-    const int n = m_search->rowCount({});
-#   endif
-    if (n <= 0) { if (m_findCount) m_findCount->setText("0/0"); return; }
+    TRACE_SPAN("search", "findPrev");
+    const int n = m_tab->searchEngine->count();
+    if (n <= 0) { updateFindCount(); return; }
+    goToSearchHit(m_tab->searchIndex < 0 ? 0 : (m_tab->searchIndex - 1 + n) % n);
+}
 
-    if (m_searchIndex < 0) m_searchIndex = 0;
-    else m_searchIndex = (m_searchIndex - 1 + n) % n;
+void MainWindow::goToSearchHit(int index) {
+    TRACE_SPAN_ARG("nav", "goToSearchHit", index);
+    m_tab->searchIndex = index;
+    m_tab->view->setCurrentSearchHit(index);
+    updateFindCount();
 
-    m_view->setCurrentSearchResultIndex(m_searchIndex);
-    if (m_findCount) m_findCount->setText(QString("%1/%2").arg(m_searchIndex + 1).arg(n));
+    const SearchHit &hit = m_tab->searchEngine->hits().at(index);
+    if (auto nav = m_tab->view->pageNavigator())
+        nav->jump(hit.page, hit.location, 0);
+}
 
-    const QPdfLink link = m_search->resultAtIndex(m_searchIndex);
-    if (auto nav = m_view->pageNavigator())
-        nav->jump(link.page(), link.location(), 0);
-#endif
+// "3/17…" while the scan is still running, "3/17" once it is complete
+void MainWindow::updateFindCount() {
+    if (!m_findCount) return;
+    const int n = m_tab->searchEngine->count();
+    const QString more = m_tab->searchEngine->isRunning()   ? QStringLiteral("…")
+                       : m_tab->searchEngine->isTruncated() ? QStringLiteral("+")
+                                                       : QString();
+    if (m_tab->searchIndex >= 0 && n > 0)
+        m_findCount->setText(QString("%1/%2%3").arg(m_tab->searchIndex + 1).arg(n).arg(more));
+    else
+        m_findCount->setText(QString("0/%1%2").arg(n).arg(more));
 }
 
 
 //Changes makde so that current / total is visible while searching
 void MainWindow::showFindBar() {
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
     if (!m_findBar) return;
     m_findBar->setVisible(true);
     if (m_findEdit) {
         m_findEdit->setFocus(Qt::ShortcutFocusReason);
         m_findEdit->selectAll();
     }
-#   if (QT_VERSION >= QT_VERSION_CHECK(6, 8, 0))
-    int n = m_search ? m_search->count() : 0;
-#   else
-    int n = m_search ? m_search->rowCount({}) : 0;
-#   endif
-    if (m_findCount) {
-        if (m_searchIndex >= 0 && n > 0)
-            m_findCount->setText(QString("%1/%2").arg(m_searchIndex + 1).arg(n));
-        else
-            m_findCount->setText("0/0");
-    }
-#else
-    QMessageBox::information(this, "Find",
-                             "Upgrade Qt to ≥ 6.6 to enable in-view highlights and navigation.");
-#endif
+    updateFindCount();
 }
 
 
@@ -346,5 +918,295 @@ bool MainWindow::eventFilter(QObject* obj, QEvent* ev) {
             return true;
         }
     }
+
+    // drag-to-annotate and right-click-to-delete on the page view
+    if (m_tab && obj == m_tab->view->viewport()) {
+        switch (ev->type()) {
+        case QEvent::MouseButtonPress: {
+            auto *me = static_cast<QMouseEvent*>(ev);
+            if (me->button() == Qt::RightButton && !m_annotateMode)
+                return editMarkupAt(me->position().toPoint());
+            if (me->button() != Qt::LeftButton || !m_annotateMode) break;
+            if (!m_tab->view->mapViewportToPage(me->position().toPoint(), &m_selPage, &m_selStartPts)) {
+                m_selPage = -1;
+                break;
+            }
+            m_tab->geometry->prioritize(m_selPage);   // usually done long ago
+            m_selEndPts = m_selStartPts;
+            return true;
+        }
+        case QEvent::MouseMove: {
+            if (!m_annotateMode || m_selPage < 0) break;
+            auto *me = static_cast<QMouseEvent*>(ev);
+            const QRect pr = m_tab->view->pageViewportRect(m_selPage);
+            const QPoint clamped(qBound(pr.left(), me->position().toPoint().x(), pr.right()),
+                                 qBound(pr.top(),  me->position().toPoint().y(), pr.bottom()));
+            int page = -1;
+            if (!m_tab->view->mapViewportToPage(clamped, &page, &m_selEndPts) || page != m_selPage) break;
+            m_tab->overlay->setPreview(m_selPage, selectionQuads(m_selPage, m_selStartPts, m_selEndPts),
+                                  m_pendingKind, defaultMarkupColor(m_pendingKind));
+            return true;
+        }
+        case QEvent::MouseButtonRelease: {
+            auto *me = static_cast<QMouseEvent*>(ev);
+            if (me->button() != Qt::LeftButton || !m_annotateMode || m_selPage < 0) break;
+            m_tab->overlay->clearPreview();
+            const QList<QRectF> quads = selectionQuads(m_selPage, m_selStartPts, m_selEndPts);
+            if (!quads.isEmpty()) addMarkupFromSelection(m_pendingKind, m_selPage, quads);
+            m_selPage = -1;
+            return true;
+        }
+        default:
+            break;
+        }
+    }
     return QMainWindow::eventFilter(obj, ev);
 }
+
+// --- annotations ---
+
+void MainWindow::startHighlight() { m_annotateMode = true; m_pendingKind = MarkupKind::Highlight; m_tab->view->viewport()->setCursor(Qt::IBeamCursor); }
+void MainWindow::startUnderline() { m_annotateMode = true; m_pendingKind = MarkupKind::Underline; m_tab->view->viewport()->setCursor(Qt::IBeamCursor); }
+void MainWindow::startStrike()    { m_annotateMode = true; m_pendingKind = MarkupKind::StrikeOut; m_tab->view->viewport()->setCursor(Qt::IBeamCursor); }
+
+void MainWindow::cancelAnnotate() {
+    m_annotateMode = false;
+    m_selPage = -1;
+    m_tab->overlay->clearPreview();
+    m_tab->view->viewport()->unsetCursor();
+}
+
+bool MainWindow::mapViewportToPage(const QPoint& vpPos, int* outPage, QPointF* outPagePt) const {
+    return m_tab->view->mapViewportToPage(vpPos, outPage, outPagePt);
+}
+
+// Text under the drag as page-space rectangles, snapped to words; a drag over a
+// scan (no text) keeps the dragged box.
+QList<QRectF> MainWindow::selectionQuads(int page, const QPointF& fromPts, const QPointF& toPts) const {
+    QList<QRectF> quads;
+    const QRectF dragged = QRectF(fromPts, toPts).normalized();
+    if (dragged.width() < 2 && dragged.height() < 2) return quads;   // a click, not a drag
+
+    if (auto geometry = m_tab->geometry->page(page)) {
+        quads = geometry->selectionQuads(fromPts, toPts);
+    } else {
+        // not extracted yet: ask pdfium (slow on dense pages, hence the store)
+        for (const QPolygonF& poly : m_tab->doc->getSelection(page, fromPts, toPts).bounds())
+            quads << poly.boundingRect();
+    }
+    if (quads.isEmpty()) quads << dragged;
+    return quads;
+}
+
+void MainWindow::addMarkupFromSelection(MarkupKind kind, int page, const QList<QRectF>& quadsPts) {
+    Markup m;
+    m.page = page;
+    m.quadsPts = quadsPts;
+    m.kind = kind;
+    m.color = defaultMarkupColor(kind);
+    m_tab->history->add(m);   // stored, journaled and repainted as one undoable step
+}
+
+// Right-click on a markup: delete it, change its kind or pick a colour.
+bool MainWindow::editMarkupAt(const QPoint& vpPos) {
+    int page = -1;
+    QPointF pt;
+    if (!m_tab->view->mapViewportToPage(vpPos, &page, &pt)) return false;
+    const MarkupId id = m_tab->store.hitTest(page, pt);
+    if (id == kNoMarkup) return false;
+
+    const MarkupKind kind = m_tab->store.kind(id);
+    const QColor color = m_tab->store.color(id);
+    QMenu menu(this);
+    QAction* del = menu.addAction("Delete");
+    menu.addSeparator();
+    const std::pair<const char*, MarkupKind> kinds[] = {
+        { "Highlight", MarkupKind::Highlight }, { "Underline", MarkupKind::Underline }, { "Strike", MarkupKind::StrikeOut } };
+    QHash<QAction*, MarkupKind> kindActions;
+    for (const auto& [label, k] : kinds) {
+        QAction* a = menu.addAction(label);
+        a->setCheckable(true);
+        a->setChecked(k == kind);
+        kindActions.insert(a, k);
+    }
+    menu.addSeparator();
+    QAction* recolor = menu.addAction("Color…");
+
+    QAction* chosen = menu.exec(m_tab->view->viewport()->mapToGlobal(vpPos));
+    if (!chosen) return true;
+    if (chosen == del) {
+        m_tab->history->remove(id);
+    } else if (chosen == recolor) {
+        const QColor c = QColorDialog::getColor(color, this, "Markup Color", QColorDialog::ShowAlphaChannel);
+        if (c.isValid()) m_tab->history->restyle(id, kind, c);
+    } else if (kindActions.contains(chosen)) {
+        // a markup still in its kind's default colour takes the new kind's; a picked one stays
+        const MarkupKind k = kindActions.value(chosen);
+        m_tab->history->restyle(id, k, color == defaultMarkupColor(kind) ? defaultMarkupColor(k) : color);
+    }
+    return true;
+}
+
+void MainWindow::exportAnnotations() {
+    if (m_tab->currentFile.isEmpty()) {
+        QMessageBox::information(this, "Export Notes", "Open a PDF first.");
+        return;
+    }
+    const QString out = QFileDialog::getSaveFileName(this, "Export Annotations",
+                                                     QFileInfo(m_tab->currentFile).completeBaseName() + ".json",
+                                                     "JSON Files (*.json)");
+    if (out.isEmpty()) return;
+    saveAnnotationsJson(out);
+}
+
+// --- page edits ---
+
+bool MainWindow::pageEditSource(const QString& what) {
+    if (!m_tab->currentFile.isEmpty()) return true;
+    QMessageBox::information(this, what, "Open a PDF first.");
+    return false;
+}
+
+// The assembler only reads the sources, so edits run on a worker while the
+// tabs stay usable; the new file opens in a tab of its own.
+void MainWindow::runPageEdit(const QString& what, std::function<QStringList(QString*)> op, bool openResult) {
+    statusBar()->showMessage(what + "…");
+    m_editPool.start([this, what, op, openResult] {
+        QElapsedTimer timer;
+        timer.start();
+        QString err;
+        const QStringList written = op(&err);
+        const qint64 ms = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, what, written, err, ms, openResult] {
+            if (written.isEmpty()) {
+                statusBar()->clearMessage();
+                QMessageBox::warning(this, what, what + " failed.\n" + err);
+                return;
+            }
+            statusBar()->showMessage(QString("%1 done in %2 ms").arg(what).arg(ms), 4000);
+            // a tab showing a file that was just replaced still has the old one
+            // mapped (the new one was renamed over it): load the new one there
+            for (const QString& fn : written)
+                if (DocumentTab* tab = tabFor(fn)) loadPdf(fn, tab);
+            if (openResult) openInTab(written.first());
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::mergeDocuments() {
+    QStringList files = QFileDialog::getOpenFileNames(this, "Merge PDFs", {}, "PDF Files (*.pdf)");
+    if (files.isEmpty()) return;
+
+    // the file dialog's order is whatever the platform makes of the selection: show it, drag to change
+    QDialog order(this);
+    order.setWindowTitle("Merge in This Order");
+    auto* list = new QListWidget(&order);
+    list->setDragDropMode(QAbstractItemView::InternalMove);
+    for (const QString& fn : std::as_const(files)) {
+        auto* item = new QListWidgetItem(QFileInfo(fn).fileName(), list);
+        item->setData(Qt::UserRole, fn);
+        item->setToolTip(fn);
+    }
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &order);
+    connect(buttons, &QDialogButtonBox::accepted, &order, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &order, &QDialog::reject);
+    auto* box = new QVBoxLayout(&order);
+    box->addWidget(new QLabel("Drag files to change the order:", &order));
+    box->addWidget(list);
+    box->addWidget(buttons);
+    if (order.exec() != QDialog::Accepted) return;
+    files.clear();
+    for (int i = 0; i < list->count(); ++i) files << list->item(i)->data(Qt::UserRole).toString();
+
+    const QString out = QFileDialog::getSaveFileName(this, "Save Merged PDF", {}, "PDF Files (*.pdf)");
+    if (out.isEmpty()) return;
+    runPageEdit("Merge", [files, out](QString* err) { return mergePdfs(files, out, err) ? QStringList{ out } : QStringList(); });
+}
+
+void MainWindow::extractPageList() {
+    if (!pageEditSource("Extract Pages")) return;
+    const int pages = m_tab->doc->pageCount();
+    bool ok = false;
+    const QString spec = QInputDialog::getText(this, "Extract / Reorder",
+        QString("Pages in the order wanted, e.g. 3,1-2 or %1-1:").arg(pages), QLineEdit::Normal,
+        QString::number(m_pageSpin->value()), &ok);
+    const QVector<int> list = parsePageList(spec, pages);
+    if (!ok || list.isEmpty()) return;
+    const QString out = QFileDialog::getSaveFileName(this, "Save Pages As",
+                                                     QFileInfo(m_tab->currentFile).completeBaseName() + "-pages.pdf",
+                                                     "PDF Files (*.pdf)");
+    if (out.isEmpty()) return;
+    const QString in = m_tab->currentFile;
+    runPageEdit("Extract", [in, list, out](QString* err) {
+        return extractPages(in, list, out, err) ? QStringList{ out } : QStringList();
+    });
+}
+
+void MainWindow::splitDocument() {
+    if (!pageEditSource("Split")) return;
+    bool ok = false;
+    const int per = QInputDialog::getInt(this, "Split", "Pages per part:", 1, 1, qMax(1, m_tab->doc->pageCount()), 1, &ok);
+    if (!ok) return;
+    const QString dir = QFileDialog::getExistingDirectory(this, "Write Parts To", QFileInfo(m_tab->currentFile).absolutePath());
+    if (dir.isEmpty()) return;
+    const QString in = m_tab->currentFile;
+    runPageEdit("Split", [in, per, dir](QString* err) { return splitPdf(in, per, dir, err); }, false);
+}
+
+void MainWindow::rotatePageRange() {
+    if (!pageEditSource("Rotate")) return;
+    bool ok = false;
+    const QString spec = QInputDialog::getText(this, "Rotate", "Pages (empty: all), e.g. 1-3,7:", QLineEdit::Normal,
+                                               QString::number(m_pageSpin->value()), &ok);
+    if (!ok) return;
+    const QStringList turns{ "90° clockwise", "180°", "90° counter-clockwise" };
+    const QString turn = QInputDialog::getItem(this, "Rotate", "Turn by:", turns, 0, false, &ok);
+    if (!ok) return;
+    const int degrees = (turns.indexOf(turn) + 1) * 90;
+    const QVector<int> list = spec.trimmed().isEmpty() ? QVector<int>() : parsePageRanges(spec, m_tab->doc->pageCount());
+    if (!spec.trimmed().isEmpty() && list.isEmpty()) return;
+    const QString out = QFileDialog::getSaveFileName(this, "Save Rotated PDF",
+                                                     QFileInfo(m_tab->currentFile).completeBaseName() + "-rotated.pdf",
+                                                     "PDF Files (*.pdf)");
+    if (out.isEmpty()) return;
+    const QString in = m_tab->currentFile;
+    runPageEdit("Rotate", [in, list, degrees, out](QString* err) {
+        return rotatePages(in, list, degrees, out, err) ? QStringList{ out } : QStringList();
+    });
+}
+
+void MainWindow::deletePageRange() {
+    if (!pageEditSource("Delete Pages")) return;
+    bool ok = false;
+    const QString spec = QInputDialog::getText(this, "Delete Pages", "Pages to delete, e.g. 2,5-7:", QLineEdit::Normal,
+                                               QString::number(m_pageSpin->value()), &ok);
+    if (!ok || spec.trimmed().isEmpty()) return;
+    const QVector<int> list = parsePageRanges(spec, m_tab->doc->pageCount());
+    if (list.isEmpty()) return;
+    const QString out = QFileDialog::getSaveFileName(this, "Save Without Those Pages",
+                                                     QFileInfo(m_tab->currentFile).completeBaseName() + "-trimmed.pdf",
+                                                     "PDF Files (*.pdf)");
+    if (out.isEmpty()) return;
+    const QString in = m_tab->currentFile;
+    runPageEdit("Delete pages", [in, list, out](QString* err) {
+        return deletePages(in, list, out, err) ? QStringList{ out } : QStringList();
+    });
+}
+
+// --- sidecar I/O ---
+
+QString MainWindow::annotationSidecarPath(const DocumentTab* tab) {
+    return tab->currentFile.isEmpty() ? QString() : AnnotationJournal::sidecarPathFor(tab->currentFile);
+}
+
+QString MainWindow::legacyAnnotationJsonPath(const DocumentTab* tab) {
+    return tab->currentFile.isEmpty() ? QString() : tab->currentFile + ".annotations.json";
+}
+
+void MainWindow::saveAnnotationsJson(const QString& jsonPath) const {
+    writeMarkupsJson(m_tab->store, jsonPath, QFileInfo(m_tab->currentFile).fileName());
+}
+
+bool MainWindow::loadAnnotationsJson(DocumentTab* tab, const QString& jsonPath) {
+    return readMarkupsJson(&tab->store, jsonPath, tab->doc->pageCount());
+}
@@ -3,29 +3,37 @@
 #include <QVector>
 #include <QRectF>
 #include <QColor>
+#include <QThreadPool>
+
+#include <QtPdf/QPdfDocument>
+#include <functional>
+#include <memory>
+
+#include "annotationstore.h"
+#include "memorybudget.h"
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
-enum class MarkupKind { Highlight, Underline, StrikeOut };
 class QWidget;
 class QEvent;
-class QPdfDocument;
-class QPdfView;
+class RenderScheduler;
+class DocumentTab;
+class QTabWidget;
 class QSpinBox;
 class QLabel;
-class QPdfSearchModel;
+class TextIndexer;
+class QDockWidget;
+class QListWidget;
+class QListWidgetItem;
 class QLineEdit;
 class QToolButton;
 class QShortcut;
 
-struct Markup {
-    int page = 0;
-    QVector<QRectF> quadsPts;   // rectangles in PAGE POINTS
-    MarkupKind kind = MarkupKind::Highlight;
-    QColor color = QColor(255, 235, 0, 96); // translucent yellow by default
-};
-class AnnotationOverlay;
+class QTimer;
+class QAction;
+class QUndoGroup;
+class DiskPageCache;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -43,6 +51,7 @@ private slots:
     void zoomOut();
     void fitWidth();
     void fitPage();
+    void setContinuousScroll(bool on);
 
     //search slots
     void findTextChanged(const QString& s);
@@ -50,6 +59,22 @@ private slots:
     void findPrev();
     void showFindBar();
     void hideFindBar();
+    void searchHitsAdded(int first, int count);
+    void librarySearch(const QString& s);
+    void openSearchResult(QListWidgetItem* item);
+    void indexReady(const QString& fn);
+    void indexFailed(const QString& fn);
+
+    // tabs
+    void currentTabChanged(int index);
+    void closeTab(int index);
+
+    void checkMemory();
+
+    // tracing / performance HUD
+    void setPerfHudVisible(bool on);
+    void updatePerfHud();
+    void saveTrace();
 
     //Anotation slots
     void startHighlight();
@@ -58,38 +83,82 @@ private slots:
     void cancelAnnotate();
     void exportAnnotations();
 
+    // page edits (new files, see pdfassembler.h)
+    void mergeDocuments();
+    void extractPageList();
+    void splitDocument();
+    void rotatePageRange();
+    void deletePageRange();
+
 
 protected:
     bool eventFilter(QObject* obj, QEvent* ev) override; // for Enter / Shift+Enter in the find box
+    void closeEvent(QCloseEvent* ev) override;          // saves the session
 
 private:
     void setupUi();
+    DocumentTab* addDocumentTab();
+    DocumentTab* tabFor(const QString& fn) const;   // already open (or opening) in a tab
+    DocumentTab* tabAt(int index) const;
+    void openInTab(const QString& fn);             // that tab, or a new one unless the current is empty
+    bool loadPdf(const QString& fn, DocumentTab* into = nullptr);   // into the current tab unless into
+    void documentStatusChanged(DocumentTab* tab, QPdfDocument::Status status);
+    void documentLoaded(DocumentTab* tab);
+    void documentFailed(DocumentTab* tab);
+    void renderedPage(DocumentTab* tab, int page);
+    QStringList recentFiles() const;
+    void addRecentFile(const QString& fn);
     void updatePageUi();
+    void updateTitle();
+    // open files, their page and first-screen render, for reopening them next launch
+    void saveSession() const;
+    void restoreSession();
+    // Runs op (returns the files it wrote, none on failure) on the edit pool and
+    // reports in the status bar. Tabs showing a written file reload it; with
+    // openResult the first one opens (or comes to the front).
+    void runPageEdit(const QString& what, std::function<QStringList(QString*)> op, bool openResult = true);
+    bool pageEditSource(const QString& what);   // a document is open, or says so
+    void goToSearchHit(int index);
+    void updateFindCount();
 
     Ui::MainWindow *ui;
-    QPdfDocument   *m_doc;
-    QPdfView       *m_view;
-    QString         m_currentFile;
+    // every tab renders through this: one pool, one page cache under the budget
+    std::unique_ptr<RenderScheduler> m_scheduler;
+    QTabWidget     *m_tabs = nullptr;
+    DiskPageCache  *m_diskCache = nullptr;  // rendered pages across runs; null if disabled
+    DocumentTab    *m_tab = nullptr;        // the one in front; there's always one, maybe empty
+
+    // memory ceiling, shared by all tabs
+    MemoryBudget    m_budget;
+    QTimer*         m_memoryTimer = nullptr;
+
+    // status-bar HUD: render latency, cache hit rate, memory
+    QLabel*         m_perfHud = nullptr;
+    QTimer*         m_perfHudTimer = nullptr;
+    QAction*        m_perfHudAction = nullptr;
+    QAction*        m_continuousAction = nullptr;
+    QAction*        m_restoreSessionAction = nullptr;
+    QUndoGroup*     m_undoGroup = nullptr;      // undo/redo of the tab in front
+    QThreadPool     m_editPool;                 // page edits, one at a time
 
     QSpinBox *m_pageSpin;
     QLabel   *m_pageLabel;
 
     //Search Box ka Implementation
-    QPdfSearchModel* m_search = nullptr;
+    TextIndexer*     m_indexer = nullptr;
+    QToolButton*     m_btnAllFiles = nullptr;
+    QDockWidget*     m_resultsDock = nullptr;
+    QListWidget*     m_resultsList = nullptr;
+    QTimer*          m_librarySearchTimer = nullptr;   // debounces librarySearch() while typing
     QWidget*         m_findBar = nullptr;
     QLineEdit*       m_findEdit = nullptr;
     QLabel*          m_findCount = nullptr;
     QToolButton*     m_btnPrev = nullptr;
     QToolButton*     m_btnNext = nullptr;
     QToolButton*     m_btnClose = nullptr;
-    int              m_searchIndex = -1;
-
 
-    // --- annotations (overlay + model) ---
-    QVector<Markup>     m_marks;
-    AnnotationOverlay*  m_overlay = nullptr;
 
-    // annotate-by-drag state
+    // annotate-by-drag state (markups, their overlay and journal live in the tab)
     bool        m_annotateMode = false;
     MarkupKind  m_pendingKind  = MarkupKind::Highlight;
     int         m_selPage      = -1;
@@ -102,13 +171,19 @@ private:
     QShortcut* m_scNext = nullptr;
     QShortcut* m_scPrev = nullptr;
     QShortcut* m_scEsc  = nullptr;
+    QShortcut* m_scCloseTab = nullptr;
 
     //For annotations w
     bool mapViewportToPage(const QPoint& vpPos, int* outPage, QPointF* outPagePt) const;
     void addMarkupFromSelection(MarkupKind kind, int page, const QList<QRectF>& quadsPts);
+    QList<QRectF> selectionQuads(int page, const QPointF& fromPts, const QPointF& toPts) const;
+    bool editMarkupAt(const QPoint& vpPos);
 
     // sidecar I/O
+    static QString annotationSidecarPath(const DocumentTab* tab);
+    static QString legacyAnnotationJsonPath(const DocumentTab* tab);
+    // JSON stays as the interchange format (Export Notes, import of old sidecars)
     void saveAnnotationsJson(const QString& jsonPath) const;
-    bool loadAnnotationsJson(const QString& jsonPath);
+    static bool loadAnnotationsJson(DocumentTab* tab, const QString& jsonPath);
 
 };
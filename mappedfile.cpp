@@ -0,0 +1,55 @@
+#include "mappedfile.h"
+
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#endif
+
+MappedFileDevice::MappedFileDevice(QObject* parent) : QIODevice(parent) {}
+
+MappedFileDevice::~MappedFileDevice() { close(); }
+
+bool MappedFileDevice::openFile(const QString& path) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+    m_size = m_file.size();
+    m_map = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_map) {
+        setErrorString(m_file.errorString());
+        m_file.close();
+        m_size = 0;
+        return false;
+    }
+#if defined(Q_OS_UNIX)
+    // pdfium jumps around (xref, then whatever objects a page needs): readahead only inflates RSS
+    ::madvise(m_map, size_t(m_size), MADV_RANDOM);
+#endif
+    return QIODevice::open(QIODevice::ReadOnly);
+}
+
+void MappedFileDevice::close() {
+    if (isOpen()) QIODevice::close();
+    if (m_map) m_file.unmap(m_map);
+    m_map = nullptr;
+    m_size = 0;
+    m_file.close();
+}
+
+qint64 MappedFileDevice::readData(char* data, qint64 maxSize) {
+    const qint64 at = pos();
+    if (!m_map || at >= m_size) return at >= m_size ? 0 : -1;
+    const qint64 n = qMin(maxSize, m_size - at);
+    std::memcpy(data, m_map + at, size_t(n));
+    return n;
+}
+
+void MappedFileDevice::releaseResidentPages() {
+#if defined(Q_OS_UNIX)
+    if (m_map) ::madvise(m_map, size_t(m_size), MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <QFile>
+#include <QIODevice>
+
+// Read-only QIODevice over a memory-mapped file, for QPdfDocument::load(QIODevice*).
+// pdfium pulls the bytes it needs through readData(), so only the parts of
+// the file it actually touches get faulted in, and those pages are file-backed
+// (clean, reclaimable) rather than heap. releaseResidentPages() hands them
+// back to the kernel outright when we're over budget.
+class MappedFileDevice : public QIODevice {
+    Q_OBJECT
+public:
+    explicit MappedFileDevice(QObject* parent = nullptr);
+    ~MappedFileDevice() override;
+
+    bool openFile(const QString& path);   // opens ReadOnly
+    void close() override;
+
+    QString fileName() const { return m_file.fileName(); }
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_size; }
+
+    // Drop the mapping's resident pages; they're refaulted from the page cache on access.
+    void releaseResidentPages();
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QFile  m_file;
+    uchar* m_map = nullptr;
+    qint64 m_size = 0;
+};
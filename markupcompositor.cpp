@@ -0,0 +1,232 @@
+#include "markupcompositor.h"
+#include "trace.h"
+
+#include <QByteArray>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define PDFEDITOR_HAVE_SSE2
+#    include <emmintrin.h>
+#  endif
+#  if defined(PDFEDITOR_HAVE_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+#    define PDFEDITOR_HAVE_AVX2
+#    include <immintrin.h>
+#    if defined(_MSC_VER) && !defined(__clang__)
+#      include <intrin.h>
+#    endif
+#  endif
+#endif
+
+#if defined(PDFEDITOR_HAVE_AVX2) && defined(__GNUC__)
+#  define PDFEDITOR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define PDFEDITOR_TARGET_AVX2
+#endif
+
+namespace {
+// dst = src + dst * (255 - alpha(src)) / 255 on every channel of n premultiplied pixels
+using BlendRowFn = void (*)(quint32* dst, int n, quint32 src);
+
+// x * a / 255 for each byte of x, rounded (two channels per multiply)
+inline quint32 byteMul(quint32 x, quint32 a) {
+    quint32 t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+    x = ((x >> 8) & 0xff00ff) * a;
+    x = x + ((x >> 8) & 0xff00ff) + 0x800080;
+    x &= 0xff00ff00;
+    return x | t;
+}
+
+void blendRowScalar(quint32* dst, int n, quint32 src) {
+    const quint32 ia = 255 - qAlpha(src);
+    for (int i = 0; i < n; ++i) dst[i] = src + byteMul(dst[i], ia);
+}
+
+#if defined(PDFEDITOR_HAVE_SSE2)
+// Same rounding as byteMul, on 16-bit lanes: (t + (t >> 8) + 128) >> 8 with t = v * ia.
+inline __m128i mulDiv255(__m128i v, __m128i ia, __m128i half) {
+    const __m128i t = _mm_mullo_epi16(v, ia);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), half), 8);
+}
+
+void blendRowSse2(quint32* dst, int n, quint32 src) {
+    const __m128i s = _mm_set1_epi32(int(src));
+    const __m128i ia = _mm_set1_epi16(short(255 - qAlpha(src)));
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i d = _mm_loadu_si128(p);
+        const __m128i lo = mulDiv255(_mm_unpacklo_epi8(d, zero), ia, half);
+        const __m128i hi = mulDiv255(_mm_unpackhi_epi8(d, zero), ia, half);
+        // premultiplied: src + the scaled dst never exceeds 255, so a plain add is fine
+        _mm_storeu_si128(p, _mm_add_epi8(_mm_packus_epi16(lo, hi), s));
+    }
+    blendRowScalar(dst + i, n - i, src);
+}
+#endif
+
+#if defined(PDFEDITOR_HAVE_AVX2)
+PDFEDITOR_TARGET_AVX2 inline __m256i mulDiv255x2(__m256i v, __m256i ia, __m256i half) {
+    const __m256i t = _mm256_mullo_epi16(v, ia);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), half), 8);
+}
+
+// unpack/pack work within 128-bit lanes, so the two undo each other and pixel order is kept
+PDFEDITOR_TARGET_AVX2 void blendRowAvx2(quint32* dst, int n, quint32 src) {
+    const __m256i s = _mm256_set1_epi32(int(src));
+    const __m256i ia = _mm256_set1_epi16(short(255 - qAlpha(src)));
+    const __m256i half = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i d = _mm256_loadu_si256(p);
+        const __m256i lo = mulDiv255x2(_mm256_unpacklo_epi8(d, zero), ia, half);
+        const __m256i hi = mulDiv255x2(_mm256_unpackhi_epi8(d, zero), ia, half);
+        _mm256_storeu_si256(p, _mm256_add_epi8(_mm256_packus_epi16(lo, hi), s));
+    }
+    blendRowSse2(dst + i, n - i, src);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    const bool osxsave = regs[2] & (1 << 27);
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;   // OS saves the YMM registers
+    __cpuidex(regs, 7, 0);
+    return regs[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct Kernel {
+    BlendRowFn  blend;
+    const char* name;
+};
+
+Kernel pickKernel() {
+    const QByteArray force = qgetenv("PDFEDITOR_SIMD");
+#if defined(PDFEDITOR_HAVE_AVX2)
+    if ((force.isEmpty() || force == "avx2") && cpuHasAvx2()) return { blendRowAvx2, "avx2" };
+#endif
+#if defined(PDFEDITOR_HAVE_SSE2)
+    if (force != "scalar") return { blendRowSse2, "sse2" };
+#endif
+    return { blendRowScalar, "scalar" };
+}
+
+const Kernel& kernel() {
+    static const Kernel k = pickKernel();
+    return k;
+}
+
+// Pixel coverage of a device-space rect, snapped like QPainter's non-antialiased fillRect.
+QRect toPixels(const QRectF& r) {
+    const int x0 = qRound(r.left()), y0 = qRound(r.top());
+    const int x1 = qMax(x0 + 1, qRound(r.right())), y1 = qMax(y0 + 1, qRound(r.bottom()));
+    return QRect(x0, y0, x1 - x0, y1 - y0);
+}
+}
+
+MarkupCompositor::MarkupCompositor(const AnnotationStore* store) : m_store(store) {
+    m_layers.setMaxCost(kDefaultBudget);
+}
+
+const char* MarkupCompositor::kernelName() { return kernel().name; }
+
+QRectF MarkupCompositor::paintedRect(const QRectF& quad, MarkupKind kind) {
+    const qreal t = qMax<qreal>(1.0, quad.height() * 0.08);
+    switch (kind) {
+    case MarkupKind::Underline: return QRectF(quad.left(), quad.bottom() - t, quad.width(), t);
+    case MarkupKind::StrikeOut: return QRectF(quad.left(), quad.center().y() - t / 2, quad.width(), t);
+    case MarkupKind::Highlight: break;
+    }
+    return quad;
+}
+
+const QImage* MarkupCompositor::layer(int page, qreal scale, QPoint* origin) {
+    const quint64 key = cacheKey(page, qMax(1, qRound(scale * 1000)));
+    Layer* l = m_layers.object(key);
+    if (!l) {
+        const QRectF bounds = m_store->pageBounds(page);
+        if (bounds.isNull()) return nullptr;
+        const QRect px = QRectF(bounds.topLeft() * scale, bounds.size() * scale).toAlignedRect().adjusted(-1, -1, 1, 1);
+        if (qint64(px.width()) * px.height() > kMaxLayerPx) return nullptr;
+
+        auto* fresh = new Layer;
+        fresh->image = QImage(px.size(), QImage::Format_ARGB32_Premultiplied);
+        if (fresh->image.isNull()) {
+            delete fresh;
+            return nullptr;
+        }
+        fresh->origin = px.topLeft();
+        fresh->coverPts = QRectF(QPointF(px.topLeft()) / scale, QSizeF(px.size()) / scale);
+        fresh->dirty = QRegion(fresh->image.rect());
+        if (!m_layers.insert(key, fresh, fresh->image.sizeInBytes())) return nullptr;   // deleted by insert
+        l = fresh;
+    }
+
+    if (!l->dirty.isEmpty()) {
+        TRACE_SPAN_ARG("annotations", "compositeLayer", page);
+        for (const QRect& r : l->dirty) rasterize(*l, page, scale, r);
+        l->dirty = QRegion();
+    }
+    if (origin) *origin = l->origin;
+    return &l->image;
+}
+
+void MarkupCompositor::invalidate(int page, const QRectF& rectPts) {
+    const bool pageEmpty = m_store->pageBounds(page).isNull();
+    const QList<quint64> keys = m_layers.keys();
+    for (quint64 key : keys) {
+        if (int(quint32(key >> 32)) != page) continue;
+        Layer* l = m_layers.object(key);
+        // nothing left, or a markup outside what the layer covers: start over next time
+        if (pageEmpty || !l->coverPts.contains(rectPts)) {
+            m_layers.remove(key);
+            continue;
+        }
+        const qreal scale = quint32(key) / 1000.0;
+        const QRect px = QRectF(rectPts.topLeft() * scale, rectPts.size() * scale)
+                             .toAlignedRect().adjusted(-1, -1, 1, 1).translated(-l->origin);
+        l->dirty += px & l->image.rect();
+    }
+}
+
+// Clear area (layer pixels) and blend back every markup that touches it, in id order.
+void MarkupCompositor::rasterize(Layer& layer, int page, qreal scale, const QRect& area) const {
+    QImage& img = layer.image;
+    const QRect a = area & img.rect();
+    if (a.isEmpty()) return;
+
+    uchar* bits = img.bits();
+    const qsizetype bpl = img.bytesPerLine();
+    for (int y = a.top(); y <= a.bottom(); ++y)
+        std::memset(bits + y * bpl + a.left() * 4, 0, size_t(a.width()) * 4);
+
+    const QRectF areaPts(QPointF(a.topLeft() + layer.origin) / scale, QSizeF(a.size()) / scale);
+    const BlendRowFn blend = kernel().blend;
+    for (MarkupId id : m_store->query(page, areaPts)) {
+        const quint32 src = qPremultiply(m_store->color(id).rgba());
+        if (qAlpha(src) == 0) continue;
+        const MarkupKind kind = m_store->kind(id);
+        const AnnotationStore::Quads q = m_store->quads(id);
+        for (int i = 0; i < q.count; ++i) {
+            const QRectF quad(q.x[i] * scale, q.y[i] * scale, q.w[i] * scale, q.h[i] * scale);
+            const QRect px = toPixels(paintedRect(quad, kind)).translated(-layer.origin) & a;
+            if (px.isEmpty()) continue;
+            for (int y = px.top(); y <= px.bottom(); ++y)
+                blend(reinterpret_cast<quint32*>(bits + y * bpl) + px.left(), px.width(), src);
+        }
+    }
+}
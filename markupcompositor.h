@@ -0,0 +1,54 @@
+#pragma once
+#include <QCache>
+#include <QImage>
+#include <QRectF>
+#include <QRegion>
+
+#include "annotationstore.h"
+
+// Rasterizes the markups of a page into one premultiplied ARGB layer, so a
+// repaint of an annotated page is a single blit instead of a fillRect per quad.
+// Layers are cached per page and scale (byte-bounded LRU) and cover only the
+// page's markup bounds. When markups change, only the area they covered is
+// cleared and re-blended (with whatever else overlaps it, in id order).
+//
+// The blend is constant-colour source-over on premultiplied pixels; the row
+// kernel is picked once at startup: AVX2, SSE2 or plain C++.
+// PDFEDITOR_SIMD=scalar|sse2|avx2 forces one (for comparing them).
+class MarkupCompositor {
+public:
+    static constexpr qint64 kDefaultBudget = 64ll << 20;
+    static constexpr qint64 kMaxLayerPx = 8 << 20;   // bigger than this, the caller paints directly
+
+    explicit MarkupCompositor(const AnnotationStore* store);
+
+    void setBudget(qint64 bytes) { m_layers.setMaxCost(qMax<qint64>(bytes, 1)); }
+    qint64 memoryUsed() const { return m_layers.totalCost(); }
+
+    // The page's layer at scale (device pixels per point), brought up to date.
+    // origin is where the layer's top-left sits, in device pixels from the page's
+    // top-left. nullptr if the page has no markups or the layer would be too big.
+    const QImage* layer(int page, qreal scale, QPoint* origin);
+
+    // Markups inside rectPts (page points) were added, removed or changed.
+    void invalidate(int page, const QRectF& rectPts);
+    void clear() { m_layers.clear(); }
+
+    static const char* kernelName();
+    // The part of a quad (device px) a markup of this kind covers: all of it,
+    // or a bar along the bottom / through the middle.
+    static QRectF paintedRect(const QRectF& quad, MarkupKind kind);
+
+private:
+    struct Layer {
+        QImage  image;
+        QPoint  origin;      // device px, from the page's top-left
+        QRectF  coverPts;    // what the layer can hold, in points
+        QRegion dirty;       // layer pixels to redo
+    };
+    static quint64 cacheKey(int page, int zoomMilli) { return (quint64(quint32(page)) << 32) | quint32(zoomMilli); }
+    void rasterize(Layer& layer, int page, qreal scale, const QRect& area) const;
+
+    const AnnotationStore*   m_store;
+    QCache<quint64, Layer>   m_layers;
+};
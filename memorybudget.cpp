@@ -0,0 +1,54 @@
+#include "memorybudget.h"
+
+#include <QSettings>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+MemoryBudget MemoryBudget::fromSettings() {
+    MemoryBudget b;
+    const qint64 mb = QSettings().value("memory/ceilingMB", kDefaultCeilingMB).toLongLong();
+    b.ceiling = qMax<qint64>(mb, 64) << 20;   // below that we'd thrash on a single page
+    return b;
+}
+
+qint64 currentResidentBytes() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) return qint64(pmc.WorkingSetSize);
+    return 0;
+#elif defined(Q_OS_LINUX)
+    long pages = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    const bool ok = std::fscanf(f, "%*ld %ld", &pages) == 1;
+    std::fclose(f);
+    return ok ? qint64(pages) * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return peakResidentBytes();   // no cheap "current" elsewhere; peak is an upper bound
+#endif
+}
+
+qint64 peakResidentBytes() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) return qint64(pmc.PeakWorkingSetSize);
+    return 0;
+#elif defined(Q_OS_UNIX)
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(Q_OS_DARWIN)
+    return qint64(ru.ru_maxrss);          // bytes on macOS
+#else
+    return qint64(ru.ru_maxrss) * 1024;   // KB on Linux/BSD
+#endif
+#else
+    return 0;
+#endif
+}
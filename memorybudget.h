@@ -0,0 +1,25 @@
+#pragma once
+#include <QtGlobal>
+#include <climits>
+
+// How much resident memory the open document may use, and how it's split.
+// The ceiling comes from QSettings ("memory/ceilingMB"). Rendered pages and
+// search hits get fixed shares (the text index is a file mapping and pages
+// out on its own); the rest is headroom for pdfium and the mapped PDF, which
+// get trimmed when the process goes over.
+struct MemoryBudget {
+    static constexpr qint64 kDefaultCeilingMB = 512;
+    static constexpr qint64 kBytesPerSearchHit = 160;   // SearchHit + one rect, roughly
+
+    qint64 ceiling = kDefaultCeilingMB << 20;   // bytes
+
+    qint64 renderCache() const { return ceiling * 6 / 10; }
+    qint64 search() const { return ceiling / 10; }
+    int maxSearchHits() const { return int(qMin<qint64>(search() / kBytesPerSearchHit, INT_MAX)); }
+
+    static MemoryBudget fromSettings();
+};
+
+// Resident set size of this process, current and peak, in bytes (0 if unknown).
+qint64 currentResidentBytes();
+qint64 peakResidentBytes();
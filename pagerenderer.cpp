@@ -0,0 +1,303 @@
+#include "pagerenderer.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfDocumentRenderOptions>
+#include <QRunnable>
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QtMath>
+
+#include "diskpagecache.h"
+#include "trace.h"
+
+namespace {
+constexpr qint64 kDefaultBudget = 256ll * 1024 * 1024;   // 256 MB of rendered pages
+
+QPdfDocumentRenderOptions::Rotation toPdfRotation(int degrees) {
+    switch (((degrees % 360) + 360) % 360) {
+    case 90:  return QPdfDocumentRenderOptions::Rotation::Clockwise90;
+    case 180: return QPdfDocumentRenderOptions::Rotation::Clockwise180;
+    case 270: return QPdfDocumentRenderOptions::Rotation::Clockwise270;
+    default:  return QPdfDocumentRenderOptions::Rotation::None;
+    }
+}
+}
+
+// Owned by the service (autoDelete off) so it can be taken back out of the pool
+// queue or outlive a reset; the service deletes it once finished() has run.
+// The service's outstanding count drops only once run() is done with it.
+class RenderJob : public QRunnable {
+public:
+    // clip: the part of the size-d page to rasterize (a tile), or null for all of it
+    RenderJob(PageRenderService* svc, const RenderKey& key, const QSize& size, const QRect& clip,
+              quint64 gen, PageRenderService::Priority prio)
+        : m_svc(svc), m_key(key), m_size(size), m_clip(clip), m_gen(gen), m_prio(prio),
+          m_disk(key.isTile() ? nullptr : svc->m_disk), m_hash(svc->m_contentHash) {
+        setAutoDelete(false);
+        m_age.start();
+    }
+
+    void run() override {
+        QImage img;
+        bool rendered = false;
+        if (!m_cancelled.loadRelaxed() && m_disk && !m_hash.isEmpty()) {
+            img = m_disk->load(m_hash, m_key);   // no pdfium lock needed for these
+            m_fromDisk = !img.isNull();
+        }
+        if (img.isNull() && !m_cancelled.loadRelaxed()) {
+            TRACE_SPAN_ARG(m_prio == PageRenderService::Priority::Prefetch ? "prefetch" : "render", "renderPage", m_key.page);
+            // prefetches shouldn't compete with the GUI thread for a core
+            const bool background = m_prio == PageRenderService::Priority::Prefetch;
+            if (background) QThread::currentThread()->setPriority(QThread::LowPriority);
+
+            QPdfDocumentRenderOptions opts;
+            opts.setRotation(toPdfRotation(m_key.rotation));
+            if (!m_clip.isNull()) {
+                opts.setScaledSize(m_size);
+                opts.setScaledClipRect(m_clip);
+            }
+            // QPdfDocument serializes pdfium access internally, so this is safe off the GUI thread
+            img = m_svc->m_doc->render(m_key.page, m_clip.isNull() ? m_size : m_clip.size(), opts);
+            rendered = !img.isNull();
+
+            if (background) QThread::currentThread()->setPriority(QThread::NormalPriority);
+        }
+        PageRenderService* svc = m_svc;
+        const quint64 gen = m_gen;
+        DiskPageCache* disk = m_disk;
+        const QByteArray hash = m_hash;
+        const RenderKey key = m_key;
+        QMetaObject::invokeMethod(svc, [svc, this, gen, img] { svc->finished(this, gen, img); },
+                                  Qt::QueuedConnection);
+        // queued for the disk cache's own worker: compressing a page isn't this pool's job
+        if (rendered && disk && !hash.isEmpty()) disk->store(hash, key, img);
+        svc->m_outstanding.deref();   // last touch: the service may go away after this
+    }
+
+    void cancel() { m_cancelled.storeRelaxed(1); }
+    const RenderKey& key() const { return m_key; }
+    PageRenderService::Priority priority() const { return m_prio; }
+    void setPriority(PageRenderService::Priority prio) { m_prio = prio; }
+    double ageMs() const { return m_age.nsecsElapsed() / 1e6; }
+    bool fromDisk() const { return m_fromDisk; }
+
+private:
+    PageRenderService* m_svc;
+    RenderKey m_key;
+    QSize     m_size;
+    QRect     m_clip;
+    quint64   m_gen;
+    PageRenderService::Priority m_prio;
+    QAtomicInt m_cancelled;
+    QElapsedTimer m_age;   // since request()
+    DiskPageCache* m_disk;
+    QByteArray m_hash;     // empty: don't use the disk cache
+    bool       m_fromDisk = false;
+};
+
+RenderScheduler::RenderScheduler() {
+    // keep one core for the GUI thread
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    m_cache.setMaxCost(kDefaultBudget);
+}
+
+void RenderScheduler::setMemoryBudget(qint64 bytes) {
+    m_cache.setMaxCost(qMax<qint64>(bytes, 1));
+}
+
+void RenderScheduler::trim(qint64 bytes) {
+    const qint64 budget = m_cache.maxCost();
+    m_cache.setMaxCost(qBound<qint64>(1, bytes, budget));   // QCache evicts down to it
+    m_cache.setMaxCost(budget);
+}
+
+void RenderScheduler::removeOwner(quint32 owner) {
+    const QList<CacheKey> keys = m_cache.keys();
+    for (const CacheKey& k : keys)
+        if (k.owner == owner) m_cache.remove(k);
+}
+
+PageRenderService::PageRenderService(QPdfDocument* doc, RenderScheduler* scheduler, QObject* parent)
+    : QObject(parent), m_doc(doc)
+{
+    qRegisterMetaType<RenderKey>();
+    if (!scheduler) {
+        m_ownScheduler = std::make_unique<RenderScheduler>();
+        scheduler = m_ownScheduler.get();
+    }
+    m_sched = scheduler;
+    m_owner = m_sched->m_nextOwner++;
+}
+
+PageRenderService::~PageRenderService() {
+    for (RenderJob* job : std::as_const(m_jobs)) {
+        if (take(job)) continue;
+        job->cancel();
+    }
+    waitForJobs();
+    qDeleteAll(m_jobs);
+    m_sched->removeOwner(m_owner);
+}
+
+// Other documents share the pool, so waitForDone() would wait for their renders too.
+void PageRenderService::waitForJobs() {
+    while (m_outstanding.loadAcquire() > 0) QThread::msleep(1);
+}
+
+void PageRenderService::start(RenderJob* job) {
+    m_outstanding.ref();
+    m_sched->m_pool.start(job, poolPriority(job->priority()));
+}
+
+bool PageRenderService::take(RenderJob* job) {
+    if (!m_sched->m_pool.tryTake(job)) return false;
+    m_outstanding.deref();
+    return true;
+}
+
+void PageRenderService::setActive(bool active) {
+    if (active == m_active) return;
+    m_active = active;
+    // re-queue what hasn't started at the new priority
+    for (RenderJob* job : std::as_const(m_pending))
+        if (take(job)) start(job);
+}
+
+RenderKey PageRenderService::keyFor(int page, qreal scale, int rotation) {
+    RenderKey k;
+    k.page = page;
+    k.zoomMilli = qMax(1, qRound(scale * 1000.0));
+    k.rotation = ((rotation % 360) + 360) % 360;
+    return k;
+}
+
+RenderKey PageRenderService::tileKeyFor(int page, qreal scale, int tileX, int tileY, int rotation) {
+    RenderKey k = keyFor(page, scale, rotation);
+    k.tileX = tileX;
+    k.tileY = tileY;
+    return k;
+}
+
+QRect PageRenderService::tileRect(const RenderKey& key, const QSize& pagePx) {
+    if (!key.isTile()) return QRect(QPoint(), pagePx);
+    return QRect(key.tileX * kTileSize, key.tileY * kTileSize, kTileSize, kTileSize) & QRect(QPoint(), pagePx);
+}
+
+QSizeF PageRenderService::pagePointSize(int page) const {
+    if (!m_doc || page < 0 || page >= m_doc->pageCount()) return {};
+    if (m_pointSizes.size() != m_doc->pageCount()) m_pointSizes = QVector<QSizeF>(m_doc->pageCount());
+    QSizeF& pts = m_pointSizes[page];
+    if (!pts.isValid()) pts = m_doc->pagePointSize(page);
+    return pts;
+}
+
+QSize PageRenderService::pixelSize(int page, qreal scale, int rotation) const {
+    QSizeF pts = pagePointSize(page);
+    if (rotation % 180 != 0) pts.transpose();
+    return (pts * scale).toSize();
+}
+
+bool PageRenderService::needsTiles(int page, qreal scale) const {
+    const QSize px = pixelSize(page, scale);
+    return qint64(px.width()) * px.height() > kTileThresholdPx;
+}
+
+RenderKey PageRenderService::previewKeyFor(int page, qreal scale, int rotation) const {
+    const QSize px = pixelSize(page, scale, rotation);
+    const qreal area = qreal(px.width()) * px.height();
+    qreal preview = scale / kPreviewDivisor;
+    if (area > 0) preview = qMin(preview, scale * qSqrt(kPreviewMaxPx / area));
+    return keyFor(page, preview, rotation);
+}
+
+const QImage* PageRenderService::anyCached(int page, int rotation) {
+    const auto it = m_sharpest.constFind(page);
+    if (it == m_sharpest.cend() || it->rotation != rotation) return nullptr;
+    return m_sched->m_cache.object({ m_owner, *it });
+}
+
+const QImage* PageRenderService::cached(const RenderKey& key) {
+    return m_sched->m_cache.object({ m_owner, key });   // also bumps it to most-recently-used
+}
+
+void PageRenderService::request(const RenderKey& key, Priority prio) {
+    if (!m_doc || key.page < 0 || key.page >= m_doc->pageCount()) return;
+    if (contains(key)) return;
+
+    if (RenderJob* queued = m_pending.value(key)) {
+        // promote a queued prefetch the user is now looking at
+        if (prio > queued->priority() && take(queued)) {
+            queued->setPriority(prio);
+            start(queued);
+        }
+        return;
+    }
+
+    const QSize px = pixelSize(key.page, key.scale(), key.rotation);
+    const QRect clip = key.isTile() ? tileRect(key, px) : QRect();
+    if (px.isEmpty() || (key.isTile() && clip.isEmpty())) return;
+
+    auto *job = new RenderJob(this, key, px, clip, m_generation, prio);
+    m_jobs.insert(job);
+    m_pending.insert(key, job);
+    start(job);
+}
+
+void PageRenderService::cancelPrefetches(const QSet<RenderKey>& keys) {
+    for (const RenderKey& key : keys) {
+        RenderJob* job = m_pending.value(key);
+        if (!job || job->priority() != Priority::Prefetch || !take(job)) continue;
+        m_jobs.remove(job);
+        delete job;
+        m_pending.remove(key);
+    }
+}
+
+void PageRenderService::cancel(const RenderKey& key) {
+    RenderJob* job = m_pending.value(key);
+    if (!job || !take(job)) return;
+    m_jobs.remove(job);
+    delete job;
+    m_pending.remove(key);
+}
+
+void PageRenderService::reset() {
+    ++m_generation;
+    for (RenderJob* job : std::as_const(m_pending)) {
+        if (take(job)) {                    // still queued: never going to run
+            m_jobs.remove(job);
+            delete job;
+        } else {
+            job->cancel();                  // running: result gets dropped in finished()
+        }
+    }
+    m_pending.clear();
+    waitForJobs();
+    m_sched->removeOwner(m_owner);
+    m_sharpest.clear();
+    m_pointSizes.clear();
+    m_contentHash.clear();
+}
+
+void PageRenderService::finished(RenderJob* job, quint64 generation, const QImage& img) {
+    const RenderKey key = job->key();
+    if (job->priority() == Priority::Visible) {
+        m_stats.lastLatencyMs = job->ageMs();
+        if (job->fromDisk()) ++m_stats.diskHits;
+    }
+    if (m_pending.value(key) == job) m_pending.remove(key);
+    m_jobs.remove(job);
+    delete job;
+
+    if (generation != m_generation || img.isNull()) return;
+    QCache<RenderScheduler::CacheKey, QImage>& cache = m_sched->m_cache;
+    if (!cache.insert({ m_owner, key }, new QImage(img), img.sizeInBytes())) return;
+    if (!key.isTile()) {
+        // remember the sharpest whole page we have, unless it's been evicted already
+        auto it = m_sharpest.find(key.page);
+        if (it == m_sharpest.end()) m_sharpest.insert(key.page, key);
+        else if (!cache.contains({ m_owner, *it }) || it->rotation != key.rotation || it->zoomMilli < key.zoomMilli) *it = key;
+    }
+    emit pageReady(key);
+}
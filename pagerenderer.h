@@ -0,0 +1,191 @@
+#pragma once
+#include <QObject>
+#include <QAtomicInt>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QSet>
+#include <QSize>
+#include <QThreadPool>
+#include <QVector>
+#include <memory>
+
+class QPdfDocument;
+class RenderJob;
+class PageRenderService;
+class DiskPageCache;
+
+// One rasterized page, or one tile of it. The zoom is the render scale (device
+// pixels per PDF point) stored in thousandths so the key stays hashable and
+// stable across float noise.
+struct RenderKey {
+    int page = -1;
+    int zoomMilli = 1000;
+    int rotation = 0;   // degrees, multiple of 90
+    int tileX = -1;     // -1: the whole page
+    int tileY = -1;
+
+    qreal scale() const { return zoomMilli / 1000.0; }
+    bool isTile() const { return tileX >= 0; }
+};
+
+inline bool operator==(const RenderKey& a, const RenderKey& b) {
+    return a.page == b.page && a.zoomMilli == b.zoomMilli && a.rotation == b.rotation
+        && a.tileX == b.tileX && a.tileY == b.tileY;
+}
+inline size_t qHash(const RenderKey& k, size_t seed = 0) {
+    return qHashMulti(seed, k.page, k.zoomMilli, k.rotation, k.tileX, k.tileY);
+}
+Q_DECLARE_METATYPE(RenderKey)
+
+// The worker pool and page cache every open document renders through, so they
+// share the cores by priority and the memory under one budget: when it's full,
+// the least recently used page goes, whichever document it belongs to.
+// GUI thread only (like the services using it); create it before them and
+// destroy it after the last one.
+class RenderScheduler {
+public:
+    RenderScheduler();
+
+    // Byte budget of the shared page cache; trim() evicts down to bytes for now
+    // and leaves the budget as it was.
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return m_cache.maxCost(); }
+    void trim(qint64 bytes);
+    qint64 memoryUsed() const { return m_cache.totalCost(); }
+
+private:
+    struct CacheKey {
+        quint32   owner;   // PageRenderService::m_owner
+        RenderKey key;
+        friend bool operator==(const CacheKey& a, const CacheKey& b) { return a.owner == b.owner && a.key == b.key; }
+        friend size_t qHash(const CacheKey& k, size_t seed = 0) { return qHashMulti(seed, k.owner, k.key); }
+    };
+    void removeOwner(quint32 owner);
+
+    QThreadPool                m_pool;
+    QCache<CacheKey, QImage>   m_cache;
+    quint32                    m_nextOwner = 1;
+
+    friend class PageRenderService;
+};
+
+// Renders pages of one document with QPdfDocument::render() on the scheduler's
+// pool and keeps the results in its byte-bounded LRU (QCache with cost = image
+// bytes). Everything except the actual rasterization runs on the GUI thread, so
+// the cache needs no locking. An inactive service (a background tab) queues
+// behind every active one.
+//
+// Past kTileThresholdPx a whole-page bitmap isn't worth it (800% on a large
+// drawing would be gigabytes); the view asks for kTileSize tiles of what's on
+// screen instead, over a small preview of the whole page.
+class PageRenderService : public QObject {
+    Q_OBJECT
+public:
+    enum class Priority { Prefetch = 0, Visible = 10 };
+
+    static constexpr int    kTileSize = 512;              // device pixels, square
+    static constexpr qint64 kTileThresholdPx = 16 << 20;  // ~64 MB as ARGB32
+    static constexpr qint64 kPreviewMaxPx = 1 << 20;
+    static constexpr int    kPreviewDivisor = 4;          // preview: 1/16 of the pixels
+
+    // Without a scheduler the service gets a private one.
+    explicit PageRenderService(QPdfDocument* doc, RenderScheduler* scheduler = nullptr, QObject* parent = nullptr);
+    ~PageRenderService();
+
+    // Inactive: queued and future renders drop below those of every active service.
+    void setActive(bool active);
+    bool isActive() const { return m_active; }
+
+    // Whole pages are looked up on disk before pdfium renders them and written
+    // there after, once the document's content hash is set. reset() forgets the hash.
+    void setDiskCache(DiskPageCache* cache) { m_disk = cache; }
+    void setContentHash(const QByteArray& hash) { m_contentHash = hash; }
+    QByteArray contentHash() const { return m_contentHash; }
+
+    static RenderKey keyFor(int page, qreal scale, int rotation = 0);
+    static RenderKey tileKeyFor(int page, qreal scale, int tileX, int tileY, int rotation = 0);
+    // Part of the whole page (at the key's scale, sized pagePx) a tile covers.
+    static QRect tileRect(const RenderKey& key, const QSize& pagePx);
+
+    // Page size in points, cached: QPdfDocument takes pdfium's lock for it, and
+    // that lock is held for the length of any render in progress.
+    QSizeF pagePointSize(int page) const;
+    QSize pixelSize(int page, qreal scale, int rotation = 0) const;   // whole page
+    bool needsTiles(int page, qreal scale) const;
+    // Cheap whole-page stand-in: a quarter of the scale, and never over kPreviewMaxPx.
+    RenderKey previewKeyFor(int page, qreal scale, int rotation = 0) const;
+    // Sharpest whole-page render of the page still cached, at any scale, for
+    // showing something (rescaled) while the right one renders. Not counted in stats().
+    const QImage* anyCached(int page, int rotation = 0);
+
+    // nullptr on miss. The pointer is only valid until the next insert, so use it right away.
+    const QImage* cached(const RenderKey& key);
+    bool contains(const RenderKey& key) const { return m_sched->m_cache.contains({ m_owner, key }); }
+    bool isPending(const RenderKey& key) const { return m_pending.contains(key); }
+
+    // Queue a render unless it is cached or already queued. Asking for a queued
+    // prefetch with Visible priority moves it to the front.
+    void request(const RenderKey& key, Priority prio = Priority::Visible);
+
+    // Take these out of the pool if they're still queued as prefetches (someone
+    // may have asked for one as Visible since). Renders that already started
+    // finish and land in the cache as usual.
+    void cancelPrefetches(const QSet<RenderKey>& keys);
+    // Take one queued render out of the pool, whatever its priority (no-op once it runs).
+    void cancel(const RenderKey& key);
+
+    // The scheduler's: shared with every other document using it.
+    void setMemoryBudget(qint64 bytes) { m_sched->setMemoryBudget(bytes); }
+    qint64 memoryBudget() const { return m_sched->memoryBudget(); }
+    void trim(qint64 bytes) { m_sched->trim(bytes); }
+    qint64 memoryUsed() const { return m_sched->memoryUsed(); }
+
+    // For the performance HUD. A hit is a page (or tile) that was cached when it
+    // came into view, a miss one that wasn't (see countShown()); latency is
+    // request() to cache.
+    struct Stats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 diskHits = 0;         // misses answered from the disk cache
+        double  lastLatencyMs = -1;   // until the first visible render
+    };
+    const Stats& stats() const { return m_stats; }
+    // The view calls this once per page or tile as it comes into view, not per paint.
+    void countShown(const RenderKey& key) { ++(contains(key) ? m_stats.hits : m_stats.misses); }
+    void resetStats() { m_stats = Stats(); }
+
+    // Drop the queue and the cache and wait for in-flight renders.
+    // Call this before the document gets (re)loaded.
+    void reset();
+
+signals:
+    void pageReady(const RenderKey& key);
+
+private:
+    void finished(RenderJob* job, quint64 generation, const QImage& img);
+    void start(RenderJob* job);
+    bool take(RenderJob* job);   // out of the pool queue; false once it's running
+    int poolPriority(Priority prio) const { return int(prio) - (m_active ? 0 : kInactivePenalty); }
+    void waitForJobs();
+
+    static constexpr int kInactivePenalty = 20;   // below Prefetch of any active service
+
+    QPdfDocument*               m_doc;
+    std::unique_ptr<RenderScheduler> m_ownScheduler;
+    RenderScheduler*            m_sched;
+    quint32                     m_owner;     // our part of the shared cache
+    bool                        m_active = true;
+    QAtomicInt                  m_outstanding;   // jobs in the pool, queued or running
+    DiskPageCache*              m_disk = nullptr;
+    QByteArray                  m_contentHash;
+    QHash<RenderKey, RenderJob*> m_pending;   // queued or running, by key
+    QSet<RenderJob*>            m_jobs;      // every job we still own
+    QHash<int, RenderKey>       m_sharpest;  // per page, for anyCached()
+    mutable QVector<QSizeF>     m_pointSizes;
+    quint64                     m_generation = 0;
+    Stats                       m_stats;
+
+    friend class RenderJob;
+};
@@ -0,0 +1,377 @@
+#include "pdfassembler.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+namespace {
+constexpr int kMaxTreeDepth = 32;
+constexpr int kXrefChunk = 4096;   // xref lines per write
+
+bool fail(QString* error, const QString& msg) {
+    if (error) *error = msg;
+    return false;
+}
+
+// The same file whatever way the path gets there (symlinks, ".."); a file that
+// doesn't exist yet by its directory's real path.
+QString canonicalPath(const QString& path) {
+    const QFileInfo fi(path);
+    if (fi.exists()) return fi.canonicalFilePath();
+    const QString dir = fi.absoluteDir().canonicalPath();
+    return dir.isEmpty() ? fi.absoluteFilePath() : dir + '/' + fi.fileName();
+}
+}
+
+PdfAssembler::PdfAssembler() = default;
+PdfAssembler::~PdfAssembler() = default;
+
+bool PdfAssembler::fail(const QString& msg) {
+    m_error = msg;
+    return false;
+}
+
+int PdfAssembler::sourceFor(const QString& path) {
+    const QString key = canonicalPath(path);
+    auto it = m_sourceIndex.constFind(key);
+    if (it != m_sourceIndex.cend()) return *it;
+    Source s;
+    s.path = path;
+    m_sources << s;
+    m_sourceIndex.insert(key, int(m_sources.size()) - 1);
+    return int(m_sources.size()) - 1;
+}
+
+int PdfAssembler::pagesIn(const QString& path) {
+    const int index = sourceFor(path);
+    if (!m_sources[index].loaded && !openSource(index)) return -1;
+    return int(m_sources[index].pages.size());
+}
+
+void PdfAssembler::addPage(const QString& path, int page, int rotate) {
+    m_plan << Planned{ sourceFor(path), page, rotate, 0 };
+}
+
+bool PdfAssembler::openSource(int index) {
+    if (m_current == index && m_reader) return true;
+    m_reader.reset();
+    m_current = -1;
+    Source& src = m_sources[index];
+    auto reader = std::make_unique<PdfReader>();
+    if (!reader->open(src.path)) return fail(QString("%1: %2").arg(QFileInfo(src.path).fileName(), reader->errorString()));
+    if (reader->isEncrypted()) return fail(QString("%1: encrypted documents can't be edited.").arg(QFileInfo(src.path).fileName()));
+    if (!src.loaded) {
+        src.pages = reader->pages();
+        src.loaded = true;
+        mapPlannedPages(index);
+    }
+    m_reader = std::move(reader);
+    m_current = index;
+    return true;
+}
+
+// Output numbers of the planned pages of a source, so links between them survive.
+void PdfAssembler::mapPlannedPages(int index) {
+    Source& src = m_sources[index];
+    for (const Planned& p : std::as_const(m_plan)) {
+        if (p.source != index || p.page < 0 || p.page >= src.pages.size() || !p.destNum) continue;
+        const int num = src.pages[p.page].ref.num;
+        if (!src.pageDest.contains(num)) src.pageDest.insert(num, p.destNum);
+    }
+}
+
+int PdfAssembler::destFor(int num) {
+    Source& src = m_sources[m_current];
+    auto page = src.pageDest.constFind(num);
+    if (page != src.pageDest.cend()) return *page;
+    auto it = src.map.constFind(num);
+    if (it != src.map.cend()) return *it;
+
+    const PdfObject obj = m_reader->object(num);
+    // the old page tree and catalog stay behind; so do pages that aren't copied
+    if (obj.isDict() && !obj.isStream()) {
+        const PdfObject type = obj.value("Type");
+        if (type.isName("Pages")) return m_pagesRoot;
+        if (type.isName("Catalog") || type.isName("Page")) return 0;
+    }
+    const int dest = m_nextNum++;
+    src.map.insert(num, dest);
+    m_queue << Pending{ num, obj };
+    return dest;
+}
+
+PdfObject PdfAssembler::rewrite(const PdfObject& o) {
+    switch (o.type()) {
+    case PdfObject::Type::Ref: {
+        const int dest = destFor(o.toRef().num);
+        return dest ? PdfObject::ref({ dest, 0 }) : PdfObject();
+    }
+    case PdfObject::Type::Array: {
+        PdfObject a = PdfObject::array();
+        for (int i = 0; i < o.size(); ++i) a.append(rewrite(o.at(i)));
+        return a;
+    }
+    case PdfObject::Type::Dict:
+    case PdfObject::Type::Stream: {
+        PdfObject d = PdfObject::dict();
+        for (const PdfDictEntry& e : o.entries()) d.insert(e.key, rewrite(e.value));
+        return d;
+    }
+    default:
+        return o;
+    }
+}
+
+PdfObject PdfAssembler::inherited(const PdfObject& page, const QByteArray& key) const {
+    PdfObject node = m_reader->resolve(page.value("Parent"));
+    for (int depth = 0; node.isDict() && depth < kMaxTreeDepth; ++depth) {
+        if (node.contains(key)) return node.value(key);
+        node = m_reader->resolve(node.value("Parent"));
+    }
+    return PdfObject();
+}
+
+bool PdfAssembler::writePage(const Planned& p) {
+    if (!openSource(p.source)) return false;
+    const Source& src = m_sources[p.source];
+    if (p.page < 0 || p.page >= src.pages.size())
+        return fail(QString("%1 has no page %2.").arg(QFileInfo(src.path).fileName()).arg(p.page + 1));
+    const PdfPage& info = src.pages[p.page];
+    const PdfObject page = m_reader->object(info.ref);
+    if (!page.isDict()) return fail(QString("%1: page %2 is damaged.").arg(QFileInfo(src.path).fileName()).arg(p.page + 1));
+
+    TRACE_SPAN_ARG("edit", "copyPage", p.page);
+    PdfObject out = PdfObject::dict();
+    out.insert("Type", PdfObject::name("Page"));
+    out.insert("Parent", PdfObject::ref({ m_pagesRoot, 0 }));
+    // the first copy of a page owns its annotations; a repeat gets copies of its own
+    const bool repeat = src.pageDest.value(info.ref.num) != p.destNum;
+    for (const PdfDictEntry& e : page.entries()) {
+        // tree links, article beads and the rotation (redone below) don't come along
+        if (e.key == "Type" || e.key == "Parent" || e.key == "B" || e.key == "Rotate") continue;
+        if (repeat && e.key == "Annots") {
+            PdfObject annots;
+            if (!cloneAnnots(e.value, p.destNum, &annots)) return false;
+            out.insert(e.key, annots);
+            continue;
+        }
+        out.insert(e.key, rewrite(e.value));
+    }
+    // what the page used to inherit from its tree
+    for (const char* key : { "Resources", "MediaBox", "CropBox" }) {
+        if (page.contains(key)) continue;
+        const PdfObject v = inherited(page, key);
+        if (!v.isNull()) out.insert(key, rewrite(v));
+    }
+    if (!out.contains("MediaBox")) {
+        PdfObject box = PdfObject::array();
+        for (double v : { 0.0, 0.0, 612.0, 792.0 }) box.append(PdfObject::real(v));
+        out.insert("MediaBox", box);
+    }
+    const int rotate = ((info.rotate + p.rotate) % 360 + 360) % 360 / 90 * 90;
+    if (rotate) out.insert("Rotate", PdfObject::integer(rotate));
+
+    return writeObject(p.destNum, out.serialize()) && drain();
+}
+
+// An annotation belongs to one page (its /P), so sharing the objects between
+// copies of a page would put it on several at once and have an edit on one
+// show up on all. Each is written again pointing at this copy; what it refers
+// to (appearance streams and the like) is still shared. Popups and form field
+// links point back at the originals and are left off.
+bool PdfAssembler::cloneAnnots(const PdfObject& annots, int pageNum, PdfObject* out) {
+    *out = PdfObject::array();
+    const PdfObject list = m_reader->resolve(annots);
+    for (int i = 0; list.isArray() && i < list.size(); ++i) {
+        const PdfObject annot = m_reader->resolve(list.at(i));
+        if (!annot.isDict() || annot.isStream() || annot.value("Subtype").isName("Popup")) continue;
+        PdfObject copy = PdfObject::dict();
+        for (const PdfDictEntry& e : annot.entries())
+            if (e.key != "P" && e.key != "Popup" && e.key != "Parent") copy.insert(e.key, rewrite(e.value));
+        copy.insert("P", PdfObject::ref({ pageNum, 0 }));
+        const int num = m_nextNum++;
+        if (!writeObject(num, copy.serialize())) return false;
+        out->append(PdfObject::ref({ num, 0 }));
+    }
+    return true;
+}
+
+// Everything the page pulled in, and what that pulls in, until nothing's left.
+bool PdfAssembler::drain() {
+    while (!m_queue.isEmpty()) {
+        const Pending next = m_queue.takeLast();
+        const int dest = m_sources[m_current].map.value(next.num);
+        if (next.obj.isStream()) {
+            // /Length may be an indirect object; the copy gets a direct one
+            PdfObject dict = PdfObject::dict();
+            for (const PdfDictEntry& e : next.obj.entries())
+                if (e.key != "Length") dict.insert(e.key, rewrite(e.value));
+            dict.insert("Length", PdfObject::integer(next.obj.streamLength()));
+            if (!writeObject(dest, dict.serialize(), &next.obj)) return false;
+        } else if (!writeObject(dest, rewrite(next.obj).serialize())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PdfAssembler::writeObject(int num, const QByteArray& body, const PdfObject* stream) {
+    if (num >= m_offsets.size()) m_offsets.resize(num + 1);
+    m_offsets[num] = m_pos;
+    if (!put(QByteArray::number(num) + " 0 obj\n" + body)) return false;
+    if (stream) {
+        const qint64 offset = stream->streamOffset(), length = stream->streamLength();
+        if (offset < 0 || length < 0 || offset + length > m_reader->size())
+            return fail(QString("%1: a stream runs past the end of the file.").arg(QFileInfo(m_sources[m_current].path).fileName()));
+        // straight from the mapping, never decoded; 64-bit all the way, streams can pass 2 GB
+        if (!put("\nstream\n")
+            || !put(reinterpret_cast<const char*>(m_reader->data()) + offset, length)
+            || !put("\nendstream"))
+            return false;
+    }
+    return put("\nendobj\n");
+}
+
+bool PdfAssembler::put(const char* data, qint64 size) {
+    if (m_out->write(data, size) != size) return fail(m_out->errorString());
+    m_pos += size;
+    return true;
+}
+
+bool PdfAssembler::write(const QString& outPath) {
+    TRACE_SPAN_ARG("edit", "assemble", pageCount());
+    m_error.clear();
+    if (m_plan.isEmpty()) return fail("No pages to write.");
+    // by real path: a symlink or ".." to an input would be overwritten while it's read
+    if (m_sourceIndex.contains(canonicalPath(outPath))) return fail("The output can't be one of the inputs.");
+
+    // numbering: the new tree, the catalog, then the pages in order; the rest as it's reached
+    m_nextNum = 1;
+    m_pagesRoot = m_nextNum++;
+    const int catalog = m_nextNum++;
+    for (Planned& p : m_plan) p.destNum = m_nextNum++;
+    m_offsets.fill(0, m_nextNum);
+    m_queue.clear();
+    for (int i = 0; i < m_sources.size(); ++i) {
+        m_sources[i].map.clear();
+        m_sources[i].pageDest.clear();
+        if (m_sources[i].loaded) mapPlannedPages(i);
+    }
+
+    m_out = std::make_unique<QSaveFile>(outPath);
+    if (!m_out->open(QIODevice::WriteOnly)) {
+        fail(m_out->errorString());
+        m_out.reset();
+        return false;
+    }
+    m_pos = 0;
+    bool ok = put("%PDF-1.7\n%\xe2\xe3\xcf\xd3\n");
+    for (const Planned& p : std::as_const(m_plan))
+        if (!(ok = ok && writePage(p))) break;
+
+    if (ok) {
+        PdfObject kids = PdfObject::array();
+        for (const Planned& p : std::as_const(m_plan)) kids.append(PdfObject::ref({ p.destNum, 0 }));
+        PdfObject pages = PdfObject::dict();
+        pages.insert("Type", PdfObject::name("Pages"));
+        pages.insert("Kids", kids);
+        pages.insert("Count", PdfObject::integer(m_plan.size()));
+        PdfObject root = PdfObject::dict();
+        root.insert("Type", PdfObject::name("Catalog"));
+        root.insert("Pages", PdfObject::ref({ m_pagesRoot, 0 }));
+        ok = writeObject(m_pagesRoot, pages.serialize()) && writeObject(catalog, root.serialize());
+    }
+    if (ok) {
+        // classic table, one section; every number up to m_nextNum got written
+        const qint64 xrefOffset = m_pos;
+        QByteArray xref = "xref\n0 " + QByteArray::number(m_nextNum) + "\n0000000000 65535 f\r\n";
+        for (int n = 1; ok && n < m_nextNum; ++n) {
+            xref += QByteArray::number(m_offsets.value(n)).rightJustified(10, '0') + " 00000 n\r\n";
+            if (n % kXrefChunk == 0) {
+                ok = put(xref);
+                xref.clear();
+            }
+        }
+        PdfObject trailer = PdfObject::dict();
+        trailer.insert("Size", PdfObject::integer(m_nextNum));
+        trailer.insert("Root", PdfObject::ref({ catalog, 0 }));
+        ok = ok && put(xref + "trailer\n" + trailer.serialize() + "\nstartxref\n" + QByteArray::number(xrefOffset) + "\n%%EOF\n");
+    }
+    if (ok) ok = m_out->commit() || fail(m_out->errorString());
+    else m_out->cancelWriting();   // the target stays as it was
+    m_out.reset();
+    m_queue.clear();
+    return ok;
+}
+
+// --- page operations ---
+
+bool mergePdfs(const QStringList& inputs, const QString& outPath, QString* error) {
+    PdfAssembler a;
+    for (const QString& in : inputs) {
+        const int n = a.pagesIn(in);
+        if (n < 0) return fail(error, a.errorString());
+        for (int p = 0; p < n; ++p) a.addPage(in, p);
+    }
+    return a.write(outPath) || fail(error, a.errorString());
+}
+
+bool extractPages(const QString& input, const QVector<int>& pages, const QString& outPath, QString* error) {
+    PdfAssembler a;
+    const int n = a.pagesIn(input);
+    if (n < 0) return fail(error, a.errorString());
+    for (int p : pages) {
+        if (p < 0 || p >= n) return fail(error, QString("There's no page %1 (the document has %2).").arg(p + 1).arg(n));
+        a.addPage(input, p);
+    }
+    return a.write(outPath) || fail(error, a.errorString());
+}
+
+bool deletePages(const QString& input, const QVector<int>& pages, const QString& outPath, QString* error) {
+    PdfAssembler a;
+    const int n = a.pagesIn(input);
+    if (n < 0) return fail(error, a.errorString());
+    const QSet<int> drop(pages.cbegin(), pages.cend());
+    for (int p = 0; p < n; ++p)
+        if (!drop.contains(p)) a.addPage(input, p);
+    if (!a.pageCount()) return fail(error, "That would delete every page.");
+    return a.write(outPath) || fail(error, a.errorString());
+}
+
+bool rotatePages(const QString& input, const QVector<int>& pages, int degrees, const QString& outPath, QString* error) {
+    if (degrees % 90) return fail(error, "Pages turn in steps of 90 degrees.");
+    PdfAssembler a;
+    const int n = a.pagesIn(input);
+    if (n < 0) return fail(error, a.errorString());
+    // no pages listed: all of them
+    const QSet<int> turn(pages.cbegin(), pages.cend());
+    for (int p = 0; p < n; ++p) a.addPage(input, p, turn.isEmpty() || turn.contains(p) ? degrees : 0);
+    return a.write(outPath) || fail(error, a.errorString());
+}
+
+QStringList splitPdf(const QString& input, int pagesPerPart, const QString& outDir, QString* error) {
+    QStringList written;
+    if (pagesPerPart < 1) {
+        fail(error, "A part needs at least one page.");
+        return written;
+    }
+    // one assembler for all parts: the source is opened and its page tree read once
+    PdfAssembler a;
+    const int n = a.pagesIn(input);
+    if (n < 0) {
+        fail(error, a.errorString());
+        return written;
+    }
+    const QString base = QFileInfo(input).completeBaseName();
+    for (int first = 0, part = 1; first < n; first += pagesPerPart, ++part) {
+        a.clearPages();
+        for (int p = first; p < qMin(n, first + pagesPerPart); ++p) a.addPage(input, p);
+        const QString out = QDir(outDir).filePath(QString("%1-part%2.pdf").arg(base).arg(part));
+        if (!a.write(out)) {
+            fail(error, a.errorString());
+            return written;
+        }
+        written << out;
+    }
+    return written;
+}
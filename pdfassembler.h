@@ -0,0 +1,102 @@
+#pragma once
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+
+#include "pdfreader.h"
+
+// Builds a new PDF out of pages of existing ones, without loading any of them:
+// each page's object graph is walked from the source's mapping and written out
+// as it's reached, stream data copied byte for byte (never decoded). Objects
+// are renumbered once per source, so fonts and images shared by several pages
+// are written once too. Memory is the renumbering tables and the page list,
+// not the documents; only one source is open at a time.
+//
+// What gets left behind: the source page trees (pages hang off one new /Pages,
+// inherited attributes copied down), outlines, forms and the structure tree.
+// Links to pages that aren't in the output become null. A page listed more
+// than once gets copies of its annotations on every repeat.
+//
+// The output goes to a temporary file that replaces the target only once it's
+// complete, so a target that's open (mapped) elsewhere keeps its old bytes.
+class PdfAssembler {
+public:
+    PdfAssembler();
+    ~PdfAssembler();
+    PdfAssembler(const PdfAssembler&) = delete;
+    PdfAssembler& operator=(const PdfAssembler&) = delete;
+
+    // Page count of a source (reads its page tree once); -1 if it can't be read.
+    int pagesIn(const QString& path);
+    // Queue a page (0-based) of a source, turned clockwise by rotate degrees on
+    // top of its own /Rotate. Nothing is copied until write().
+    void addPage(const QString& path, int page, int rotate = 0);
+    int pageCount() const { return int(m_plan.size()); }
+    // Forget the queued pages, keep what's known about the sources (for the next part of a split).
+    void clearPages() { m_plan.clear(); }
+
+    bool write(const QString& outPath);
+    QString errorString() const { return m_error; }
+
+private:
+    struct Planned {
+        int source;
+        int page;
+        int rotate;
+        int destNum;
+    };
+    struct Source {
+        QString path;
+        bool    loaded = false;       // pages known
+        QVector<PdfPage> pages;
+        QHash<int, int> map;          // source object number -> output number (per write)
+        QHash<int, int> pageDest;     // source page object -> its first copy in the output
+    };
+    struct Pending {
+        int       num;                // in the source
+        PdfObject obj;
+    };
+
+    bool fail(const QString& msg);
+    int sourceFor(const QString& path);
+    bool openSource(int index);
+    void mapPlannedPages(int index);
+    int destFor(int num);             // 0: becomes null
+    PdfObject rewrite(const PdfObject& o);
+    PdfObject inherited(const PdfObject& page, const QByteArray& key) const;
+    bool writePage(const Planned& p);
+    bool cloneAnnots(const PdfObject& annots, int pageNum, PdfObject* out);
+    bool drain();
+    bool writeObject(int num, const QByteArray& body, const PdfObject* stream = nullptr);
+    bool put(const char* data, qint64 size);
+    bool put(const QByteArray& bytes) { return put(bytes.constData(), bytes.size()); }
+
+    QVector<Source>  m_sources;
+    QHash<QString, int> m_sourceIndex;
+    QVector<Planned> m_plan;
+
+    // while writing
+    std::unique_ptr<QSaveFile> m_out;   // temp file, renamed over the target on success
+    qint64           m_pos = 0;
+    QVector<qint64>  m_offsets;      // by output object number; 0 = not written yet
+    int              m_nextNum = 1;
+    int              m_pagesRoot = 0;
+    int              m_current = -1; // open source
+    std::unique_ptr<PdfReader> m_reader;
+    QVector<Pending> m_queue;        // source objects referenced but not written yet
+    QString          m_error;
+};
+
+// The page operations on top of it. Pages are 0-based; every one writes a new file.
+bool mergePdfs(const QStringList& inputs, const QString& outPath, QString* error = nullptr);
+// The pages in the given order (repeats allowed): extract a range, or reorder.
+bool extractPages(const QString& input, const QVector<int>& pages, const QString& outPath, QString* error = nullptr);
+bool deletePages(const QString& input, const QVector<int>& pages, const QString& outPath, QString* error = nullptr);
+bool rotatePages(const QString& input, const QVector<int>& pages, int degrees, const QString& outPath,
+                 QString* error = nullptr);
+// Parts of pagesPerPart pages, named <outDir>/<base>-partN.pdf. Returns the files written.
+QStringList splitPdf(const QString& input, int pagesPerPart, const QString& outDir, QString* error = nullptr);
@@ -0,0 +1,13 @@
+#pragma once
+#include <QtPdf/QPdfDocument>
+
+// QPdfDocument::load() result check. In newer Qt, compare to QPdfDocument::Error::None;
+// in older, QPdfDocument::NoError.
+template <typename LoadError>
+inline bool pdfLoadOk(LoadError err) {
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 6, 0))
+    return err == QPdfDocument::Error::None;
+#else
+    return err == QPdfDocument::NoError;
+#endif
+}
@@ -0,0 +1,419 @@
+#include "pdfpageview.h"
+#include "pagerenderer.h"
+#include "searchengine.h"
+#include "trace.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfPageNavigator>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QTimer>
+#include <QTransform>
+#include <algorithm>
+
+namespace {
+const QColor kPlaceholder(250, 250, 250);
+const QColor kSearchHit(255, 255, 0, 50);
+const QColor kCurrentHit(Qt::cyan);
+
+constexpr qreal kFastScrollPxPerMs = 1.5;   // faster than this, only low-res renders are queued
+constexpr qreal kScrollSmoothing   = 0.5;   // weight of the newest sample
+constexpr int   kSettleMs          = 150;   // no scrolling for this long = settled
+}
+
+PdfPageView::PdfPageView(QWidget* parent) : QPdfView(parent) {
+    if (auto *screen = QGuiApplication::primaryScreen())
+        m_screenResolution = screen->logicalDotsPerInch() / 72.0;
+
+    m_settleTimer = new QTimer(this);
+    m_settleTimer->setSingleShot(true);
+    m_settleTimer->setInterval(kSettleMs);
+    connect(m_settleTimer, &QTimer::timeout, this, &PdfPageView::scrollSettled);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &PdfPageView::scrolled);
+
+    connect(this, &QPdfView::documentChanged, this, [this](QPdfDocument* doc) {
+        disconnect(m_docStatus);
+        m_layout = Layout();
+        m_requested.clear();
+        m_shown.clear();
+        if (doc)
+            m_docStatus = connect(doc, &QPdfDocument::statusChanged, this, [this] {
+                m_layout = Layout();
+                m_requested.clear();   // the render service was reset along with the document
+                m_shown.clear();
+            });
+    });
+}
+
+void PdfPageView::setRenderService(PageRenderService* svc) {
+    if (m_renderer) disconnect(m_renderer, nullptr, this, nullptr);
+    m_renderer = svc;
+    m_requested.clear();
+    m_shown.clear();
+    if (m_renderer)
+        connect(m_renderer, &PageRenderService::pageReady, this, &PdfPageView::onPageReady);
+    viewport()->update();
+}
+
+void PdfPageView::setSearchEngine(SearchEngine* engine) {
+    if (m_search) disconnect(m_search, nullptr, this, nullptr);
+    m_search = engine;
+    m_currentHit = -1;
+    if (m_search) {
+        connect(m_search, &SearchEngine::started, this, [this] {
+            m_currentHit = -1;
+            viewport()->update();
+        });
+        connect(m_search, &SearchEngine::hitsAdded, this, [this](int first, int count) {
+            const auto &hits = m_search->hits();
+            for (int i = first; i < first + count; ++i) {
+                const QRect r = pageViewportRect(hits[i].page);
+                if (!r.isNull()) viewport()->update(r);
+            }
+        });
+    }
+    viewport()->update();
+}
+
+void PdfPageView::setCurrentSearchHit(int index) {
+    if (index == m_currentHit) return;
+    m_currentHit = index;
+    viewport()->update();
+}
+
+// --- layout (kept in step with QPdfViewPrivate::calculateDocumentLayout) ---
+
+int PdfPageView::firstLaidOutPage() const {
+    if (pageMode() == PageMode::SinglePage)
+        return pageNavigator() ? pageNavigator()->currentPage() : 0;
+    return 0;
+}
+
+int PdfPageView::lastLaidOutPage() const {
+    if (!document()) return -1;
+    if (pageMode() == PageMode::SinglePage) return firstLaidOutPage();
+    return document()->pageCount() - 1;
+}
+
+QSize PdfPageView::pageSizeAt(int page, qreal* outScale) const {
+    const QSizeF pts = m_renderer ? m_renderer->pagePointSize(page) : document()->pagePointSize(page);
+    const QMargins m = documentMargins();
+    const QSize vp = viewport()->size();
+    QSize size;
+    qreal scale = zoomFactor();
+
+    switch (zoomMode()) {
+    case ZoomMode::Custom:
+        size = QSizeF(pts * m_screenResolution * zoomFactor()).toSize();
+        break;
+    case ZoomMode::FitToWidth:
+        size = QSizeF(pts * m_screenResolution).toSize();
+        scale = size.width() > 0 ? qreal(vp.width() - m.left() - m.right()) / size.width() : 1.0;
+        size *= scale;
+        break;
+    case ZoomMode::FitInView: {
+        const QSize avail = vp + QSize(-m.left() - m.right(), -pageSpacing());
+        size = QSizeF(pts * m_screenResolution).toSize().scaled(avail, Qt::KeepAspectRatio);
+        scale = pts.width() > 0 ? size.width() / (pts.width() * m_screenResolution) : 1.0;
+        break;
+    }
+    }
+    if (outScale) *outScale = scale;
+    return size;
+}
+
+// Rebuilt only when something it depends on changed; otherwise every lookup
+// below is O(1) or a binary search.
+const PdfPageView::Layout& PdfPageView::layout() const {
+    QPdfDocument* doc = document();
+    const bool ready = doc && doc->status() == QPdfDocument::Status::Ready;
+    const int first = ready ? firstLaidOutPage() : 0;
+    const int last = ready ? lastLaidOutPage() : -1;
+
+    Layout& l = m_layout;
+    if (l.doc == doc && l.first == first && l.last == last && l.zoomMode == zoomMode()
+        && l.zoom == zoomFactor() && l.viewport == viewport()->size()
+        && l.margins == documentMargins() && l.spacing == pageSpacing())
+        return l;
+
+    l = Layout();
+    l.doc = doc;
+    l.first = first;
+    l.last = last;
+    l.zoomMode = zoomMode();
+    l.zoom = zoomFactor();
+    l.viewport = viewport()->size();
+    l.margins = documentMargins();
+    l.spacing = pageSpacing();
+
+    const int n = qMax(0, last - first + 1);
+    l.tops.resize(n + 1);
+    l.sizes.resize(n);
+    l.scales.resize(n);
+    int y = l.margins.top();
+    for (int i = 0; i < n; ++i) {
+        qreal scale = 1.0;
+        const QSize s = pageSizeAt(first + i, &scale);
+        l.tops[i] = y;
+        l.sizes[i] = s;
+        l.scales[i] = scale;
+        l.width = qMax(l.width, s.width());
+        y += s.height() + l.spacing;
+    }
+    l.tops[n] = y;
+    l.width += l.margins.left() + l.margins.right();
+    return l;
+}
+
+QRect PdfPageView::pageDocumentRect(int page) const {
+    const Layout& l = layout();
+    if (page < l.first || page > l.last) return {};
+    const int i = page - l.first;
+    const QSize s = l.sizes[i];
+    const int x = (qMax(l.width, viewport()->width()) - s.width()) / 2;
+    return QRect(QPoint(x, l.tops[i]), s);
+}
+
+QPair<int, int> PdfPageView::pagesInRows(int y0, int y1) const {
+    const Layout& l = layout();
+    const int n = int(l.sizes.size());
+    if (n == 0 || y1 <= y0) return { 0, -1 };
+
+    // last page starting at or above y0; step past it if y0 is in the gap below it
+    int i = int(std::upper_bound(l.tops.cbegin(), l.tops.cbegin() + n, y0) - l.tops.cbegin()) - 1;
+    i = qMax(0, i);
+    if (l.tops[i] + l.sizes[i].height() <= y0) ++i;
+    if (i >= n || l.tops[i] >= y1) return { 0, -1 };
+
+    int j = i;
+    while (j + 1 < n && l.tops[j + 1] < y1) ++j;
+    return { l.first + i, l.first + j };
+}
+
+QRect PdfPageView::pageViewportRect(int page) const {
+    const QRect r = pageDocumentRect(page);
+    if (r.isNull()) return r;
+    return r.translated(-horizontalScrollBar()->value(), -verticalScrollBar()->value());
+}
+
+qreal PdfPageView::pageScale(int page) const {
+    if (!document() || page < 0 || page >= document()->pageCount()) return 1.0;
+    const Layout& l = layout();
+    if (page >= l.first && page <= l.last) return l.scales[page - l.first] * m_screenResolution;
+    qreal zoom = 1.0;   // not laid out (single page mode): the prefetcher still wants its scale
+    pageSizeAt(page, &zoom);
+    return zoom * m_screenResolution;
+}
+
+QList<int> PdfPageView::visiblePages() const {
+    QList<int> pages;
+    const QRect vp = viewport()->rect();
+    const int top = verticalScrollBar()->value();
+    const auto range = pagesInRows(top, top + vp.height());
+    for (int p = range.first; p <= range.second; ++p)
+        if (pageViewportRect(p).intersects(vp)) pages << p;
+    return pages;
+}
+
+bool PdfPageView::mapViewportToPage(const QPoint& vpPos, int* outPage, QPointF* outPagePt) const {
+    const int y = vpPos.y() + verticalScrollBar()->value();
+    const auto range = pagesInRows(y, y + 1);
+    for (int p = range.first; p <= range.second; ++p) {
+        const QRect r = pageViewportRect(p);
+        if (!r.contains(vpPos)) continue;
+        const qreal s = pageScale(p);
+        if (outPage) *outPage = p;
+        if (outPagePt) *outPagePt = QPointF(vpPos - r.topLeft()) / s;
+        return true;
+    }
+    return false;
+}
+
+// --- scrolling ---
+
+void PdfPageView::scrolled(int value) {
+    const int dy = value - m_lastScrollValue;
+    m_lastScrollValue = value;
+    if (pageMode() != PageMode::MultiPage) return;
+
+    // a first step after a pause says nothing about speed
+    const qint64 ms = m_scrollClock.isValid() ? m_scrollClock.restart() : kSettleMs;
+    if (!m_scrollClock.isValid()) m_scrollClock.start();
+    if (ms < kSettleMs) {
+        const qreal speed = qAbs(dy) / qreal(qMax<qint64>(ms, 1));
+        m_scrollSpeed = kScrollSmoothing * speed + (1 - kScrollSmoothing) * m_scrollSpeed;
+        if (m_scrollSpeed > kFastScrollPxPerMs) m_fastScroll = true;
+    }
+    m_settleTimer->start();
+}
+
+void PdfPageView::scrollSettled() {
+    m_scrollSpeed = 0;
+    m_scrollClock.invalidate();
+    if (!m_fastScroll) return;
+    m_fastScroll = false;
+    viewport()->update();   // repaint asks for the sharp renders
+}
+
+// Indices of the tiles of a page (laid out at pageRect, rendered at pagePx)
+// that cover area, as a rect in tile units; empty if none.
+QRect PdfPageView::tilesCovering(const QRect& pageRect, const QSize& pagePx, const QRect& area) {
+    const QRect hit = pageRect & area;
+    if (hit.isEmpty() || pageRect.isEmpty() || pagePx.isEmpty()) return {};
+    const qreal kx = qreal(pagePx.width()) / pageRect.width();
+    const qreal ky = qreal(pagePx.height()) / pageRect.height();
+    const int t = PageRenderService::kTileSize;
+    const int x0 = int((hit.left() - pageRect.left()) * kx) / t;
+    const int y0 = int((hit.top() - pageRect.top()) * ky) / t;
+    const int x1 = qBound(x0, int((hit.right() + 1 - pageRect.left()) * kx - 1) / t, (pagePx.width() - 1) / t);
+    const int y1 = qBound(y0, int((hit.bottom() + 1 - pageRect.top()) * ky - 1) / t, (pagePx.height() - 1) / t);
+    return QRect(QPoint(x0, y0), QPoint(x1, y1));
+}
+
+void PdfPageView::updateRequests() {
+    QPdfDocument* doc = document();
+    if (!m_renderer || !doc || doc->status() != QPdfDocument::Status::Ready) return;
+
+    const qreal dpr = devicePixelRatioF();
+    const int top = verticalScrollBar()->value();
+    const int height = viewport()->height();
+    const int margin = pageMode() == PageMode::MultiPage ? height / 2 : 0;
+    const auto visible = pagesInRows(top, top + height);
+    const auto around = pagesInRows(top - margin, top + height + margin);
+    const QRect vp = viewport()->rect();
+    const QRect vpAround = vp.adjusted(0, -margin, 0, margin);
+
+    QSet<RenderKey> wanted;
+    QSet<RenderKey> shown;   // what the user is looking at, sharp
+    auto want = [&](const RenderKey& key, bool onScreen) {
+        if (m_renderer->contains(key)) return;
+        m_renderer->request(key, onScreen ? PageRenderService::Priority::Visible
+                                          : PageRenderService::Priority::Prefetch);
+        wanted.insert(key);
+    };
+
+    for (int p = around.first; p <= around.second; ++p) {
+        const qreal scale = pageScale(p) * dpr;
+        const bool onScreen = p >= visible.first && p <= visible.second;
+
+        if (m_renderer->needsTiles(p, scale)) {
+            // a preview of the whole page to pan over, then the tiles in view
+            want(m_renderer->previewKeyFor(p, scale), onScreen);
+            if (m_fastScroll) continue;
+            const QRect r = pageViewportRect(p);
+            const QSize px = m_renderer->pixelSize(p, scale);
+            const QRect onScreenTiles = tilesCovering(r, px, vp);
+            const QRect tiles = tilesCovering(r, px, vpAround);
+            for (int ty = tiles.top(); ty <= tiles.bottom(); ++ty) {
+                for (int tx = tiles.left(); tx <= tiles.right(); ++tx) {
+                    const RenderKey key = PageRenderService::tileKeyFor(p, scale, tx, ty);
+                    const bool tileOnScreen = onScreenTiles.contains(tx, ty);
+                    if (tileOnScreen) shown.insert(key);
+                    want(key, tileOnScreen);
+                }
+            }
+            continue;
+        }
+
+        const RenderKey sharp = PageRenderService::keyFor(p, scale);
+        if (onScreen && !m_fastScroll) shown.insert(sharp);
+        if (m_renderer->contains(sharp)) continue;
+        want(m_fastScroll ? m_renderer->previewKeyFor(p, scale) : sharp, onScreen);
+    }
+    // pages (or tiles, or zoom levels) left behind before their turn came: don't render them after all
+    for (const RenderKey& key : std::as_const(m_requested))
+        if (!wanted.contains(key)) m_renderer->cancel(key);
+    m_requested = wanted;
+    // hit rate: each page or tile once as it comes into view, not on every repaint
+    for (const RenderKey& key : std::as_const(shown))
+        if (!m_shown.contains(key)) m_renderer->countShown(key);
+    m_shown = shown;
+}
+
+// --- painting ---
+
+// The best whole-page image we have short of the right one: the preview, else
+// any other scale (say, the one from before a zoom step), drawn stretched.
+bool PdfPageView::paintStandIn(QPainter& painter, int page, const QRect& r, qreal scale) {
+    const QImage* img = m_renderer->cached(m_renderer->previewKeyFor(page, scale));
+    if (!img) img = m_renderer->anyCached(page);
+    if (!img) return false;
+    painter.drawImage(r, *img);
+    return true;
+}
+
+void PdfPageView::paintEvent(QPaintEvent* ev) {
+    TRACE_SPAN("view", "paint");
+    QPainter painter(viewport());
+    painter.fillRect(ev->rect(), palette().brush(QPalette::Dark));
+
+    QPdfDocument* doc = document();
+    if (!doc || doc->status() != QPdfDocument::Status::Ready || !m_renderer) return;
+
+    updateRequests();
+
+    const qreal dpr = devicePixelRatioF();
+    const int top = verticalScrollBar()->value();
+    const auto pages = pagesInRows(ev->rect().top() + top, ev->rect().bottom() + 1 + top);
+    for (int page = pages.first; page <= pages.second; ++page) {
+        const QRect r = pageViewportRect(page);
+        if (!r.intersects(ev->rect())) continue;
+
+        const qreal scale = pageScale(page);
+        const qreal renderScale = scale * dpr;
+        if (m_renderer->needsTiles(page, renderScale)) {
+            if (!paintStandIn(painter, page, r, renderScale)) painter.fillRect(r, kPlaceholder);
+            // tiles that are in go on top; the stand-in shows through the gaps
+            const QSize px = m_renderer->pixelSize(page, renderScale);
+            const qreal kx = qreal(r.width()) / px.width(), ky = qreal(r.height()) / px.height();
+            const QRect tiles = tilesCovering(r, px, ev->rect());
+            for (int ty = tiles.top(); ty <= tiles.bottom(); ++ty) {
+                for (int tx = tiles.left(); tx <= tiles.right(); ++tx) {
+                    const RenderKey key = PageRenderService::tileKeyFor(page, renderScale, tx, ty);
+                    const QImage* img = m_renderer->cached(key);
+                    if (!img) continue;
+                    const QRect t = PageRenderService::tileRect(key, px);
+                    painter.drawImage(QRectF(r.x() + t.x() * kx, r.y() + t.y() * ky,
+                                             t.width() * kx, t.height() * ky), *img);
+                }
+            }
+        } else if (const QImage* img = m_renderer->cached(PageRenderService::keyFor(page, renderScale))) {
+            painter.drawImage(r, *img);
+        } else if (!paintStandIn(painter, page, r, renderScale)) {
+            painter.fillRect(r, kPlaceholder);    // shown until the worker delivers
+        }
+
+        if (m_search && m_search->count() > 0) {
+            const QTransform toView = QTransform::fromTranslate(r.x(), r.y()).scale(scale, scale);
+            const auto &hits = m_search->hits();
+            const auto range = m_search->hitsOnPage(page);
+            for (int i = range.first; i < range.second; ++i)
+                for (const QRectF& rc : hits[i].rects)
+                    painter.fillRect(toView.mapRect(rc), kSearchHit);
+
+            if (m_currentHit >= range.first && m_currentHit < range.second) {
+                painter.setPen(QPen(kCurrentHit, 2));
+                for (const QRectF& rc : hits[m_currentHit].rects)
+                    painter.drawRect(toView.mapRect(rc));
+            }
+        }
+    }
+}
+
+void PdfPageView::onPageReady(const RenderKey& key) {
+    QRect r = pageViewportRect(key.page);
+    if (r.isNull()) return;
+    if (key.isTile()) {
+        // just the tile's footprint
+        const QSize px = m_renderer->pixelSize(key.page, key.scale(), key.rotation);
+        if (px.isEmpty()) return;
+        const QRect t = PageRenderService::tileRect(key, px);
+        const qreal kx = qreal(r.width()) / px.width(), ky = qreal(r.height()) / px.height();
+        r = QRectF(r.x() + t.x() * kx, r.y() + t.y() * ky, t.width() * kx, t.height() * ky).toAlignedRect();
+    }
+    if (r.intersects(viewport()->rect()))
+        viewport()->update(r);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <QtPdfWidgets/QPdfView>
+#include <QRect>
+#include <QPointF>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QVector>
+
+#include "pagerenderer.h"
+
+class QPainter;
+class QTimer;
+
+class SearchEngine;
+
+// QPdfView that paints pages out of PageRenderService instead of rendering them
+// itself. Navigation, zoom modes and scrolling stay with QPdfView; we only take
+// over paintEvent() (pages and search hits), so the layout below mirrors QPdfView's own.
+//
+// In MultiPage (continuous) mode only the pages intersecting the viewport, plus
+// a margin, are ever requested. The layout is cached as prefix sums, so finding
+// them is a binary search however long the document is. While the user scrolls
+// fast we ask for cheap low-res renders only and upgrade once scrolling settles.
+// Until the right render lands (after a zoom step, say) a page is drawn from
+// whatever scale of it is cached; at high zoom only the visible tiles are rendered.
+class PdfPageView : public QPdfView {
+    Q_OBJECT
+public:
+    explicit PdfPageView(QWidget* parent = nullptr);
+
+    void setRenderService(PageRenderService* svc);
+    PageRenderService* renderService() const { return m_renderer; }
+
+    // Search hits are painted from the engine as they stream in.
+    void setSearchEngine(SearchEngine* engine);
+    void setCurrentSearchHit(int index);
+    int currentSearchHit() const { return m_currentHit; }
+
+    // Page rectangle in viewport coordinates, or a null rect if the page isn't laid out.
+    QRect pageViewportRect(int page) const;
+    // Device-independent pixels per PDF point for the page at the current zoom.
+    qreal pageScale(int page) const;
+    // Pages whose rectangle intersects the viewport.
+    QList<int> visiblePages() const;
+    // Viewport position -> page index + position in page points (top-left origin).
+    bool mapViewportToPage(const QPoint& vpPos, int* outPage, QPointF* outPagePt) const;
+
+    bool isFastScrolling() const { return m_fastScroll; }
+
+protected:
+    void paintEvent(QPaintEvent* ev) override;
+
+private:
+    // Everything the layout depends on; a mismatch means rebuild.
+    struct Layout {
+        const QPdfDocument* doc = nullptr;
+        int       first = 0, last = -1;    // laid-out page range
+        ZoomMode  zoomMode = ZoomMode::Custom;
+        qreal     zoom = 0;
+        QSize     viewport;
+        QMargins  margins;
+        int       spacing = 0;
+
+        int            width = 0;          // document width incl. margins
+        QVector<int>   tops;               // y of page first+i; one extra entry past the end
+        QVector<QSize> sizes;
+        QVector<qreal> scales;             // zoom factor per page (before screen resolution)
+    };
+    const Layout& layout() const;
+
+    QRect pageDocumentRect(int page) const;   // in scrolled document coordinates
+    int firstLaidOutPage() const;
+    int lastLaidOutPage() const;
+    QSize pageSizeAt(int page, qreal* outScale) const;
+    // Laid-out pages overlapping document rows [y0, y1); first > last if none.
+    QPair<int, int> pagesInRows(int y0, int y1) const;
+    // What paintEvent() wants for the current scroll position: visible pages at
+    // full (or, while flinging, low) resolution, the margin as prefetches.
+    void updateRequests();
+    static QRect tilesCovering(const QRect& pageRect, const QSize& pagePx, const QRect& area);
+    bool paintStandIn(QPainter& painter, int page, const QRect& r, qreal scale);
+    void scrolled(int value);
+    void scrollSettled();
+    void onPageReady(const RenderKey& key);
+
+    PageRenderService* m_renderer = nullptr;
+    SearchEngine*      m_search = nullptr;
+    int                m_currentHit = -1;
+    qreal m_screenResolution = 1.0;   // logical DPI / 72, same as QPdfView
+    mutable Layout m_layout;
+
+    // fast-scroll detection
+    bool          m_fastScroll = false;
+    int           m_lastScrollValue = 0;
+    qreal         m_scrollSpeed = 0;   // px/ms, smoothed
+    QElapsedTimer m_scrollClock;
+    QTimer*       m_settleTimer = nullptr;
+    QMetaObject::Connection m_docStatus;   // layout goes stale when the document reloads
+    QSet<RenderKey> m_requested;       // what updateRequests() last asked for
+    QSet<RenderKey> m_shown;           // sharp pages/tiles on screen then, counted in the render stats
+};
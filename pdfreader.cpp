@@ -0,0 +1,706 @@
+#include "pdfreader.h"
+
+#include <QSet>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+#include <functional>
+
+namespace {
+constexpr int kMaxDepth = 64;          // nesting of arrays/dicts, /Prev chains, page tree
+constexpr qint64 kTailScan = 1024;     // startxref lives in the last KB
+
+bool isWhite(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0'; }
+bool isDelim(char c) { return std::strchr("()<>[]{}/%", c) != nullptr && c != '\0'; }
+bool isRegular(char c) { return !isWhite(c) && !isDelim(c); }
+
+// Tokenizer/parser for the object syntax. Works on any buffer: the mapped file
+// or a decompressed object stream.
+class Parser {
+public:
+    Parser(const char* data, qint64 size, qint64 pos = 0) : m_p(data), m_size(size), m_pos(pos) {}
+
+    qint64 pos() const { return m_pos; }
+    void seek(qint64 pos) { m_pos = pos; }
+    bool atEnd() const { return m_pos >= m_size; }
+    bool ok() const { return m_ok; }
+
+    void skipWhitespace() {
+        while (m_pos < m_size) {
+            const char c = m_p[m_pos];
+            if (isWhite(c)) { ++m_pos; continue; }
+            if (c == '%') {
+                while (m_pos < m_size && m_p[m_pos] != '\n' && m_p[m_pos] != '\r') ++m_pos;
+                continue;
+            }
+            break;
+        }
+    }
+
+    // Next token is kw (followed by a delimiter or the end); consumed if consume.
+    bool keyword(const char* kw, bool consume = true) {
+        skipWhitespace();
+        const qint64 n = qint64(std::strlen(kw));
+        if (m_pos + n > m_size || std::memcmp(m_p + m_pos, kw, size_t(n)) != 0) return false;
+        if (m_pos + n < m_size && isRegular(m_p[m_pos + n])) return false;
+        if (consume) m_pos += n;
+        return true;
+    }
+
+    bool readInt(qint64* out) {
+        skipWhitespace();
+        qint64 at = m_pos;
+        bool neg = false;
+        if (at < m_size && (m_p[at] == '+' || m_p[at] == '-')) neg = m_p[at++] == '-';
+        const qint64 digits = at;
+        qint64 v = 0;
+        while (at < m_size && m_p[at] >= '0' && m_p[at] <= '9' && at - digits < 18)
+            v = v * 10 + (m_p[at++] - '0');
+        if (at == digits || (at < m_size && isRegular(m_p[at]))) return false;
+        m_pos = at;
+        *out = neg ? -v : v;
+        return true;
+    }
+
+    PdfObject parseObject(int depth = 0) {
+        skipWhitespace();
+        if (atEnd() || depth > kMaxDepth) return failed();
+        const char c = m_p[m_pos];
+        switch (c) {
+        case '/': return parseName();
+        case '(': return parseLiteralString();
+        case '[': return parseArray(depth);
+        case '<':
+            if (m_pos + 1 < m_size && m_p[m_pos + 1] == '<') return parseDict(depth);
+            return parseHexString();
+        default: break;
+        }
+        if (c == '+' || c == '-' || c == '.' || (c >= '0' && c <= '9')) return parseNumberOrRef();
+        if (keyword("true")) return PdfObject::boolean(true);
+        if (keyword("false")) return PdfObject::boolean(false);
+        if (keyword("null")) return PdfObject();
+        return failed();
+    }
+
+private:
+    PdfObject failed() { m_ok = false; return PdfObject(); }
+
+    PdfObject parseNumberOrRef() {
+        const qint64 start = m_pos;
+        while (m_pos < m_size && isRegular(m_p[m_pos])) ++m_pos;
+        const QByteArray tok = QByteArray::fromRawData(m_p + start, int(m_pos - start));
+        if (tok.contains('.')) {
+            bool ok = false;
+            const double v = tok.toDouble(&ok);
+            return ok ? PdfObject::real(v) : failed();
+        }
+        bool ok = false;
+        const qint64 v = tok.toLongLong(&ok);
+        if (!ok) return failed();
+
+        // "num gen R"?
+        if (v > 0) {
+            const qint64 save = m_pos;
+            qint64 gen = 0;
+            if (readInt(&gen) && gen >= 0 && keyword("R")) return PdfObject::ref({int(v), int(gen)});
+            m_pos = save;
+        }
+        return PdfObject::integer(v);
+    }
+
+    PdfObject parseName() {
+        ++m_pos;   // '/'
+        QByteArray name;
+        while (m_pos < m_size && isRegular(m_p[m_pos])) {
+            const char c = m_p[m_pos++];
+            if (c == '#' && m_pos + 1 < m_size) {
+                bool ok = false;
+                const int v = QByteArray(m_p + m_pos, 2).toInt(&ok, 16);
+                if (ok) { name += char(v); m_pos += 2; continue; }
+            }
+            name += c;
+        }
+        return PdfObject::name(name);
+    }
+
+    PdfObject parseLiteralString() {
+        ++m_pos;   // '('
+        QByteArray s;
+        int nesting = 0;
+        while (m_pos < m_size) {
+            char c = m_p[m_pos++];
+            if (c == '(') ++nesting;
+            else if (c == ')') {
+                if (nesting-- == 0) return PdfObject::string(s);
+            } else if (c == '\\' && m_pos < m_size) {
+                c = m_p[m_pos++];
+                switch (c) {
+                case 'n': s += '\n'; continue;
+                case 'r': s += '\r'; continue;
+                case 't': s += '\t'; continue;
+                case 'b': s += '\b'; continue;
+                case 'f': s += '\f'; continue;
+                case '\r':   // line continuation
+                    if (m_pos < m_size && m_p[m_pos] == '\n') ++m_pos;
+                    continue;
+                case '\n': continue;
+                default: break;
+                }
+                if (c >= '0' && c <= '7') {
+                    int v = c - '0';
+                    for (int i = 0; i < 2 && m_pos < m_size && m_p[m_pos] >= '0' && m_p[m_pos] <= '7'; ++i)
+                        v = v * 8 + (m_p[m_pos++] - '0');
+                    s += char(v);
+                    continue;
+                }
+            }
+            s += c;
+        }
+        return failed();
+    }
+
+    PdfObject parseHexString() {
+        ++m_pos;   // '<'
+        QByteArray hex;
+        while (m_pos < m_size && m_p[m_pos] != '>') {
+            if (!isWhite(m_p[m_pos])) hex += m_p[m_pos];
+            ++m_pos;
+        }
+        if (atEnd()) return failed();
+        ++m_pos;
+        if (hex.size() % 2) hex += '0';
+        return PdfObject::string(QByteArray::fromHex(hex));
+    }
+
+    PdfObject parseArray(int depth) {
+        ++m_pos;   // '['
+        PdfObject arr = PdfObject::array();
+        for (;;) {
+            skipWhitespace();
+            if (atEnd()) return failed();
+            if (m_p[m_pos] == ']') { ++m_pos; return arr; }
+            const PdfObject item = parseObject(depth + 1);
+            if (!m_ok) return PdfObject();
+            arr.append(item);
+        }
+    }
+
+    PdfObject parseDict(int depth) {
+        m_pos += 2;   // '<<'
+        PdfObject dict = PdfObject::dict();
+        for (;;) {
+            skipWhitespace();
+            if (m_pos + 1 < m_size && m_p[m_pos] == '>' && m_p[m_pos + 1] == '>') { m_pos += 2; return dict; }
+            if (atEnd() || m_p[m_pos] != '/') return failed();
+            const QByteArray key = parseName().bytes();
+            const PdfObject value = parseObject(depth + 1);
+            if (!m_ok) return PdfObject();
+            if (!value.isNull()) dict.insert(key, value);   // a null value means "absent"
+        }
+    }
+
+    const char* m_p;
+    qint64 m_size;
+    qint64 m_pos;
+    bool m_ok = true;
+};
+
+QByteArray inflate(const QByteArray& data) {
+    // qUncompress wants zlib data behind a big-endian size hint; it grows the
+    // buffer itself if the hint is short
+    QByteArray buf(4, '\0');
+    qToBigEndian<quint32>(quint32(qBound<qint64>(1024, qint64(data.size()) * 4, 64 << 20)), buf.data());
+    buf += data;
+    return qUncompress(buf);
+}
+
+// PNG row predictors (/Predictor 10..15), as used by xref and object streams.
+bool unpredictPng(QByteArray& data, int colors, int bpc, int columns) {
+    const int bpp = qMax(1, colors * bpc / 8);
+    const int rowLen = (colors * bpc * columns + 7) / 8;
+    if (rowLen <= 0) return false;
+    const int rows = int(data.size() / (rowLen + 1));
+    QByteArray out(qsizetype(rows) * rowLen, '\0');
+    const uchar* in = reinterpret_cast<const uchar*>(data.constData());
+    uchar* o = reinterpret_cast<uchar*>(out.data());
+    for (int r = 0; r < rows; ++r) {
+        const int filter = *in++;
+        uchar* row = o + qsizetype(r) * rowLen;
+        const uchar* up = r ? row - rowLen : nullptr;
+        for (int i = 0; i < rowLen; ++i) {
+            const int a = i >= bpp ? row[i - bpp] : 0;
+            const int b = up ? up[i] : 0;
+            const int c = (up && i >= bpp) ? up[i - bpp] : 0;
+            int v = in[i];
+            switch (filter) {
+            case 0: break;
+            case 1: v += a; break;
+            case 2: v += b; break;
+            case 3: v += (a + b) / 2; break;
+            case 4: {
+                const int p = a + b - c;
+                const int pa = qAbs(p - a), pb = qAbs(p - b), pc = qAbs(p - c);
+                v += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+            default: return false;
+            }
+            row[i] = uchar(v);
+        }
+        in += rowLen;
+    }
+    data = out;
+    return true;
+}
+
+QRectF rectFrom(const PdfObject& arr) {
+    if (!arr.isArray() || arr.size() != 4) return QRectF();
+    const double x0 = arr.at(0).toReal(), y0 = arr.at(1).toReal();
+    const double x1 = arr.at(2).toReal(), y1 = arr.at(3).toReal();
+    return QRectF(QPointF(qMin(x0, x1), qMin(y0, y1)), QPointF(qMax(x0, x1), qMax(y0, y1)));
+}
+
+void appendReal(QByteArray& out, double v) {
+    if (v == qint64(v) && qAbs(v) < 1e15) { out += QByteArray::number(qint64(v)); return; }
+    QByteArray s = QByteArray::number(v, 'f', 4);
+    while (s.endsWith('0')) s.chop(1);
+    if (s.endsWith('.')) s.chop(1);
+    out += s;
+}
+}
+
+// --- PdfObject ---------------------------------------------------------------
+
+PdfObject PdfObject::boolean(bool v) { PdfObject o; o.m_type = Type::Bool; o.m_int = v; return o; }
+PdfObject PdfObject::integer(qint64 v) { PdfObject o; o.m_type = Type::Int; o.m_int = v; return o; }
+PdfObject PdfObject::real(double v) { PdfObject o; o.m_type = Type::Real; o.m_real = v; return o; }
+PdfObject PdfObject::string(const QByteArray& b) { PdfObject o; o.m_type = Type::String; o.m_bytes = b; return o; }
+PdfObject PdfObject::name(const QByteArray& n) { PdfObject o; o.m_type = Type::Name; o.m_bytes = n; return o; }
+PdfObject PdfObject::ref(PdfRef r) { PdfObject o; o.m_type = Type::Ref; o.m_ref = r; return o; }
+PdfObject PdfObject::array() { PdfObject o; o.m_type = Type::Array; return o; }
+PdfObject PdfObject::dict() { PdfObject o; o.m_type = Type::Dict; return o; }
+
+PdfObject PdfObject::stream(const PdfObject& dict, qint64 offset, qint64 length) {
+    PdfObject o = dict;
+    o.m_type = Type::Stream;
+    o.m_int = offset;
+    o.m_length = length;
+    return o;
+}
+
+void PdfObject::append(const PdfObject& o) { m_items.push_back(o); }
+
+PdfObject PdfObject::value(const QByteArray& key) const {
+    for (const PdfDictEntry& e : m_entries)
+        if (e.key == key) return e.value;
+    return PdfObject();
+}
+
+bool PdfObject::contains(const QByteArray& key) const {
+    for (const PdfDictEntry& e : m_entries)
+        if (e.key == key) return true;
+    return false;
+}
+
+void PdfObject::insert(const QByteArray& key, const PdfObject& v) {
+    for (PdfDictEntry& e : m_entries)
+        if (e.key == key) { e.value = v; return; }
+    m_entries.push_back({key, v});
+}
+
+void PdfObject::remove(const QByteArray& key) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        if (it->key == key) { m_entries.erase(it); return; }
+}
+
+QByteArray PdfObject::serialize() const {
+    QByteArray out;
+    serializeTo(out);
+    return out;
+}
+
+void PdfObject::serializeTo(QByteArray& out) const {
+    switch (m_type) {
+    case Type::Null: out += "null"; break;
+    case Type::Bool: out += m_int ? "true" : "false"; break;
+    case Type::Int: out += QByteArray::number(m_int); break;
+    case Type::Real: appendReal(out, m_real); break;
+    case Type::String: out += '<' + m_bytes.toHex() + '>'; break;
+    case Type::Name:
+        out += '/';
+        for (char c : m_bytes) {
+            if (uchar(c) < 0x21 || uchar(c) > 0x7e || isDelim(c) || c == '#')
+                out += '#' + QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+            else
+                out += c;
+        }
+        break;
+    case Type::Ref: out += QByteArray::number(m_ref.num) + ' ' + QByteArray::number(m_ref.gen) + " R"; break;
+    case Type::Array:
+        out += '[';
+        for (size_t i = 0; i < m_items.size(); ++i) {
+            if (i) out += ' ';
+            m_items[i].serializeTo(out);
+        }
+        out += ']';
+        break;
+    case Type::Dict:
+    case Type::Stream:
+        out += "<<";
+        for (const PdfDictEntry& e : m_entries) {
+            PdfObject::name(e.key).serializeTo(out);
+            out += ' ';
+            e.value.serializeTo(out);
+        }
+        out += ">>";
+        break;
+    }
+}
+
+// --- PdfPage -----------------------------------------------------------------
+
+QSizeF PdfPage::displaySize() const {
+    return (rotate == 90 || rotate == 270) ? box.size().transposed() : box.size();
+}
+
+QPointF PdfPage::toUserSpace(const QPointF& pt) const {
+    const qreal u = pt.x(), v = pt.y();
+    switch (rotate) {
+    case 90:  return QPointF(box.left() + v, box.top() + u);        // box.top() is lly (y up)
+    case 180: return QPointF(box.right() - u, box.top() + v);
+    case 270: return QPointF(box.right() - v, box.bottom() - u);
+    default:  return QPointF(box.left() + u, box.bottom() - v);
+    }
+}
+
+// --- PdfReader ---------------------------------------------------------------
+
+bool PdfReader::fail(const QString& msg) {
+    close();
+    m_error = msg;
+    return false;
+}
+
+bool PdfReader::open(const QString& path) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) return fail(m_file.errorString());
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data) return fail("Cannot map the file.");
+    if (m_size < 8 || std::memcmp(m_data, "%PDF-", 5) != 0) return fail("Not a PDF file.");
+
+    // startxref <offset> %%EOF, somewhere in the tail
+    const char* p = reinterpret_cast<const char*>(m_data);
+    const qint64 from = qMax<qint64>(0, m_size - kTailScan);
+    const QByteArray tail = QByteArray::fromRawData(p + from, int(m_size - from));
+    const int at = tail.lastIndexOf("startxref");
+    if (at < 0) return fail("No startxref.");
+    Parser ps(p, m_size, from + at + 9);
+    if (!ps.readInt(&m_startXref) || m_startXref <= 0 || m_startXref >= m_size)
+        return fail("Bad startxref.");
+
+    if (!readXrefSection(m_startXref, 0)) return false;
+    if (!m_trailer.value("Root").isRef()) return fail("The trailer has no /Root.");
+    return true;
+}
+
+void PdfReader::close() {
+    if (m_data) m_file.unmap(const_cast<uchar*>(m_data));
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_error.clear();
+    m_trailer = PdfObject();
+    m_startXref = -1;
+    m_xrefStream = false;
+    m_xref.clear();
+    m_objectStreams.clear();
+}
+
+// Newest section first; entries already set by a newer section win.
+bool PdfReader::readXrefSection(qint64 offset, int depth) {
+    if (depth > kMaxDepth || offset <= 0 || offset >= m_size) return fail("Bad xref offset.");
+
+    PdfObject trailer;
+    Parser ps(reinterpret_cast<const char*>(m_data), m_size, offset);
+    const bool table = ps.keyword("xref", false);
+    if (!(table ? readXrefTable(offset, &trailer) : readXrefStream(offset, &trailer))) return false;
+    if (depth == 0) {
+        m_trailer = trailer;
+        m_xrefStream = !table;
+    }
+
+    const PdfObject prev = trailer.value("Prev");
+    if (prev.isNumber() && prev.toInt() > 0) return readXrefSection(prev.toInt(), depth + 1);
+    return true;
+}
+
+void PdfReader::setEntry(int num, const XrefEntry& e) {
+    if (num < 0 || num > 8388607) return;   // the spec's object number limit
+    if (num >= m_xref.size()) m_xref.resize(num + 1);
+    if (m_xref[num].type == -1) m_xref[num] = e;
+}
+
+bool PdfReader::readXrefTable(qint64 offset, PdfObject* trailer) {
+    Parser ps(reinterpret_cast<const char*>(m_data), m_size, offset);
+    ps.keyword("xref");
+    QVector<QPair<int, XrefEntry>> entries;
+    for (;;) {
+        if (ps.keyword("trailer")) break;
+        qint64 first = 0, count = 0;
+        if (!ps.readInt(&first) || !ps.readInt(&count) || first < 0 || count < 0)
+            return fail("Bad xref table.");
+        for (qint64 i = 0; i < count; ++i) {
+            qint64 field = 0, gen = 0;
+            if (!ps.readInt(&field) || !ps.readInt(&gen)) return fail("Bad xref entry.");
+            XrefEntry e;
+            if (ps.keyword("n")) e.type = 1;
+            else if (ps.keyword("f")) e.type = 0;
+            else return fail("Bad xref entry.");
+            e.field = field;
+            e.gen = int(gen);
+            entries.append({int(first + i), e});
+        }
+    }
+    *trailer = ps.parseObject();
+    if (!ps.ok() || !trailer->isDict()) return fail("Bad trailer.");
+
+    // hybrid file: the /XRefStm entries belong to this section and fill in what
+    // the table lists as free (objects that moved into object streams), so
+    // they go in before the table's own entries
+    const PdfObject stm = trailer->value("XRefStm");
+    if (stm.isNumber()) {
+        PdfObject ignored;
+        if (!readXrefStream(stm.toInt(), &ignored)) return false;
+    }
+    for (const auto& e : std::as_const(entries)) setEntry(e.first, e.second);
+    return true;
+}
+
+bool PdfReader::readXrefStream(qint64 offset, PdfObject* trailer) {
+    const PdfObject stm = parseIndirect(offset, -1);
+    if (!stm.isStream() || !stm.value("Type").isName("XRef")) return fail("Bad xref stream.");
+    bool ok = false;
+    const QByteArray data = streamData(stm, &ok);
+    if (!ok) return fail("Cannot decode the xref stream.");
+
+    const PdfObject w = stm.value("W");
+    if (!w.isArray() || w.size() != 3) return fail("Bad /W in xref stream.");
+    const int w0 = int(w.at(0).toInt()), w1 = int(w.at(1).toInt()), w2 = int(w.at(2).toInt());
+    const int rowLen = w0 + w1 + w2;
+    if (w0 < 0 || w1 < 0 || w2 < 0 || rowLen <= 0 || w0 > 8 || w1 > 8 || w2 > 8)
+        return fail("Bad /W in xref stream.");
+
+    PdfObject index = stm.value("Index");
+    if (!index.isArray()) {
+        index = PdfObject::array();
+        index.append(PdfObject::integer(0));
+        index.append(stm.value("Size"));
+    }
+
+    const uchar* row = reinterpret_cast<const uchar*>(data.constData());
+    const uchar* end = row + data.size();
+    auto field = [&row](int at, int width) {
+        qint64 v = 0;
+        for (int i = 0; i < width; ++i) v = (v << 8) | row[at + i];
+        return v;
+    };
+    for (int s = 0; s + 1 < index.size(); s += 2) {
+        const qint64 first = index.at(s).toInt(), count = index.at(s + 1).toInt();
+        for (qint64 i = 0; i < count && row + rowLen <= end; ++i, row += rowLen) {
+            XrefEntry e;
+            e.type = qint8(w0 ? field(0, w0) : 1);   // type defaults to 1 when its width is 0
+            e.field = field(w0, w1);
+            e.gen = int(field(w0 + w1, w2));
+            if (e.type > 2) continue;   // unknown types are treated as null references
+            setEntry(int(first + i), e);
+        }
+    }
+
+    PdfObject t = PdfObject::dict();
+    for (const PdfDictEntry& en : stm.entries())
+        t.insert(en.key, en.value);
+    *trailer = t;
+    return true;
+}
+
+int PdfReader::objectCount() const {
+    return int(qMax<qint64>(m_xref.size(), m_trailer.value("Size").toInt()));
+}
+
+PdfRef PdfReader::refOf(int num) const {
+    if (num <= 0 || num >= m_xref.size()) return {};
+    const XrefEntry& e = m_xref[num];
+    return {num, e.type == 1 ? e.gen : 0};
+}
+
+PdfObject PdfReader::object(int num) const {
+    if (!isOpen() || num <= 0 || num >= m_xref.size()) return PdfObject();
+    const XrefEntry& e = m_xref[num];
+    if (e.type == 1) return parseIndirect(e.field, num);
+    if (e.type == 2) return objectFromStream(int(e.field), e.gen, num);
+    return PdfObject();
+}
+
+PdfObject PdfReader::resolve(const PdfObject& o) const {
+    PdfObject cur = o;
+    for (int i = 0; cur.isRef() && i < kMaxDepth; ++i) cur = object(cur.toRef());
+    return cur.isRef() ? PdfObject() : cur;
+}
+
+// "num gen obj <object> [stream ... endstream]" at offset; num < 0 skips the check.
+PdfObject PdfReader::parseIndirect(qint64 offset, int num) const {
+    if (offset <= 0 || offset >= m_size) return PdfObject();
+    const char* p = reinterpret_cast<const char*>(m_data);
+    Parser ps(p, m_size, offset);
+    qint64 n = 0, gen = 0;
+    if (!ps.readInt(&n) || !ps.readInt(&gen) || !ps.keyword("obj")) return PdfObject();
+    if (num >= 0 && n != num) return PdfObject();
+
+    const PdfObject obj = ps.parseObject();
+    if (!ps.ok()) return PdfObject();
+    if (!obj.isDict() || !ps.keyword("stream")) return obj;
+
+    // data starts after the EOL that follows "stream"
+    qint64 at = ps.pos();
+    if (at < m_size && p[at] == '\r') ++at;
+    if (at < m_size && p[at] == '\n') ++at;
+
+    qint64 len = -1;
+    const PdfObject lenObj = obj.value("Length");
+    if (lenObj.isNumber()) len = lenObj.toInt();
+    else if (lenObj.isRef() && lenObj.toRef().num != num) len = resolve(lenObj).toInt();
+
+    bool lengthOk = len >= 0 && at + len <= m_size;
+    if (lengthOk) {
+        Parser check(p, m_size, at + len);
+        lengthOk = check.keyword("endstream", false);
+    }
+    if (!lengthOk) {
+        // wrong or missing /Length: look for the keyword instead
+        const QByteArray rest = QByteArray::fromRawData(p + at, int(qMin<qint64>(m_size - at, INT_MAX)));
+        const int end = rest.indexOf("endstream");
+        if (end < 0) return PdfObject();
+        len = end;
+        if (len > 0 && p[at + len - 1] == '\n') --len;
+        if (len > 0 && p[at + len - 1] == '\r') --len;
+    }
+    return PdfObject::stream(obj, at, len);
+}
+
+PdfObject PdfReader::objectFromStream(int streamNum, int index, int num) const {
+    auto it = m_objectStreams.find(streamNum);
+    if (it == m_objectStreams.end()) {
+        ObjectStream os;
+        // an object stream can't itself live in an object stream
+        if (streamNum > 0 && streamNum < m_xref.size() && m_xref[streamNum].type == 1) {
+            const PdfObject stm = parseIndirect(m_xref[streamNum].field, streamNum);
+            bool ok = false;
+            if (stm.isStream()) os.data = streamData(stm, &ok);
+            if (ok) {
+                const qint64 n = stm.value("N").toInt();
+                const qint64 first = stm.value("First").toInt();
+                Parser hp(os.data.constData(), os.data.size());
+                for (qint64 i = 0; i < n; ++i) {
+                    qint64 objNum = 0, off = 0;
+                    if (!hp.readInt(&objNum) || !hp.readInt(&off)) break;
+                    os.nums << int(objNum);
+                    os.offsets << first + off;
+                }
+            }
+        }
+        it = m_objectStreams.insert(streamNum, os);
+    }
+
+    const ObjectStream& os = *it;
+    int i = (index >= 0 && index < os.nums.size() && os.nums[index] == num) ? index : int(os.nums.indexOf(num));
+    if (i < 0) return PdfObject();
+    Parser ps(os.data.constData(), os.data.size(), os.offsets[i]);
+    const PdfObject obj = ps.parseObject();
+    return ps.ok() ? obj : PdfObject();
+}
+
+QByteArray PdfReader::rawStreamData(const PdfObject& stream) const {
+    if (!stream.isStream() || stream.streamOffset() + stream.streamLength() > m_size) return QByteArray();
+    return QByteArray(reinterpret_cast<const char*>(m_data) + stream.streamOffset(), int(stream.streamLength()));
+}
+
+QByteArray PdfReader::streamData(const PdfObject& stream, bool* ok) const {
+    if (ok) *ok = false;
+    QByteArray data = rawStreamData(stream);
+
+    PdfObject filters = resolve(stream.value("Filter"));
+    PdfObject parms = resolve(stream.value("DecodeParms"));
+    if (filters.isName()) {
+        PdfObject a = PdfObject::array();
+        a.append(filters);
+        filters = a;
+        PdfObject p = PdfObject::array();
+        p.append(parms);
+        parms = p;
+    }
+    for (int i = 0; i < filters.size(); ++i) {
+        const PdfObject f = filters.at(i);
+        if (!f.isName("FlateDecode") && !f.isName("Fl")) return QByteArray();
+        data = inflate(data);
+        if (data.isEmpty()) return QByteArray();
+
+        const PdfObject parm = parms.isArray() && i < parms.size() ? resolve(parms.at(i)) : PdfObject();
+        const qint64 predictor = parm.isDict() ? parm.value("Predictor").toInt() : 0;
+        if (predictor >= 10) {
+            const PdfObject colors = parm.value("Colors"), bpc = parm.value("BitsPerComponent");
+            const PdfObject columns = parm.value("Columns");
+            if (!unpredictPng(data, colors.isNumber() ? int(colors.toInt()) : 1,
+                              bpc.isNumber() ? int(bpc.toInt()) : 8,
+                              columns.isNumber() ? int(columns.toInt()) : 1))
+                return QByteArray();
+        } else if (predictor > 1) {
+            return QByteArray();   // TIFF predictor: not used for the structures we read
+        }
+    }
+    if (ok) *ok = true;
+    return data;
+}
+
+QVector<PdfPage> PdfReader::pages() const {
+    QVector<PdfPage> out;
+    const PdfObject root = resolve(m_trailer.value("Root"));
+    const PdfObject top = root.value("Pages");
+    if (!top.isRef()) return out;
+
+    struct Inherited { QRectF media, crop; int rotate = 0; };
+    QSet<int> visited;
+    std::function<void(PdfRef, Inherited, int)> walk = [&](PdfRef ref, Inherited inh, int depth) {
+        if (depth > kMaxDepth || visited.contains(ref.num)) return;
+        visited.insert(ref.num);
+        const PdfObject node = object(ref);
+        if (!node.isDict()) return;
+
+        const QRectF media = rectFrom(resolve(node.value("MediaBox")));
+        const QRectF crop = rectFrom(resolve(node.value("CropBox")));
+        const PdfObject rot = resolve(node.value("Rotate"));
+        if (!media.isNull()) inh.media = media;
+        if (!crop.isNull()) inh.crop = crop;
+        if (rot.isNumber()) inh.rotate = int(rot.toInt());
+
+        const PdfObject kids = resolve(node.value("Kids"));
+        if (node.value("Type").isName("Pages") || (kids.isArray() && !node.value("Type").isName("Page"))) {
+            for (int i = 0; i < kids.size(); ++i)
+                if (kids.at(i).isRef()) walk(kids.at(i).toRef(), inh, depth + 1);
+            return;
+        }
+
+        PdfPage page;
+        page.ref = ref;
+        page.box = inh.media.isNull() ? QRectF(0, 0, 612, 792) : inh.media;   // US Letter default
+        if (!inh.crop.isNull()) {
+            const QRectF c = inh.crop.intersected(page.box);
+            if (!c.isEmpty()) page.box = c;
+        }
+        page.rotate = ((inh.rotate % 360) + 360) % 360 / 90 * 90;
+        out << page;
+    };
+    walk(refOf(top.toRef().num), Inherited(), 0);
+    return out;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+#include <vector>
+
+// Just enough of a PDF object reader to patch and restructure files without
+// going through pdfium: xref tables and streams (with /Prev chains and hybrid
+// files), object streams, FlateDecode with PNG predictors and the page tree.
+// Reads from a memory mapping; only the objects asked for get parsed.
+
+struct PdfRef {
+    int num = 0;
+    int gen = 0;
+    bool isValid() const { return num > 0; }
+};
+inline bool operator==(PdfRef a, PdfRef b) { return a.num == b.num && a.gen == b.gen; }
+
+struct PdfDictEntry;
+
+class PdfObject {
+public:
+    enum class Type { Null, Bool, Int, Real, String, Name, Array, Dict, Ref, Stream };
+
+    PdfObject() = default;
+    static PdfObject boolean(bool v);
+    static PdfObject integer(qint64 v);
+    static PdfObject real(double v);
+    static PdfObject string(const QByteArray& bytes);
+    static PdfObject name(const QByteArray& name);
+    static PdfObject ref(PdfRef r);
+    static PdfObject array();
+    static PdfObject dict();
+    // A stream is its dictionary plus where the (still encoded) data sits in the file.
+    static PdfObject stream(const PdfObject& dict, qint64 offset, qint64 length);
+
+    Type type() const { return m_type; }
+    bool isNull() const { return m_type == Type::Null; }
+    bool isNumber() const { return m_type == Type::Int || m_type == Type::Real; }
+    bool isName(const char* n = nullptr) const { return m_type == Type::Name && (!n || m_bytes == n); }
+    bool isArray() const { return m_type == Type::Array; }
+    bool isDict() const { return m_type == Type::Dict || m_type == Type::Stream; }
+    bool isStream() const { return m_type == Type::Stream; }
+    bool isRef() const { return m_type == Type::Ref; }
+
+    bool toBool() const { return m_type == Type::Bool && m_int != 0; }
+    qint64 toInt() const { return m_type == Type::Real ? qint64(m_real) : m_int; }
+    double toReal() const { return m_type == Type::Real ? m_real : double(m_int); }
+    const QByteArray& bytes() const { return m_bytes; }   // String and Name
+    PdfRef toRef() const { return m_ref; }
+
+    // Array
+    int size() const { return int(m_items.size()); }
+    const PdfObject& at(int i) const { return m_items[size_t(i)]; }
+    void append(const PdfObject& o);
+
+    // Dict, or a stream's dictionary
+    PdfObject value(const QByteArray& key) const;   // Null when missing
+    bool contains(const QByteArray& key) const;
+    void insert(const QByteArray& key, const PdfObject& v);
+    void remove(const QByteArray& key);
+    const std::vector<PdfDictEntry>& entries() const { return m_entries; }
+
+    qint64 streamOffset() const { return m_int; }
+    qint64 streamLength() const { return m_length; }
+
+    // PDF syntax for writing the object back out; a stream gives only its dictionary.
+    QByteArray serialize() const;
+
+private:
+    void serializeTo(QByteArray& out) const;
+
+    Type       m_type = Type::Null;
+    qint64     m_int = 0;         // Bool, Int; stream offset
+    double     m_real = 0;
+    qint64     m_length = 0;      // stream data length
+    QByteArray m_bytes;
+    PdfRef     m_ref;
+    std::vector<PdfObject>    m_items;
+    std::vector<PdfDictEntry> m_entries;
+};
+
+struct PdfDictEntry {
+    QByteArray key;
+    PdfObject  value;
+};
+
+struct PdfPage {
+    PdfRef ref;
+    QRectF box;          // crop box clipped to the media box, user space (y up)
+    int    rotate = 0;   // 0, 90, 180 or 270
+
+    QSizeF displaySize() const;
+    // Page points as QPdfDocument reports them (top-left origin, /Rotate applied)
+    // to PDF user space.
+    QPointF toUserSpace(const QPointF& pt) const;
+};
+
+class PdfReader {
+public:
+    PdfReader() = default;
+    ~PdfReader() { close(); }
+    PdfReader(const PdfReader&) = delete;
+    PdfReader& operator=(const PdfReader&) = delete;
+
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    QString errorString() const { return m_error; }
+
+    const uchar* data() const { return m_data; }
+    qint64 size() const { return m_size; }
+
+    const PdfObject& trailer() const { return m_trailer; }
+    qint64 startXref() const { return m_startXref; }
+    bool hasXrefStream() const { return m_xrefStream; }   // newest section is a stream
+    bool isEncrypted() const { return m_trailer.contains("Encrypt"); }
+    int objectCount() const;                              // first unused object number
+
+    PdfObject object(int num) const;
+    PdfObject object(PdfRef ref) const { return object(ref.num); }
+    PdfRef refOf(int num) const;                          // with its current generation
+    PdfObject resolve(const PdfObject& o) const;          // follows references
+    // Stream contents with the filters undone; only FlateDecode is understood.
+    QByteArray streamData(const PdfObject& stream, bool* ok = nullptr) const;
+    QByteArray rawStreamData(const PdfObject& stream) const;
+
+    QVector<PdfPage> pages() const;
+
+private:
+    // type 1: field = byte offset, gen = generation
+    // type 2: field = number of the object stream, gen = index inside it
+    struct XrefEntry {
+        qint8  type = -1;   // -1: not seen yet
+        qint64 field = 0;
+        int    gen = 0;
+    };
+    struct ObjectStream {
+        QByteArray        data;
+        QVector<int>      nums;
+        QVector<qint64>   offsets;   // relative to data
+    };
+
+    bool fail(const QString& msg);
+    bool readXrefSection(qint64 offset, int depth);
+    bool readXrefTable(qint64 offset, PdfObject* trailer);
+    bool readXrefStream(qint64 offset, PdfObject* trailer);
+    void setEntry(int num, const XrefEntry& e);
+    PdfObject parseIndirect(qint64 offset, int num) const;
+    PdfObject objectFromStream(int streamNum, int index, int num) const;
+
+    QFile            m_file;
+    const uchar*     m_data = nullptr;
+    qint64           m_size = 0;
+    QString          m_error;
+    PdfObject        m_trailer;
+    qint64           m_startXref = -1;
+    bool             m_xrefStream = false;
+    QVector<XrefEntry> m_xref;
+    mutable QHash<int, ObjectStream> m_objectStreams;
+};
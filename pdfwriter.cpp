@@ -0,0 +1,205 @@
+#include "pdfwriter.h"
+#include "annotationstore.h"
+#include "trace.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <limits>
+
+namespace {
+bool fail(QString* error, const QString& msg) {
+    if (error) *error = msg;
+    return false;
+}
+
+PdfObject numberArray(std::initializer_list<double> values) {
+    PdfObject a = PdfObject::array();
+    for (double v : values) a.append(PdfObject::real(v));
+    return a;
+}
+
+QByteArray pdfDate(const QDateTime& utc) {
+    return "D:" + utc.toString("yyyyMMddHHmmss").toLatin1() + 'Z';
+}
+
+const char* subtypeFor(MarkupKind kind) {
+    switch (kind) {
+    case MarkupKind::Underline: return "Underline";
+    case MarkupKind::StrikeOut: return "StrikeOut";
+    default:                    return "Highlight";
+    }
+}
+
+// One text-markup annotation. QuadPoints go upper-left, upper-right,
+// lower-left, lower-right as seen on screen, which is what viewers expect
+// for rotated pages too. No /AP: viewers generate the appearance for these
+// subtypes themselves.
+PdfObject markupAnnotation(const AnnotationStore& store, MarkupId id, const PdfPage& page, const QByteArray& stamp) {
+    const AnnotationStore::Quads q = store.quads(id);
+    PdfObject quadPoints = PdfObject::array();
+    constexpr qreal inf = std::numeric_limits<qreal>::infinity();
+    qreal x0 = inf, y0 = inf, x1 = -inf, y1 = -inf;
+    for (int i = 0; i < q.count; ++i) {
+        const QRectF r = q.at(i);
+        for (const QPointF& pt : { r.topLeft(), r.topRight(), r.bottomLeft(), r.bottomRight() }) {
+            const QPointF u = page.toUserSpace(pt);
+            quadPoints.append(PdfObject::real(u.x()));
+            quadPoints.append(PdfObject::real(u.y()));
+            x0 = qMin(x0, u.x()); y0 = qMin(y0, u.y());
+            x1 = qMax(x1, u.x()); y1 = qMax(y1, u.y());
+        }
+    }
+
+    const QColor c = store.color(id);
+    PdfObject a = PdfObject::dict();
+    a.insert("Type", PdfObject::name("Annot"));
+    a.insert("Subtype", PdfObject::name(subtypeFor(store.kind(id))));
+    a.insert("Rect", numberArray({ x0, y0, x1, y1 }));
+    a.insert("QuadPoints", quadPoints);
+    a.insert("C", numberArray({ c.redF(), c.greenF(), c.blueF() }));
+    a.insert("CA", PdfObject::real(c.alphaF()));
+    a.insert("F", PdfObject::integer(4));   // Print
+    a.insert("P", PdfObject::ref(page.ref));
+    a.insert("NM", PdfObject::string("pdfeditor-" + QByteArray::number(id)));
+    a.insert("M", PdfObject::string(stamp));
+    return a;
+}
+}
+
+PdfIncrementalUpdate::PdfIncrementalUpdate(const PdfReader& reader)
+    : m_reader(reader), m_nextNum(qMax(1, reader.objectCount())) {}
+
+PdfRef PdfIncrementalUpdate::allocate() {
+    return { m_nextNum++, 0 };
+}
+
+void PdfIncrementalUpdate::setObject(PdfRef ref, const PdfObject& obj) {
+    m_objects.insert(ref.num, { ref.gen, obj.serialize() });
+}
+
+QByteArray PdfIncrementalUpdate::finish() {
+    QByteArray out;
+    const qint64 base = m_reader.size();
+    const uchar last = base ? m_reader.data()[base - 1] : '\n';
+    if (last != '\n' && last != '\r') out += '\n';
+
+    QMap<int, QPair<int, qint64>> offsets;   // num -> (gen, file offset)
+    for (auto it = m_objects.cbegin(); it != m_objects.cend(); ++it) {
+        offsets.insert(it.key(), { it->first, base + out.size() });
+        out += QByteArray::number(it.key()) + ' ' + QByteArray::number(it->first) + " obj\n";
+        out += it->second;
+        out += "\nendobj\n";
+    }
+
+    // trailer keys carried over from the original
+    PdfObject trailer = PdfObject::dict();
+    for (const char* key : { "Root", "Info", "ID" }) {
+        const PdfObject v = m_reader.trailer().value(key);
+        if (!v.isNull()) trailer.insert(key, v);
+    }
+    trailer.insert("Prev", PdfObject::integer(m_reader.startXref()));
+
+    // consecutive runs of object numbers become one subsection each
+    QVector<QPair<int, int>> runs;   // (first, count)
+    auto collectRuns = [&runs, &offsets] {
+        runs.clear();
+        for (auto it = offsets.cbegin(); it != offsets.cend(); ++it) {
+            if (!runs.isEmpty() && runs.last().first + runs.last().second == it.key()) ++runs.last().second;
+            else runs.append({ it.key(), 1 });
+        }
+    };
+
+    const qint64 xrefOffset = base + out.size();
+    if (m_reader.hasXrefStream()) {
+        // the xref stream is an object itself and lists itself
+        const PdfRef self = allocate();
+        offsets.insert(self.num, { 0, xrefOffset });
+        collectRuns();
+
+        int offsetWidth = 1;
+        while (offsetWidth < 8 && (xrefOffset >> (8 * offsetWidth)) != 0) ++offsetWidth;
+        QByteArray data;
+        for (auto it = offsets.cbegin(); it != offsets.cend(); ++it) {
+            data += char(1);
+            for (int b = offsetWidth - 1; b >= 0; --b) data += char((it->second >> (8 * b)) & 0xff);
+            data += char((it->first >> 8) & 0xff);
+            data += char(it->first & 0xff);
+        }
+
+        PdfObject index = PdfObject::array();
+        for (const auto& r : std::as_const(runs)) {
+            index.append(PdfObject::integer(r.first));
+            index.append(PdfObject::integer(r.second));
+        }
+        PdfObject w = PdfObject::array();
+        w.append(PdfObject::integer(1));
+        w.append(PdfObject::integer(offsetWidth));
+        w.append(PdfObject::integer(2));
+
+        trailer.insert("Type", PdfObject::name("XRef"));
+        trailer.insert("Size", PdfObject::integer(m_nextNum));
+        trailer.insert("W", w);
+        trailer.insert("Index", index);
+        trailer.insert("Length", PdfObject::integer(data.size()));
+        out += QByteArray::number(self.num) + " 0 obj\n" + trailer.serialize() + "\nstream\n";
+        out += data;
+        out += "\nendstream\nendobj\n";
+    } else {
+        collectRuns();
+        out += "xref\n";
+        for (const auto& r : std::as_const(runs)) {
+            out += QByteArray::number(r.first) + ' ' + QByteArray::number(r.second) + '\n';
+            for (int n = r.first; n < r.first + r.second; ++n) {
+                const auto& e = offsets[n];
+                out += QByteArray::number(e.second).rightJustified(10, '0') + ' '
+                     + QByteArray::number(e.first).rightJustified(5, '0') + " n\r\n";
+            }
+        }
+        trailer.insert("Size", PdfObject::integer(m_nextNum));
+        out += "trailer\n" + trailer.serialize() + '\n';
+    }
+    out += "startxref\n" + QByteArray::number(xrefOffset) + "\n%%EOF\n";
+    return out;
+}
+
+bool appendMarkupAnnotations(const QString& path, const AnnotationStore& store, QString* error) {
+    TRACE_SPAN_ARG("annotations", "pdfAppend", store.count());
+    QByteArray update;
+    {
+        PdfReader reader;
+        if (!reader.open(path)) return fail(error, reader.errorString());
+        if (reader.isEncrypted()) return fail(error, "Encrypted documents can't be annotated in place.");
+
+        const QVector<PdfPage> pages = reader.pages();
+        QMap<int, QVector<MarkupId>> byPage;
+        for (MarkupId id : store.ids())
+            if (store.page(id) < pages.size() && store.quads(id).count > 0) byPage[store.page(id)] << id;
+        if (byPage.isEmpty()) return true;
+
+        PdfIncrementalUpdate inc(reader);
+        const QByteArray stamp = pdfDate(QDateTime::currentDateTimeUtc());
+        for (auto it = byPage.cbegin(); it != byPage.cend(); ++it) {
+            const PdfPage& page = pages[it.key()];
+            PdfObject pageObj = reader.object(page.ref);
+            if (!pageObj.isDict()) continue;
+
+            // an indirect /Annots array gets inlined into the rewritten page
+            PdfObject annots = reader.resolve(pageObj.value("Annots"));
+            if (!annots.isArray()) annots = PdfObject::array();
+            for (MarkupId id : *it) {
+                const PdfRef ref = inc.allocate();
+                inc.setObject(ref, markupAnnotation(store, id, page, stamp));
+                annots.append(PdfObject::ref(ref));
+            }
+            pageObj.insert("Annots", annots);
+            inc.setObject(reader.refOf(page.ref.num), pageObj);
+        }
+        if (inc.isEmpty()) return true;
+        update = inc.finish();
+    }   // unmap before appending
+
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) return fail(error, f.errorString());
+    if (f.write(update) != update.size() || !f.flush()) return fail(error, f.errorString());
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+#include "pdfreader.h"
+
+class AnnotationStore;
+
+// An incremental update: new and replaced objects are appended after the
+// original bytes, followed by a cross-reference section of the same kind as
+// the file's newest one (table or stream) chained to it with /Prev. The
+// original bytes are never rewritten.
+class PdfIncrementalUpdate {
+public:
+    explicit PdfIncrementalUpdate(const PdfReader& reader);
+
+    PdfRef allocate();                                  // a fresh object number
+    void setObject(PdfRef ref, const PdfObject& obj);   // new object, or replaces an existing one
+    bool isEmpty() const { return m_objects.isEmpty(); }
+
+    // Objects + xref + trailer, to be appended to the file as is.
+    QByteArray finish();
+
+private:
+    const PdfReader& m_reader;
+    int m_nextNum = 1;
+    QMap<int, QPair<int, QByteArray>> m_objects;   // num -> (gen, serialized body)
+};
+
+// Writes the store's markups into the PDF at path as Highlight / Underline /
+// StrikeOut annotations, appended as an incremental update.
+bool appendMarkupAnnotations(const QString& path, const AnnotationStore& store, QString* error = nullptr);
@@ -0,0 +1,93 @@
+#include "prefetcher.h"
+#include "pdfpageview.h"
+#include "pagerenderer.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QSet>
+
+namespace {
+constexpr int   kBaseDepth    = 2;     // pages ahead when reading at leisure
+constexpr qreal kFastFlipMs   = 250;   // flipping faster than this maxes out the look-ahead
+constexpr qreal kSmoothing    = 0.3;   // weight of the newest interval
+}
+
+PrefetchScheduler::PrefetchScheduler(PdfPageView* view, PageRenderService* renderer, QObject* parent)
+    : QObject(parent), m_view(view), m_renderer(renderer)
+{
+}
+
+void PrefetchScheduler::reset() {
+    m_lastPage = -1;
+    m_direction = 1;
+    m_avgIntervalMs = kSlowFlipMs;
+    m_sinceFlip.invalidate();
+    m_requested.clear();   // the render service was reset too
+}
+
+void PrefetchScheduler::pageChanged(int page) {
+    if (page < 0) return;
+
+    if (m_lastPage >= 0 && page != m_lastPage) {
+        const int step = page - m_lastPage;
+        if (qAbs(step) == 1) {
+            // a real flip: update direction and pace
+            m_direction = step;
+            if (m_sinceFlip.isValid()) {
+                const qreal ms = qMin<qreal>(m_sinceFlip.elapsed(), kSlowFlipMs * 2);
+                m_avgIntervalMs = kSmoothing * ms + (1 - kSmoothing) * m_avgIntervalMs;
+            }
+        } else {
+            // a jump says nothing about reading pace
+            m_avgIntervalMs = kSlowFlipMs;
+        }
+    }
+    m_sinceFlip.restart();
+    m_lastPage = page;
+    schedule(page);
+}
+
+void PrefetchScheduler::zoomChanged() {
+    if (m_lastPage >= 0) schedule(m_lastPage);
+}
+
+int PrefetchScheduler::depth() const {
+    // linear ramp from kBaseDepth (slow) to m_maxDepth (fast)
+    const qreal t = qBound<qreal>(0, (kSlowFlipMs - m_avgIntervalMs) / (kSlowFlipMs - kFastFlipMs), 1);
+    return qMax(1, qRound(kBaseDepth + t * (m_maxDepth - kBaseDepth)));
+}
+
+void PrefetchScheduler::schedule(int page) {
+    QPdfDocument* doc = m_view->document();
+    if (!doc || doc->status() != QPdfDocument::Status::Ready) return;
+    const int count = doc->pageCount();
+    const qreal dpr = m_view->devicePixelRatioF();
+
+    QList<int> pages;
+    for (int i = 1, n = depth(); i <= n; ++i) pages << page + i * m_direction;
+    pages << page - m_direction;   // the one we just came from
+
+    // pages too big for one bitmap get their preview; the view tiles them once they're on screen
+    auto keyFor = [&](int p) {
+        const qreal scale = m_view->pageScale(p) * dpr;
+        return m_renderer->needsTiles(p, scale) ? m_renderer->previewKeyFor(p, scale)
+                                                : PageRenderService::keyFor(p, scale);
+    };
+
+    QSet<RenderKey> keep;
+    QList<RenderKey> wanted;
+    for (int p : std::as_const(pages)) {
+        if (p < 0 || p >= count) continue;
+        const RenderKey key = keyFor(p);
+        keep.insert(key);
+        wanted << key;
+    }
+    // the view asks for the current page as Visible, maybe after this runs; don't drop it meanwhile
+    keep.insert(keyFor(page));
+
+    // only what we queued earlier and no longer want; the view's margin requests
+    // (off-screen tiles included) never come through here
+    m_renderer->cancelPrefetches(m_requested - keep);
+    for (const RenderKey& key : std::as_const(wanted))
+        m_renderer->request(key, PageRenderService::Priority::Prefetch);
+    m_requested = keep;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <QObject>
+#include <QElapsedTimer>
+#include <QSet>
+
+#include "pagerenderer.h"   // RenderKey
+
+class PdfPageView;
+
+// Watches page navigation and renders the pages the user is about to flip to.
+// The look-ahead grows with flip speed, follows the flip direction and always
+// keeps one page behind. A jump away drops whatever it queued for the old spot;
+// the view's own prefetches (the margin around the screen) are its business.
+class PrefetchScheduler : public QObject {
+    Q_OBJECT
+public:
+    PrefetchScheduler(PdfPageView* view, PageRenderService* renderer, QObject* parent = nullptr);
+
+    void setMaxDepth(int pages) { m_maxDepth = qMax(1, pages); }
+
+public slots:
+    void pageChanged(int page);
+    void zoomChanged();   // same position, new render scale
+    void reset();         // new document
+
+private:
+    static constexpr qreal kSlowFlipMs = 1500;   // a jump or a fresh start reads as this pace
+
+    void schedule(int page);
+    int depth() const;
+
+    PdfPageView*       m_view;
+    PageRenderService* m_renderer;
+
+    int           m_lastPage = -1;
+    int           m_direction = 1;       // +1 forward, -1 backward
+    qreal         m_avgIntervalMs = kSlowFlipMs; // smoothed time between flips
+    QElapsedTimer m_sinceFlip;
+    int           m_maxDepth = 8;
+    QSet<RenderKey> m_requested;         // what schedule() last asked for
+};
@@ -0,0 +1,132 @@
+#include "searchengine.h"
+#include "textindex.h"
+#include "trace.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfSelection>
+#include <QPolygonF>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+constexpr int kDefaultDebounceMs = 200;
+}
+
+SearchEngine::SearchEngine(QPdfDocument* doc, QObject* parent)
+    : QObject(parent), m_doc(doc),
+    m_generation(std::make_shared<QAtomicInteger<quint64>>(0))
+{
+    m_pool.setMaxThreadCount(1);   // a new query cancels the old one, so one worker is enough
+    m_debounce.setSingleShot(true);
+    m_debounce.setInterval(kDefaultDebounceMs);
+    connect(&m_debounce, &QTimer::timeout, this, &SearchEngine::start);
+}
+
+SearchEngine::~SearchEngine() {
+    cancel();
+}
+
+void SearchEngine::setQuery(const QString& text) {
+    m_generation->fetchAndAddOrdered(1);   // stop the running scan right away
+    m_query = text;
+    m_hits.clear();
+    m_truncated = false;
+    emit started(m_query);
+
+    if (text.trimmed().isEmpty()) {
+        m_debounce.stop();                 // clearing needs no debounce
+        m_running = false;
+        emit finished(0);
+    } else {
+        m_running = true;                  // from the user's point of view it already is
+        m_debounce.start();
+    }
+}
+
+void SearchEngine::cancel() {
+    m_debounce.stop();
+    m_generation->fetchAndAddOrdered(1);
+    m_pool.waitForDone();
+    m_running = false;
+}
+
+QPair<int, int> SearchEngine::hitsOnPage(int page) const {
+    auto byPage = [](const SearchHit& h, int p) { return h.page < p; };
+    auto lo = std::lower_bound(m_hits.cbegin(), m_hits.cend(), page, byPage);
+    auto hi = std::lower_bound(lo, m_hits.cend(), page + 1, byPage);
+    return { int(lo - m_hits.cbegin()), int(hi - m_hits.cbegin()) };
+}
+
+void SearchEngine::start() {
+    const quint64 gen = m_generation->fetchAndAddOrdered(1) + 1;
+    const QString needle = m_query.trimmed();
+    if (needle.isEmpty() || !m_doc || m_doc->status() != QPdfDocument::Status::Ready) {
+        m_running = false;
+        emit finished(0);
+        return;
+    }
+
+    m_running = true;
+    QPdfDocument* doc = m_doc;
+    const int pages = doc->pageCount();
+    auto current = m_generation;
+    auto index = m_index;
+    m_pool.start([this, doc, pages, needle, gen, current, index] {
+        TRACE_SPAN("search", "scan");
+        // the index only rules pages out; what matches is decided by the scan below
+        QVector<int> candidates;
+        if (index && index->pageCount() == pages) {
+            TRACE_SPAN("search", "indexPages");
+            candidates = index->pagesContaining(needle);
+        } else {
+            candidates.resize(pages);
+            std::iota(candidates.begin(), candidates.end(), 0);
+        }
+        for (int page : std::as_const(candidates)) {
+            if (current->loadRelaxed() != gen) return;   // superseded
+            TRACE_SPAN_ARG("search", "scanPage", page);
+
+            const QString text = doc->getAllText(page).text();
+            QVector<SearchHit> found;
+            for (int at = text.indexOf(needle, 0, Qt::CaseInsensitive); at >= 0;
+                 at = text.indexOf(needle, at + needle.size(), Qt::CaseInsensitive)) {
+                const QPdfSelection sel = doc->getSelectionAtIndex(page, at, int(needle.size()));
+                SearchHit hit;
+                hit.page = page;
+                for (const QPolygonF& poly : sel.bounds())
+                    hit.rects << poly.boundingRect();
+                if (!hit.rects.isEmpty()) hit.location = hit.rects.first().topLeft();
+                found << hit;
+            }
+            if (!found.isEmpty())
+                QMetaObject::invokeMethod(this, [this, gen, found] { pageScanned(gen, found); },
+                                          Qt::QueuedConnection);
+        }
+        QMetaObject::invokeMethod(this, [this, gen] { scanDone(gen); }, Qt::QueuedConnection);
+    });
+}
+
+void SearchEngine::pageScanned(quint64 generation, const QVector<SearchHit>& pageHits) {
+    if (generation != m_generation->loadRelaxed()) return;
+    const int first = int(m_hits.size());
+    const int take = qMin(int(pageHits.size()), m_maxHits - first);
+    if (take > 0) {
+        m_hits += pageHits.mid(0, take);
+        emit hitsAdded(first, take);
+    }
+
+    // a full list keeps scanning until a hit doesn't fit: only then was it cut short
+    if (take < pageHits.size()) {
+        // stop the worker and report what we have
+        m_generation->fetchAndAddOrdered(1);
+        m_truncated = true;
+        m_running = false;
+        emit finished(int(m_hits.size()));
+    }
+}
+
+void SearchEngine::scanDone(quint64 generation) {
+    if (generation != m_generation->loadRelaxed()) return;
+    m_running = false;
+    emit finished(int(m_hits.size()));
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <QObject>
+#include <QList>
+#include <QRectF>
+#include <QPointF>
+#include <QVector>
+#include <QString>
+#include <QTimer>
+#include <QThreadPool>
+#include <QAtomicInteger>
+#include <climits>
+#include <memory>
+
+class QPdfDocument;
+class TextIndex;
+
+struct SearchHit {
+    int page = -1;
+    QList<QRectF> rects;   // in PAGE POINTS
+    QPointF location;      // where to scroll to, like QPdfLink::location()
+};
+
+// Full-document text search on a worker thread. setQuery() is debounced; every
+// new query cancels the one in flight. Hits are streamed back a page at a time
+// (in page order), so callers can browse what was found so far.
+class SearchEngine : public QObject {
+    Q_OBJECT
+public:
+    explicit SearchEngine(QPdfDocument* doc, QObject* parent = nullptr);
+    ~SearchEngine();
+
+    void setDebounceInterval(int ms) { m_debounce.setInterval(ms); }
+    // With a prebuilt index for the document, only the pages it says can hold
+    // the query are scanned. Matching stays the same (case-insensitive
+    // substring), so the hits don't change once the index arrives.
+    void setIndex(std::shared_ptr<const TextIndex> index) { m_index = std::move(index); }
+    bool hasIndex() const { return m_index != nullptr; }
+    // Stop collecting after this many hits (bounds memory on huge documents).
+    void setMaxHits(int n) { m_maxHits = qMax(1, n); }
+    int maxHits() const { return m_maxHits; }
+    bool isTruncated() const { return m_truncated; }   // the last query hit the cap
+
+    void setQuery(const QString& text);     // clears hits now, scans after the debounce
+    void cancel();                          // stop scanning and wait for the worker
+
+    QString query() const { return m_query; }
+    bool isRunning() const { return m_running; }
+    const QVector<SearchHit>& hits() const { return m_hits; }
+    int count() const { return int(m_hits.size()); }
+    // Index range [first, last) of the hits on a page.
+    QPair<int, int> hitsOnPage(int page) const;
+
+signals:
+    void started(const QString& text);      // new query, hits were cleared
+    void hitsAdded(int first, int count);
+    void finished(int total);
+
+private:
+    void start();
+    void pageScanned(quint64 generation, const QVector<SearchHit>& pageHits);
+    void scanDone(quint64 generation);
+
+    QPdfDocument*      m_doc;
+    QTimer             m_debounce;
+    QThreadPool        m_pool;
+    QString            m_query;
+    QVector<SearchHit> m_hits;
+    bool               m_running = false;
+    bool               m_truncated = false;
+    int                m_maxHits = INT_MAX;
+    // bumped on every query; the worker stops as soon as its own number is stale
+    std::shared_ptr<QAtomicInteger<quint64>> m_generation;
+    std::shared_ptr<const TextIndex> m_index;
+};
@@ -0,0 +1,198 @@
+#include "textgeometry.h"
+#include "trace.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+PageGeometry PageGeometry::fromWords(const QVector<PageWord>& words) {
+    PageGeometry g;
+    const int n = int(words.size());
+    g.m_x.reserve(n);
+    g.m_y.reserve(n);
+    g.m_w.reserve(n);
+    g.m_h.reserve(n);
+
+    for (int i = 0; i < n; ++i) {
+        const QRectF r = words[i].rect;
+        // same line while the word sits beside the previous one; a step back left
+        // or a centre outside the line's band starts the next
+        const int line = g.lineCount() - 1;
+        const bool newLine = line < 0 || r.center().y() < g.m_lineTop[line] || r.center().y() > g.m_lineBottom[line]
+                          || r.left() < g.m_x.last();
+        if (newLine) {
+            g.m_lineFirst << i;
+            g.m_lineTop << float(r.top());
+            g.m_lineBottom << float(r.bottom());
+            g.m_lineLeft << float(r.left());
+            g.m_lineRight << float(r.right());
+        } else {
+            g.m_lineTop[line] = qMin(g.m_lineTop[line], float(r.top()));
+            g.m_lineBottom[line] = qMax(g.m_lineBottom[line], float(r.bottom()));
+            g.m_lineLeft[line] = qMin(g.m_lineLeft[line], float(r.left()));
+            g.m_lineRight[line] = qMax(g.m_lineRight[line], float(r.right()));
+        }
+        g.m_x << float(r.x());
+        g.m_y << float(r.y());
+        g.m_w << float(r.width());
+        g.m_h << float(r.height());
+    }
+    g.m_lineFirst << n;
+    return g;
+}
+
+QRectF PageGeometry::lineRect(int line) const {
+    return QRectF(QPointF(m_lineLeft[line], m_lineTop[line]), QPointF(m_lineRight[line], m_lineBottom[line]));
+}
+
+int PageGeometry::lineOf(int word) const {
+    return int(std::upper_bound(m_lineFirst.cbegin(), m_lineFirst.cend() - 1, word) - m_lineFirst.cbegin()) - 1;
+}
+
+int PageGeometry::wordAt(const QPointF& pt) const {
+    if (m_x.isEmpty()) return -1;
+    const float px = float(pt.x()), py = float(pt.y());
+
+    // closest line: vertical distance first, horizontal to break ties (columns)
+    int best = 0;
+    float bestDy = std::numeric_limits<float>::max(), bestDx = bestDy;
+    for (int l = 0, n = lineCount(); l < n; ++l) {
+        const float dy = py < m_lineTop[l] ? m_lineTop[l] - py : py > m_lineBottom[l] ? py - m_lineBottom[l] : 0;
+        const float dx = px < m_lineLeft[l] ? m_lineLeft[l] - px : px > m_lineRight[l] ? px - m_lineRight[l] : 0;
+        if (dy < bestDy || (dy == bestDy && dx < bestDx)) {
+            best = l;
+            bestDy = dy;
+            bestDx = dx;
+        }
+    }
+
+    // words of a line run left to right: last one starting at or before px, or the next if that's nearer
+    const int first = m_lineFirst[best], end = m_lineFirst[best + 1];
+    int i = int(std::upper_bound(m_x.cbegin() + first, m_x.cbegin() + end, px) - m_x.cbegin()) - 1;
+    if (i < first) return first;
+    if (i + 1 < end && px > m_x[i] + m_w[i] && m_x[i + 1] - px < px - (m_x[i] + m_w[i])) ++i;
+    return i;
+}
+
+QList<QRectF> PageGeometry::selectionQuads(const QPointF& from, const QPointF& to) const {
+    QList<QRectF> quads;
+    int a = wordAt(from), b = wordAt(to);
+    if (a < 0) return quads;
+    if (a > b) std::swap(a, b);
+
+    for (int l = lineOf(a), last = lineOf(b); l <= last; ++l) {
+        const int w0 = qMax(a, m_lineFirst[l]);
+        const int w1 = qMin(b, m_lineFirst[l + 1] - 1);
+        quads << QRectF(QPointF(m_x[w0], m_lineTop[l]), QPointF(m_x[w1] + m_w[w1], m_lineBottom[l]));
+    }
+    return quads;
+}
+
+// --- TextGeometryStore ---
+
+// One per run of extraction: reset() and pause() cancel it, so whatever it still
+// has queued returns without touching pdfium.
+struct TextGeometryStore::Job {
+    QPdfDocument* doc = nullptr;
+    bool queuedAll = false;                         // extractAll() ran
+    std::atomic<bool> cancelled{ false };
+    std::unique_ptr<std::atomic<bool>[]> claimed;   // per page: a worker has taken it
+};
+
+TextGeometryStore::TextGeometryStore(QPdfDocument* doc, QObject* parent)
+    : QObject(parent), m_doc(doc), m_busy(std::make_shared<std::atomic<int>>(0))
+{
+}
+
+TextGeometryStore::~TextGeometryStore() { reset(); }
+
+// Shared by every document and capped at half the cores, so any number of open
+// tabs is still one pool's worth of low-priority threads competing with the
+// renders for pdfium's lock (which serializes the extraction itself anyway).
+QThreadPool* TextGeometryStore::pool() {
+    static QThreadPool shared;
+    static const bool configured = [] {
+        shared.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+        return true;
+    }();
+    Q_UNUSED(configured);
+    return &shared;
+}
+
+void TextGeometryStore::setIndex(std::shared_ptr<const TextIndex> index) {
+    if (!index || !m_doc || m_doc->status() != QPdfDocument::Status::Ready || index->pageCount() != m_doc->pageCount())
+        return;
+    pause();   // whatever's still queued, the index has it already
+    m_index = std::move(index);
+    m_pages.resize(m_doc->pageCount());
+}
+
+bool TextGeometryStore::ensureJob() {
+    if (m_job) return true;
+    if (m_index || !m_doc || m_doc->status() != QPdfDocument::Status::Ready) return false;
+    const int pages = m_doc->pageCount();
+    m_job = std::make_shared<Job>();
+    m_job->doc = m_doc;
+    m_job->claimed.reset(new std::atomic<bool>[size_t(pages)]);
+    m_pages.resize(pages);
+    // pages finished before a pause don't go again
+    for (int p = 0; p < pages; ++p) m_job->claimed[p] = m_pages[p] != nullptr;
+    return true;
+}
+
+void TextGeometryStore::extractAll() {
+    if (!ensureJob() || m_job->queuedAll) return;
+    m_job->queuedAll = true;
+    for (int p = 0, n = int(m_pages.size()); p < n; ++p)
+        if (!m_pages[p]) start(p, 0);
+}
+
+void TextGeometryStore::prioritize(int page) {
+    if (!ensureJob() || page < 0 || page >= m_pages.size() || m_pages[page] || m_job->claimed[page]) return;
+    start(page, 10);   // whichever copy runs first does the work
+}
+
+bool TextGeometryStore::pause() {
+    if (!m_job) return false;
+    m_job->cancelled = true;   // pages being extracted right now still come in
+    m_job.reset();
+    return true;
+}
+
+std::shared_ptr<const PageGeometry> TextGeometryStore::page(int page) const {
+    if (page < 0 || page >= m_pages.size()) return nullptr;
+    if (!m_pages[page] && m_index)
+        m_pages[page] = std::make_shared<const PageGeometry>(PageGeometry::fromWords(m_index->pageWords(page)));
+    return m_pages[page];
+}
+
+void TextGeometryStore::reset() {
+    ++m_generation;
+    pause();
+    // a task either saw the cancel or is counted here
+    while (m_busy->load() > 0) QThread::msleep(1);
+    m_index.reset();
+    m_pages.clear();
+}
+
+void TextGeometryStore::start(int page, int priority) {
+    std::shared_ptr<Job> job = m_job;
+    std::shared_ptr<std::atomic<int>> busy = m_busy;
+    const quint64 gen = m_generation;
+    pool()->start([this, job, busy, gen, page] {
+        ++*busy;   // before the check: reset() cancels first, then waits for this to drop
+        if (!job->cancelled && !job->claimed[page].exchange(true)) {
+            QThread::currentThread()->setPriority(QThread::LowPriority);   // behind the renders
+            TRACE_SPAN_ARG("text", "extractGeometry", page);
+            auto geometry = std::make_shared<const PageGeometry>(PageGeometry::fromWords(extractPageWords(job->doc, page)));
+            QMetaObject::invokeMethod(this, [this, gen, page, geometry] {
+                if (gen != m_generation || page >= m_pages.size() || m_pages[page]) return;   // document changed, or done meanwhile
+                m_pages[page] = geometry;
+                emit pageReady(page);
+            }, Qt::QueuedConnection);
+        }
+        --*busy;
+    }, priority);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <QObject>
+#include <QList>
+#include <QRectF>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+#include "textindex.h"   // PageWord, TextIndex
+
+class QPdfDocument;
+
+// Word and line boxes of one page, in page points. Words are in reading order,
+// one column per field; lines are runs of consecutive words (lineFirst has one
+// extra entry past the end), so a selection is two word lookups and a walk
+// over the lines in between — no pdfium involved.
+class PageGeometry {
+public:
+    static PageGeometry fromWords(const QVector<PageWord>& words);
+
+    int wordCount() const { return int(m_x.size()); }
+    int lineCount() const { return int(m_lineTop.size()); }
+    QRectF wordRect(int i) const { return QRectF(m_x[i], m_y[i], m_w[i], m_h[i]); }
+    QRectF lineRect(int line) const;
+    int lineOf(int word) const;
+
+    // Word nearest to pt: on the closest line, the closest word along it. -1 if the page has no text.
+    int wordAt(const QPointF& pt) const;
+    // Drag from -> to snapped to whole words, one rectangle per line (line height,
+    // from the first to the last selected word on it). Empty if the page has no text.
+    QList<QRectF> selectionQuads(const QPointF& from, const QPointF& to) const;
+
+private:
+    QVector<float> m_x, m_y, m_w, m_h;                          // per word
+    QVector<float> m_lineTop, m_lineBottom, m_lineLeft, m_lineRight;
+    QVector<int>   m_lineFirst;                                 // first word per line
+};
+
+// PageGeometry for every page of a document. Normally it comes from the text
+// index, which already has every word box: a page is built from it the first
+// time it's asked for, no pdfium involved. Without an index the words are
+// extracted on a low-priority pool shared by all documents, the pages someone
+// is about to select on first. Results are handed out on the GUI thread; pages
+// that aren't done yet return nullptr.
+class TextGeometryStore : public QObject {
+    Q_OBJECT
+public:
+    explicit TextGeometryStore(QPdfDocument* doc, QObject* parent = nullptr);
+    ~TextGeometryStore();
+
+    // The (Ready) document's text index; queued extraction stops, every page
+    // comes from the index from now on. Ignored if it doesn't fit the document.
+    void setIndex(std::shared_ptr<const TextIndex> index);
+    bool hasIndex() const { return m_index != nullptr; }
+
+    // Queue every page of the (Ready) document that isn't done yet.
+    void extractAll();
+    // Extract a page ahead of the rest (also without extractAll()).
+    void prioritize(int page);
+    // Cancel queued extractions, keep the finished pages; extractAll() carries on
+    // from there. False if nothing was queued.
+    bool pause();
+    std::shared_ptr<const PageGeometry> page(int page) const;
+
+    // Drop everything and wait for running extractions. Call before the document (re)loads.
+    void reset();
+
+signals:
+    void pageReady(int page);
+
+private:
+    struct Job;
+    static QThreadPool* pool();
+    bool ensureJob();
+    void start(int page, int priority);
+
+    QPdfDocument* m_doc;
+    std::shared_ptr<Job> m_job;
+    std::shared_ptr<std::atomic<int>> m_busy;   // our tasks past their cancel check
+    quint64       m_generation = 0;             // bumped by reset(); older results are dropped
+    std::shared_ptr<const TextIndex> m_index;
+    mutable QVector<std::shared_ptr<const PageGeometry>> m_pages;   // built lazily from the index
+};
@@ -0,0 +1,438 @@
+#include "textindex.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QtPdf/QPdfSelection>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QPolygonF>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "sidecar sections are written in host order");
+
+struct TextIndex::Header {
+    char    magic[8];
+    quint32 version;
+    quint32 pageCount;
+    quint32 termCount;
+    quint32 wordCount;
+    quint32 stringsSize;
+    quint32 postingsCount;
+    quint64 termsOffset;
+    quint64 stringsOffset;
+    quint64 postingsOffset;
+    quint64 wordsOffset;
+    quint64 pagesOffset;
+};
+
+struct TextIndex::TermEntry {
+    quint32 strOffset;
+    quint32 strLength;
+    quint32 postingsStart;
+    quint32 postingsCount;
+};
+
+struct TextIndex::WordEntry {
+    quint32 page;
+    quint32 term;
+    quint32 charIndex;
+    quint32 charLength;
+    float   x, y, w, h;
+};
+
+namespace {
+const char kMagic[8] = { 'P', 'D', 'E', 'I', 'D', 'X', '\0', '\0' };
+
+bool isWordChar(QChar c) { return c.isLetterOrNumber(); }
+
+// Position along a line's runs, as if they were laid end to end.
+qreal locate(const QList<QRectF>& runs, qreal total, qreal fraction, bool atEnd, int* run) {
+    const qreal target = fraction * total;
+    qreal acc = 0;
+    for (int i = 0; i < runs.size(); ++i) {
+        const qreal w = runs[i].width();
+        const bool inside = atEnd ? target <= acc + w : target < acc + w;
+        if (inside || i == runs.size() - 1) {
+            *run = i;
+            return runs[i].left() + qBound<qreal>(0, target - acc, w);
+        }
+        acc += w;
+    }
+    *run = 0;
+    return 0;
+}
+
+QRectF spanRect(const QList<QRectF>& runs, qreal total, qreal from, qreal to) {
+    if (runs.isEmpty() || total <= 0) return {};
+    int r0 = 0, r1 = 0;
+    const qreal x0 = locate(runs, total, from, false, &r0);
+    qreal x1 = locate(runs, total, to, true, &r1);
+    const QRectF& run = runs[r0];
+    if (r1 != r0) x1 = run.right();   // words don't wrap across runs
+    return QRectF(x0, run.top(), qMax<qreal>(x1 - x0, 0.5), run.height());
+}
+
+quint32 align4(quint32 n) { return (n + 3) & ~3u; }
+}
+
+QVector<PageWord> extractPageWords(QPdfDocument* doc, int page) {
+    QVector<PageWord> out;
+    const QString text = doc->getAllText(page).text();
+    const int n = int(text.size());
+
+    for (int lineStart = 0; lineStart < n;) {
+        int lineEnd = lineStart;
+        bool hasWord = false;
+        while (lineEnd < n && text[lineEnd] != QLatin1Char('\n') && text[lineEnd] != QLatin1Char('\r')) {
+            hasWord = hasWord || isWordChar(text[lineEnd]);
+            ++lineEnd;
+        }
+        const int lineLen = lineEnd - lineStart;
+
+        if (hasWord) {
+            QList<QRectF> runs;
+            qreal total = 0;
+            for (const QPolygonF& poly : doc->getSelectionAtIndex(page, lineStart, lineLen).bounds()) {
+                runs << poly.boundingRect();
+                total += runs.last().width();
+            }
+            for (int i = lineStart; i < lineEnd;) {
+                if (!isWordChar(text[i])) { ++i; continue; }
+                int j = i;
+                while (j < lineEnd && isWordChar(text[j])) ++j;
+
+                PageWord w;
+                w.text = text.mid(i, j - i);
+                w.charIndex = i;
+                w.charLength = j - i;
+                w.rect = spanRect(runs, total, qreal(i - lineStart) / lineLen, qreal(j - lineStart) / lineLen);
+                out << w;
+                i = j;
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+    return out;
+}
+
+QStringList indexTerms(const QString& text) {
+    QStringList terms;
+    const int n = int(text.size());
+    for (int i = 0; i < n;) {
+        if (!isWordChar(text[i])) { ++i; continue; }
+        int j = i;
+        while (j < n && isWordChar(text[j])) ++j;
+        terms << text.mid(i, j - i).toCaseFolded();
+        i = j;
+    }
+    return terms;
+}
+
+QByteArray fileContentHash(const QString& path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return {};
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&f)) return {};
+    return hash.result().toHex();
+}
+
+// --- writing ---
+
+QString TextIndex::sidecarPath(const QByteArray& contentHash) {
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/textindex";
+    return dir + "/" + QString::fromLatin1(contentHash) + ".idx";
+}
+
+bool TextIndex::write(const QString& path, const QVector<QVector<PageWord>>& pages) {
+    // term -> word ordinals; QMap keeps the terms in byte order for binary search
+    QMap<QByteArray, QVector<quint32>> postings;
+    QVector<WordEntry> words;
+    QVector<QByteArray> wordTerms;
+    QVector<quint32> pageFirst;
+    pageFirst.reserve(pages.size() + 1);
+
+    for (int page = 0; page < pages.size(); ++page) {
+        pageFirst << quint32(words.size());
+        for (const PageWord& pw : pages[page]) {
+            const QByteArray term = pw.text.toCaseFolded().toUtf8();
+            postings[term] << quint32(words.size());
+            WordEntry w{};
+            w.page = quint32(page);
+            w.charIndex = quint32(pw.charIndex);
+            w.charLength = quint32(pw.charLength);
+            w.x = float(pw.rect.x());
+            w.y = float(pw.rect.y());
+            w.w = float(pw.rect.width());
+            w.h = float(pw.rect.height());
+            words << w;
+            wordTerms << term;
+        }
+    }
+    pageFirst << quint32(words.size());
+
+    QVector<TermEntry> terms;
+    QByteArray strings;
+    QVector<quint32> flatPostings;
+    QHash<QByteArray, quint32> termIds;
+    terms.reserve(postings.size());
+    for (auto it = postings.cbegin(); it != postings.cend(); ++it) {
+        termIds.insert(it.key(), quint32(terms.size()));
+        terms << TermEntry{ quint32(strings.size()), quint32(it.key().size()),
+                            quint32(flatPostings.size()), quint32(it.value().size()) };
+        strings += it.key();
+        flatPostings += it.value();
+    }
+    for (int i = 0; i < words.size(); ++i)
+        words[i].term = termIds.value(wordTerms[i]);
+    strings.append(QByteArray(align4(quint32(strings.size())) - strings.size(), '\0'));
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.version = kVersion;
+    h.pageCount = quint32(pages.size());
+    h.termCount = quint32(terms.size());
+    h.wordCount = quint32(words.size());
+    h.stringsSize = quint32(strings.size());
+    h.postingsCount = quint32(flatPostings.size());
+    h.termsOffset = sizeof(Header);
+    h.stringsOffset = h.termsOffset + quint64(terms.size()) * sizeof(TermEntry);
+    h.postingsOffset = h.stringsOffset + quint64(strings.size());
+    h.wordsOffset = h.postingsOffset + quint64(flatPostings.size()) * sizeof(quint32);
+    h.pagesOffset = h.wordsOffset + quint64(words.size()) * sizeof(WordEntry);
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+    auto put = [&out](const void* data, qint64 len) {
+        return len == 0 || out.write(static_cast<const char*>(data), len) == len;
+    };
+    const bool ok = put(&h, sizeof h)
+        && put(terms.constData(), qint64(terms.size()) * sizeof(TermEntry))
+        && put(strings.constData(), strings.size())
+        && put(flatPostings.constData(), qint64(flatPostings.size()) * sizeof(quint32))
+        && put(words.constData(), qint64(words.size()) * sizeof(WordEntry))
+        && put(pageFirst.constData(), qint64(pageFirst.size()) * sizeof(quint32));
+    if (!ok) { out.cancelWriting(); return false; }
+    return out.commit();
+}
+
+// --- reading ---
+
+TextIndex::~TextIndex() { close(); }
+
+bool TextIndex::open(const QString& path) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(Header))) { close(); return false; }
+    m_base = m_file.map(0, m_size);
+    if (!m_base) { close(); return false; }
+
+    // never trust a sidecar: every section has to fit inside the mapping. Offsets
+    // are 64-bit values from the file, so compare against what's left after them
+    // rather than summing (a crafted offset would wrap).
+    const Header* h = header();
+    const quint64 size = quint64(m_size);
+    auto fits = [size](quint64 offset, quint64 bytes) { return offset <= size && bytes <= size - offset; };
+    const bool ok = std::memcmp(h->magic, kMagic, sizeof kMagic) == 0
+        && h->version == kVersion
+        && fits(h->termsOffset, quint64(h->termCount) * sizeof(TermEntry))
+        && fits(h->stringsOffset, h->stringsSize)
+        && fits(h->postingsOffset, quint64(h->postingsCount) * sizeof(quint32))
+        && fits(h->wordsOffset, quint64(h->wordCount) * sizeof(WordEntry))
+        && fits(h->pagesOffset, (quint64(h->pageCount) + 1) * sizeof(quint32));
+    if (!ok || !entriesValid()) { close(); return false; }
+    return true;
+}
+
+// ...and everything the entries point at has to be inside its section. One pass
+// over the file on open, so lookups can index without checking.
+bool TextIndex::entriesValid() const {
+    const Header* h = header();
+    const quint64 aligned = h->termsOffset | h->postingsOffset | h->wordsOffset | h->pagesOffset;
+    if (aligned % 4 || h->termCount > quint32(INT_MAX) || h->wordCount > quint32(INT_MAX)
+        || h->pageCount > quint32(INT_MAX) - 1)
+        return false;
+
+    const TermEntry* t = terms();
+    for (quint32 i = 0; i < h->termCount; ++i) {
+        if (quint64(t[i].strOffset) + t[i].strLength > h->stringsSize
+            || quint64(t[i].postingsStart) + t[i].postingsCount > h->postingsCount)
+            return false;
+    }
+    const quint32* p = postings();
+    for (quint32 i = 0; i < h->postingsCount; ++i)
+        if (p[i] >= h->wordCount) return false;
+    const WordEntry* w = words();
+    for (quint32 i = 0; i < h->wordCount; ++i)
+        if (w[i].term >= h->termCount || w[i].page >= h->pageCount) return false;
+    const quint32* first = pageFirstWords();
+    for (quint32 i = 0; i <= h->pageCount; ++i)
+        if (first[i] > h->wordCount || (i > 0 && first[i] < first[i - 1])) return false;
+    return true;
+}
+
+void TextIndex::close() {
+    if (m_base) m_file.unmap(m_base);
+    m_base = nullptr;
+    m_size = 0;
+    if (m_file.isOpen()) m_file.close();
+}
+
+const TextIndex::Header* TextIndex::header() const {
+    return reinterpret_cast<const Header*>(m_base);
+}
+const TextIndex::TermEntry* TextIndex::terms() const {
+    return reinterpret_cast<const TermEntry*>(m_base + header()->termsOffset);
+}
+const char* TextIndex::strings() const {
+    return reinterpret_cast<const char*>(m_base + header()->stringsOffset);
+}
+const quint32* TextIndex::postings() const {
+    return reinterpret_cast<const quint32*>(m_base + header()->postingsOffset);
+}
+const TextIndex::WordEntry* TextIndex::words() const {
+    return reinterpret_cast<const WordEntry*>(m_base + header()->wordsOffset);
+}
+const quint32* TextIndex::pageFirstWords() const {
+    return reinterpret_cast<const quint32*>(m_base + header()->pagesOffset);
+}
+
+int TextIndex::pageCount() const { return isOpen() ? int(header()->pageCount) : 0; }
+int TextIndex::wordCount() const { return isOpen() ? int(header()->wordCount) : 0; }
+
+QByteArray TextIndex::termAt(int i) const {
+    const TermEntry& t = terms()[i];
+    return QByteArray::fromRawData(strings() + t.strOffset, int(t.strLength));   // no copy
+}
+
+int TextIndex::lowerBound(const QByteArray& term) const {
+    int lo = 0, hi = int(header()->termCount);
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (termAt(mid) < term) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+QVector<PageWord> TextIndex::pageWords(int page) const {
+    QVector<PageWord> out;
+    if (!isOpen() || page < 0 || page >= pageCount()) return out;
+    const quint32* first = pageFirstWords();
+    const WordEntry* w = words();
+    out.reserve(int(first[page + 1] - first[page]));
+    for (quint32 i = first[page]; i < first[page + 1]; ++i) {
+        PageWord word;
+        word.text = QString::fromUtf8(termAt(int(w[i].term)));
+        word.charIndex = int(w[i].charIndex);
+        word.charLength = int(w[i].charLength);
+        word.rect = QRectF(w[i].x, w[i].y, w[i].w, w[i].h);
+        out << word;
+    }
+    return out;
+}
+
+QVector<int> TextIndex::pagesContaining(const QString& query) const {
+    QVector<int> out;
+    if (!isOpen()) return out;
+    const int pages = pageCount();
+    QVector<bool> possible(pages, true);
+
+    // a query word can be any part of a page word ("ell" in "hello"), so this
+    // walks every term; a few ms even for a large document
+    QStringList q = indexTerms(query);
+    q.removeDuplicates();
+    const int termCount = int(header()->termCount);
+    const WordEntry* w = words();
+    for (const QString& word : std::as_const(q)) {
+        const QByteArray part = word.toUtf8();
+        QVector<bool> on(pages, false);
+        for (int term = 0; term < termCount; ++term) {
+            if (!termAt(term).contains(part)) continue;
+            const TermEntry& t = terms()[term];
+            for (quint32 i = 0; i < t.postingsCount; ++i) on[int(w[postings()[t.postingsStart + i]].page)] = true;
+        }
+        for (int page = 0; page < pages; ++page) possible[page] = possible[page] && on[page];
+    }
+    for (int page = 0; page < pages; ++page)
+        if (possible[page]) out << page;
+    return out;
+}
+
+QVector<SearchHit> TextIndex::find(const QString& query, int maxHits) const {
+    QVector<SearchHit> hits;
+    if (!isOpen()) return hits;
+    const QStringList q = indexTerms(query);
+    if (q.isEmpty()) return hits;
+
+    const int termCount = int(header()->termCount);
+    const int wordCount = int(header()->wordCount);
+
+    // every word but the last has to match exactly
+    QVector<int> exact;
+    for (int i = 0; i + 1 < q.size(); ++i) {
+        const QByteArray t = q[i].toUtf8();
+        const int at = lowerBound(t);
+        if (at >= termCount || termAt(at) != t) return hits;
+        exact << at;
+    }
+    // the last word may be a prefix: all its terms sit in one contiguous run
+    const QByteArray prefix = q.last().toUtf8();
+    const int prefixFirst = lowerBound(prefix);
+    int prefixEnd = prefixFirst;
+    while (prefixEnd < termCount && termAt(prefixEnd).startsWith(prefix)) ++prefixEnd;
+    if (prefixFirst == prefixEnd) return hits;
+
+    // candidate starts: the first word's postings, or every term under the prefix
+    QVector<quint32> starts;
+    if (!exact.isEmpty()) {
+        const TermEntry& t = terms()[exact.first()];
+        starts.reserve(int(t.postingsCount));
+        for (quint32 i = 0; i < t.postingsCount; ++i) starts << postings()[t.postingsStart + i];
+    } else {
+        for (int term = prefixFirst; term < prefixEnd; ++term) {
+            const TermEntry& t = terms()[term];
+            for (quint32 i = 0; i < t.postingsCount; ++i) starts << postings()[t.postingsStart + i];
+        }
+        std::sort(starts.begin(), starts.end());
+    }
+
+    const WordEntry* w = words();
+    const int span = int(q.size());
+    for (quint32 start : std::as_const(starts)) {
+        if (int(start) + span > wordCount) continue;
+        bool match = true;
+        for (int k = 1; k < exact.size() && match; ++k)
+            match = int(w[start + k].term) == exact[k];
+        if (match && !exact.isEmpty()) {
+            const int last = int(w[start + span - 1].term);
+            match = last >= prefixFirst && last < prefixEnd;
+        }
+        if (!match) continue;
+
+        SearchHit hit;
+        hit.page = int(w[start].page);
+        for (int k = 0; k < span; ++k) {
+            const WordEntry& we = w[start + k];
+            if (int(we.page) != hit.page) break;
+            const QRectF r(we.x, we.y, we.w, we.h);
+            // words on the same line merge into one highlight
+            if (!hit.rects.isEmpty() && qAbs(hit.rects.last().top() - r.top()) < r.height() / 2)
+                hit.rects.last() = hit.rects.last().united(r);
+            else
+                hit.rects << r;
+        }
+        hit.location = hit.rects.isEmpty() ? QPointF() : hit.rects.first().topLeft();
+        hits << hit;
+        if (maxHits > 0 && hits.size() >= maxHits) break;
+    }
+    return hits;
+}
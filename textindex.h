@@ -0,0 +1,95 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QRectF>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "searchengine.h"   // SearchHit
+
+class QPdfDocument;
+
+// One word as it sits on the page.
+struct PageWord {
+    QString text;
+    int     charIndex = 0;   // into QPdfDocument::getAllText(page)
+    int     charLength = 0;
+    QRectF  rect;            // in PAGE POINTS
+};
+
+// Splits a page into words with bounding boxes. Boxes come from one selection
+// query per text line (a call per word would reload the page in pdfium every
+// time); inside a line characters are spread evenly over the line's runs.
+QVector<PageWord> extractPageWords(QPdfDocument* doc, int page);
+
+// Lower-cased word terms of a query, the same way the index stores them.
+QStringList indexTerms(const QString& text);
+
+// SHA-1 of the file contents (hex), read in chunks. Empty on error.
+QByteArray fileContentHash(const QString& path);
+
+// Positional inverted index of one PDF, stored as a sidecar file and read
+// straight out of a memory mapping. Sidecars are keyed by content hash, so a
+// renamed or copied file reuses its index and an edited one gets a new one.
+//
+// Layout (little-endian, every section 4-byte aligned):
+//   Header
+//   TermEntry[termCount]     sorted by UTF-8 term bytes
+//   char     strings[]       UTF-8 term text
+//   quint32  postings[]      word ordinals per term, ascending
+//   WordEntry words[wordCount]  in reading order, ordinal = array index
+//   quint32  pageFirstWord[pageCount + 1]
+class TextIndex {
+public:
+    static constexpr quint32 kVersion = 1;
+
+    TextIndex() = default;
+    ~TextIndex();
+    TextIndex(const TextIndex&) = delete;
+    TextIndex& operator=(const TextIndex&) = delete;
+
+    static QString sidecarPath(const QByteArray& contentHash);
+    // Write a sidecar from per-page word lists (index = page number).
+    static bool write(const QString& path, const QVector<QVector<PageWord>>& pages);
+
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return m_base != nullptr; }
+    QString path() const { return m_file.fileName(); }
+
+    int pageCount() const;
+    int wordCount() const;
+
+    // A page's words in reading order, as extractPageWords() gave them (text case-folded).
+    QVector<PageWord> pageWords(int page) const;
+
+    // Words of the query must appear consecutively; the last one may be a
+    // prefix (the user is usually still typing it). Hits are in reading order.
+    QVector<SearchHit> find(const QString& query, int maxHits = -1) const;
+
+    // Pages the query could occur on as plain text, ascending: every word of it
+    // sits inside some word there. Never leaves out a page where a substring
+    // scan would find it; all pages if the query has no words.
+    QVector<int> pagesContaining(const QString& query) const;
+
+private:
+    struct Header;
+    struct TermEntry;
+    struct WordEntry;
+
+    const Header*    header() const;
+    const TermEntry* terms() const;
+    const char*      strings() const;
+    const quint32*   postings() const;
+    const WordEntry* words() const;
+    const quint32*   pageFirstWords() const;
+    bool entriesValid() const;
+
+    QByteArray termAt(int i) const;
+    int lowerBound(const QByteArray& term) const;      // first term >= term
+
+    QFile  m_file;
+    uchar* m_base = nullptr;
+    qint64 m_size = 0;
+};
@@ -0,0 +1,88 @@
+#include "textindexer.h"
+#include "textindex.h"
+#include "pdfcompat.h"
+
+#include <QtPdf/QPdfDocument>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+
+TextIndexer::TextIndexer(QObject* parent) : QObject(parent) {
+    // indexing is background work; leave most cores to rendering
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+TextIndexer::~TextIndexer() {
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QString TextIndexer::fileStamp(const QString& path) {
+    const QFileInfo fi(path);
+    return fi.exists() ? QString("%1:%2").arg(fi.size()).arg(fi.lastModified().toMSecsSinceEpoch()) : QString();
+}
+
+std::shared_ptr<const TextIndex> TextIndexer::index(const QString& pdfPath) const {
+    const QString path = QFileInfo(pdfPath).absoluteFilePath();
+    auto it = m_ready.constFind(path);
+    if (it == m_ready.cend() || it->stamp != fileStamp(path)) return nullptr;   // replaced since
+    return it->index;
+}
+
+bool TextIndexer::hasFailed(const QString& pdfPath) const {
+    const QString path = QFileInfo(pdfPath).absoluteFilePath();
+    auto it = m_failed.constFind(path);
+    return it != m_failed.cend() && *it == fileStamp(path);
+}
+
+void TextIndexer::ensureIndexed(const QString& pdfPath) {
+    const QString path = QFileInfo(pdfPath).absoluteFilePath();
+    if (m_inFlight.contains(path)) return;
+    // taken before hashing: a file that changes meanwhile won't match it later
+    const QString stamp = fileStamp(path);
+    if (m_failed.value(path) == stamp && !stamp.isEmpty()) {
+        // hashing and extracting it again would fail the same way
+        QMetaObject::invokeMethod(this, [this, path] { emit indexFailed(path); }, Qt::QueuedConnection);
+        return;
+    }
+    m_inFlight.insert(path);
+
+    m_pool.start([this, path, stamp] {
+        const QByteArray hash = fileContentHash(path);
+        QString sidecar;
+        if (!hash.isEmpty()) {
+            sidecar = TextIndex::sidecarPath(hash);
+
+            TextIndex existing;
+            if (!existing.open(sidecar)) {
+                // pdfium serializes all document access, so pages are read one after the
+                // other; running several files at once is where the parallelism comes from
+                QPdfDocument doc;
+                QVector<QVector<PageWord>> pages;
+                if (pdfLoadOk(doc.load(path))) {
+                    pages.resize(doc.pageCount());
+                    for (int p = 0; p < doc.pageCount(); ++p)
+                        pages[p] = extractPageWords(&doc, p);
+                }
+                if (pages.isEmpty() || !TextIndex::write(sidecar, pages))
+                    sidecar.clear();
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, path, stamp, sidecar] { finished(path, stamp, sidecar); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void TextIndexer::finished(const QString& pdfPath, const QString& stamp, const QString& sidecar) {
+    m_inFlight.remove(pdfPath);
+    auto idx = std::make_shared<TextIndex>();
+    if (sidecar.isEmpty() || !idx->open(sidecar)) {
+        m_ready.remove(pdfPath);
+        m_failed.insert(pdfPath, stamp);
+        emit indexFailed(pdfPath);
+        return;
+    }
+    m_failed.remove(pdfPath);
+    m_ready.insert(pdfPath, { stamp, idx });
+    emit indexReady(pdfPath);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <memory>
+
+class TextIndex;
+
+// Builds and hands out TextIndex sidecars in the background. Each file is hashed,
+// and if no sidecar exists for that hash yet, a worker opens its own QPdfDocument,
+// extracts every page and writes one. Indexes that are ready stay mapped, and
+// are handed out only while the file's size and mtime are what they were when
+// hashing started; a file replaced since then needs ensureIndexed() again.
+// Files that couldn't be indexed are remembered the same way and not retried
+// until they change.
+class TextIndexer : public QObject {
+    Q_OBJECT
+public:
+    explicit TextIndexer(QObject* parent = nullptr);
+    ~TextIndexer();
+
+    void ensureIndexed(const QString& pdfPath);
+    bool isIndexing(const QString& pdfPath) const { return m_inFlight.contains(pdfPath); }
+    // indexFailed() was emitted for the file as it is now
+    bool hasFailed(const QString& pdfPath) const;
+
+    // nullptr until indexReady() was emitted for the path, or if the file changed since
+    std::shared_ptr<const TextIndex> index(const QString& pdfPath) const;
+    QStringList indexedFiles() const { return m_ready.keys(); }
+
+signals:
+    void indexReady(const QString& pdfPath);
+    void indexFailed(const QString& pdfPath);
+
+private:
+    struct Ready {
+        QString stamp;   // size:mtime of the file that was indexed
+        std::shared_ptr<const TextIndex> index;
+    };
+    static QString fileStamp(const QString& path);
+    void finished(const QString& pdfPath, const QString& stamp, const QString& sidecar);
+
+    QThreadPool m_pool;
+    QSet<QString> m_inFlight;
+    QHash<QString, Ready> m_ready;
+    QHash<QString, QString> m_failed;   // path -> stamp of the file that couldn't be indexed
+};
@@ -0,0 +1,161 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+namespace Trace {
+
+std::atomic<bool> g_enabled{ false };
+
+namespace {
+constexpr int kRingSize = 1 << 14;   // spans kept per thread
+
+struct Event {
+    const char* cat;
+    const char* name;
+    qint64 startNs;
+    qint64 durNs;
+    qint64 arg;
+};
+
+struct Ring {
+    Event events[kRingSize];
+    std::atomic<quint64> written{ 0 };   // total ever recorded; slot = written % kRingSize
+    std::atomic<quint64> exportFrom{ 0 };   // clear() moves this; only the owner writes events
+    int tid = 0;
+    QString name;
+    bool inUse = true;   // a live thread records into it
+};
+
+// Rings live until exit (a thread's spans stay exportable after it ends), but
+// one whose thread has ended goes to the next new thread: pools drop idle
+// threads and start new ones all the time, so a ring per thread ever would grow
+// without bound. The new thread continues on the same track, after the old one's spans.
+struct Registry {
+    QMutex lock;
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+thread_local Ring* t_ring = nullptr;
+
+// Hands the thread's ring back when the thread ends.
+struct RingLease {
+    ~RingLease() {
+        if (!t_ring) return;
+        QMutexLocker lock(&registry().lock);
+        t_ring->inUse = false;
+        t_ring = nullptr;
+    }
+};
+thread_local RingLease t_lease;
+
+Ring* threadRing() {
+    if (t_ring) return t_ring;
+    Registry& reg = registry();
+    QMutexLocker lock(&reg.lock);
+    Ring* ring = nullptr;
+    for (const auto& r : reg.rings)
+        if (!r->inUse) { ring = r.get(); break; }
+    if (!ring) {
+        reg.rings.push_back(std::make_unique<Ring>());
+        ring = reg.rings.back().get();
+        ring->tid = int(reg.rings.size());
+    }
+    ring->inUse = true;
+    ring->name = QThread::currentThread()->objectName();
+    if (ring->name.isEmpty())
+        ring->name = QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread()
+                   ? QStringLiteral("GUI") : QStringLiteral("worker %1").arg(ring->tid);
+    (void)&t_lease;   // constructs it, so its destructor runs when this thread ends
+    t_ring = ring;
+    return t_ring;
+}
+
+QByteArray jsonString(const char* s) {
+    QByteArray out = "\"";
+    for (const char* p = s; *p; ++p) {
+        if (*p == '"' || *p == '\\') out += '\\';
+        out += *p;
+    }
+    return out + '"';
+}
+}
+
+void setEnabled(bool on) { g_enabled.store(on, std::memory_order_relaxed); }
+
+qint64 nowNs() {
+    static QElapsedTimer clock = [] { QElapsedTimer t; t.start(); return t; }();
+    return clock.nsecsElapsed();
+}
+
+void record(const char* cat, const char* name, qint64 startNs, qint64 durNs, qint64 arg) {
+    Ring* ring = threadRing();
+    const quint64 n = ring->written.load(std::memory_order_relaxed);
+    ring->events[n % kRingSize] = { cat, name, startNs, durNs, arg };
+    ring->written.store(n + 1, std::memory_order_release);
+}
+
+void setThreadName(const QString& name) {
+    Ring* ring = threadRing();
+    QMutexLocker lock(&registry().lock);
+    ring->name = name;
+}
+
+// Rings are written without a lock, so they aren't touched here: clearing only
+// moves each ring's export start past what's in it now.
+void clear() {
+    Registry& reg = registry();
+    QMutexLocker lock(&reg.lock);
+    for (auto& ring : reg.rings)
+        ring->exportFrom.store(ring->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+// Spans being written while we copy can come out torn; it's a diagnostic
+// dump, so that's accepted rather than locking the record path.
+bool exportChromeJson(const QString& path) {
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&] { if (!first) out += ",\n"; first = false; };
+
+    Registry& reg = registry();
+    QMutexLocker lock(&reg.lock);
+    for (const auto& ring : reg.rings) {
+        sep();
+        out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + QByteArray::number(ring->tid)
+             + ",\"args\":{\"name\":\"" + ring->name.toUtf8().replace('"', "'") + "\"}}";
+
+        const quint64 written = ring->written.load(std::memory_order_acquire);
+        const quint64 from = qMax(ring->exportFrom.load(std::memory_order_relaxed),
+                                  written > quint64(kRingSize) ? written - kRingSize : 0);
+        for (quint64 i = from; i < written; ++i) {
+            const Event e = ring->events[i % kRingSize];
+            if (!e.cat || !e.name) continue;
+            sep();
+            out += "{\"ph\":\"X\",\"cat\":" + jsonString(e.cat) + ",\"name\":" + jsonString(e.name)
+                 + ",\"pid\":1,\"tid\":" + QByteArray::number(ring->tid)
+                 + ",\"ts\":" + QByteArray::number(e.startNs / 1000.0, 'f', 3)
+                 + ",\"dur\":" + QByteArray::number(e.durNs / 1000.0, 'f', 3);
+            if (e.arg >= 0) out += ",\"args\":{\"value\":" + QByteArray::number(e.arg) + '}';
+            out += '}';
+        }
+        if (out.size() > (1 << 20)) { f.write(out); out.clear(); }
+    }
+    out += "\n]}\n";
+    return f.write(out) == out.size();
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <QString>
+#include <atomic>
+
+// Span tracing for the hot paths. Every thread records into its own
+// fixed-size ring buffer (no locks, oldest spans get overwritten), and
+// exportChromeJson() writes everything in the Chrome trace-event format
+// (chrome://tracing, Perfetto). While tracing is off a span costs one relaxed
+// atomic load, so the macros stay in release builds.
+//
+//   TRACE_SPAN("render", "page");            // until the end of the scope
+//   TRACE_SPAN_ARG("render", "page", page);  // same, with an int shown as args.value
+//
+// cat and name must be string literals (only the pointers are stored).
+namespace Trace {
+
+extern std::atomic<bool> g_enabled;
+
+inline bool isEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool on);
+
+qint64 nowNs();   // monotonic, process-relative
+void record(const char* cat, const char* name, qint64 startNs, qint64 durNs, qint64 arg);
+void setThreadName(const QString& name);   // label for the current thread in the export
+
+bool exportChromeJson(const QString& path);
+void clear();   // forget what was recorded so far (the next export starts after it)
+
+class Span {
+public:
+    Span(const char* cat, const char* name, qint64 arg = -1)
+        : m_cat(cat), m_name(name), m_arg(arg), m_start(isEnabled() ? nowNs() : -1) {}
+    ~Span() {
+        if (m_start >= 0) record(m_cat, m_name, m_start, nowNs() - m_start, m_arg);
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* m_cat;
+    const char* m_name;
+    qint64      m_arg;
+    qint64      m_start;
+};
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(cat, name) Trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(cat, name)
+#define TRACE_SPAN_ARG(cat, name, arg) Trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(cat, name, qint64(arg))
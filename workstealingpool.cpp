@@ -0,0 +1,93 @@
+#include "workstealingpool.h"
+
+namespace {
+thread_local const WorkStealingPool* t_pool = nullptr;
+thread_local int t_worker = -1;
+}
+
+WorkStealingPool::WorkStealingPool(int threads) {
+    const int n = qMax(1, threads);
+    for (int i = 0; i < n; ++i) m_workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < n; ++i) {
+        m_workers[size_t(i)]->thread = QThread::create([this, i] { run(i); });
+        m_workers[size_t(i)]->thread->start();
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    waitForDone();
+    {
+        QMutexLocker lock(&m_idleLock);
+        m_stop = true;
+        m_wake.wakeAll();
+    }
+    for (auto& w : m_workers) {
+        w->thread->wait();
+        delete w->thread;
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    const int self = t_pool == this ? t_worker : -1;
+    const int target = self >= 0 ? self : int(m_nextWorker.fetchAndAddRelaxed(1) % quint32(m_workers.size()));
+
+    m_pending.fetchAndAddOrdered(1);
+    {
+        Worker& w = *m_workers[size_t(target)];
+        QMutexLocker lock(&w.lock);
+        w.tasks.push_back(std::move(task));
+    }
+    m_queued.fetchAndAddOrdered(1);
+
+    QMutexLocker lock(&m_idleLock);   // pairs with the check in run(): no lost wakeup
+    m_wake.wakeOne();
+}
+
+void WorkStealingPool::waitForDone() {
+    QMutexLocker lock(&m_idleLock);
+    while (m_pending.loadAcquire() > 0) m_idle.wait(&m_idleLock);
+}
+
+bool WorkStealingPool::popLocal(int index, Task* out) {
+    Worker& w = *m_workers[size_t(index)];
+    QMutexLocker lock(&w.lock);
+    if (w.tasks.empty()) return false;
+    *out = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int thief, Task* out) {
+    const int n = int(m_workers.size());
+    for (int k = 1; k < n; ++k) {
+        Worker& w = *m_workers[size_t((thief + k) % n)];
+        QMutexLocker lock(&w.lock);
+        if (w.tasks.empty()) continue;
+        *out = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        m_steals.fetchAndAddRelaxed(1);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int index) {
+    t_pool = this;
+    t_worker = index;
+    for (;;) {
+        Task task;
+        if (popLocal(index, &task) || steal(index, &task)) {
+            m_queued.fetchAndSubOrdered(1);
+            task();
+            task = nullptr;   // drop captures before we count the task as done
+            if (m_pending.fetchAndSubOrdered(1) == 1) {
+                QMutexLocker lock(&m_idleLock);
+                m_idle.wakeAll();
+            }
+            continue;
+        }
+        QMutexLocker lock(&m_idleLock);
+        if (m_stop) return;
+        if (m_queued.loadAcquire() == 0) m_wake.wait(&m_idleLock);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A task submitted from
+// a worker goes on that worker's own deque, and the worker pops from the back
+// (so the pages of the file it just opened run next, while that document is
+// warm). Idle workers steal from the front of the others' deques, so they take
+// the oldest work. Tasks from outside the pool are dealt round-robin.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(int threads = QThread::idealThreadCount());
+    ~WorkStealingPool();   // finishes everything queued
+
+    void submit(Task task);
+    void waitForDone();
+
+    int threadCount() const { return int(m_workers.size()); }
+    quint64 stealCount() const { return m_steals.loadRelaxed(); }
+
+private:
+    struct Worker {
+        QMutex           lock;
+        std::deque<Task> tasks;
+        QThread*         thread = nullptr;
+    };
+
+    void run(int index);
+    bool popLocal(int index, Task* out);
+    bool steal(int thief, Task* out);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    QMutex                  m_idleLock;
+    QWaitCondition          m_wake;       // work was queued, or shutdown
+    QWaitCondition          m_idle;       // nothing pending any more
+    QAtomicInteger<qint64>  m_queued = 0;    // sitting in a deque
+    QAtomicInteger<qint64>  m_pending = 0;   // submitted and not finished
+    QAtomicInteger<quint64> m_steals = 0;
+    QAtomicInteger<quint32> m_nextWorker = 0;
+    bool                    m_stop = false;  // guarded by m_idleLock
+};